@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE 16384
+#define ARENA_ALIGN 16
+#define ARENA_RETAIN_MAX (256 * 1024)   // most an idle arena keeps between requests
+
+static _Atomic unsigned long chunk_mallocs;
+
+static struct arena_chunk *chunk_new(size_t size, struct arena_chunk *next) {
+    if (size < ARENA_CHUNK_SIZE) size = ARENA_CHUNK_SIZE;
+    struct arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+    if (!chunk) {
+        perror("arena");
+        abort();
+    }
+    atomic_fetch_add_explicit(&chunk_mallocs, 1, memory_order_relaxed);
+    chunk->next = next;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+unsigned long arena_malloc_count(void) {
+    return atomic_load_explicit(&chunk_mallocs, memory_order_relaxed);
+}
+
+// Make sure the head chunk has size free bytes at an aligned offset
+static void arena_ensure(struct arena *arena, size_t size) {
+    struct arena_chunk *head = arena->head;
+    if (head) {
+        size_t start = (head->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        if (start <= head->size && head->size - start >= size) {
+            head->used = start;
+            return;
+        }
+    }
+    // Grow geometrically so a large request settles after a few chunks
+    size_t chunk_size = head ? head->size * 2 : ARENA_CHUNK_SIZE;
+    arena->head = chunk_new(size > chunk_size ? size : chunk_size, head);
+}
+
+void *arena_alloc(struct arena *arena, size_t size) {
+    arena_ensure(arena, size);
+    void *ptr = arena->head->data + arena->head->used;
+    arena->head->used += size;
+    return ptr;
+}
+
+void *arena_grow(struct arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    struct arena_chunk *head = arena->head;
+    if (ptr && head && (char *)ptr + old_size == head->data + head->used &&
+        (size_t)((char *)ptr - head->data) + new_size <= head->size) {
+        head->used += new_size - old_size;
+        return ptr;
+    }
+    void *grown = arena_alloc(arena, new_size);
+    if (ptr) memcpy(grown, ptr, old_size);
+    return grown;
+}
+
+char *arena_reserve(struct arena *arena, size_t max) {
+    arena_ensure(arena, max);
+    arena->reserved = max;
+    return arena->head->data + arena->head->used;
+}
+
+void arena_commit(struct arena *arena, size_t used) {
+    if (used > arena->reserved) used = arena->reserved;
+    arena->head->used += used;
+    arena->reserved = 0;
+}
+
+void arena_reset(struct arena *arena) {
+    struct arena_chunk *head = arena->head;
+    arena->reserved = 0;
+    if (!head) return;
+
+    // Chunks grow geometrically, so the newest is the largest: keep it alone
+    struct arena_chunk *chunk = head->next;
+    while (chunk) {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    head->next = NULL;
+    head->used = 0;
+    if (head->size > ARENA_RETAIN_MAX) {
+        free(head);
+        arena->head = NULL;
+    }
+}
+
+void arena_free(struct arena *arena) {
+    while (arena->head) {
+        struct arena_chunk *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    arena->reserved = 0;
+}
+
+// ---------- OUTPUT BUFFERS ----------
+
+void outbuf_init(struct outbuf *out, struct arena *arena, size_t limit) {
+    out->data = NULL;
+    out->len = out->cap = 0;
+    out->limit = limit;
+    out->dropped = 0;
+    out->arena = arena;
+}
+
+// Make room for need more bytes plus the terminating NUL
+static void outbuf_ensure(struct outbuf *out, size_t need) {
+    if (out->len + need + 1 <= out->cap) return;
+    size_t cap = out->cap ? out->cap : 256;
+    while (cap < out->len + need + 1) cap *= 2;
+    if (out->arena) {
+        out->data = arena_grow(out->arena, out->data, out->cap, cap);
+    } else {
+        out->data = realloc(out->data, cap);
+        if (!out->data) {
+            perror("outbuf");
+            abort();
+        }
+    }
+    out->cap = cap;
+}
+
+char *outbuf_reserve(struct outbuf *out, size_t max, size_t *room) {
+    size_t left = out->limit - out->len;
+    *room = max < left ? max : left;
+    outbuf_ensure(out, *room);
+    return out->data + out->len;
+}
+
+void outbuf_commit(struct outbuf *out, size_t used) {
+    out->len += used;
+    out->data[out->len] = '\0';
+}
+
+void outbuf_append(struct outbuf *out, const char *data, size_t len) {
+    size_t room;
+    char *dst = outbuf_reserve(out, len, &room);
+    memcpy(dst, data, room);
+    outbuf_commit(out, room);
+    out->dropped += len - room;
+}
+
+void outbuf_printf(struct outbuf *out, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out->data ? out->data + out->len : NULL,
+                      out->data ? out->cap - out->len : 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if (out->data && out->len + n < out->cap && out->len + n <= out->limit) {
+        out->len += n;
+        return;
+    }
+
+    // Did not fit: format again into a large enough buffer
+    size_t room;
+    char *dst = outbuf_reserve(out, n, &room);
+    va_start(ap, fmt);
+    if ((size_t)n == room) {
+        vsnprintf(dst, room + 1, fmt, ap);
+    } else {
+        char *tmp = malloc(n + 1);
+        vsnprintf(tmp, n + 1, fmt, ap);
+        memcpy(dst, tmp, room);
+        free(tmp);
+    }
+    va_end(ap);
+    outbuf_commit(out, room);
+    out->dropped += n - room;
+}
+
+void outbuf_free(struct outbuf *out) {
+    if (!out->arena) free(out->data);
+    out->data = NULL;
+    out->len = out->cap = 0;
+}
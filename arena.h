@@ -0,0 +1,69 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator for memory that lives exactly as long as one request.
+// Allocations are never freed individually; arena_reset() or arena_free()
+// releases everything at once. Not thread-safe: each request owns its arena.
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size, used;
+    char data[];
+};
+
+struct arena {
+    struct arena_chunk *head;    // chunk being allocated from
+    size_t reserved;             // bytes handed out by the open arena_reserve()
+};
+
+#define ARENA_INIT { NULL, 0 }
+
+// Aligned for any type; never returns NULL (aborts when out of memory)
+void *arena_alloc(struct arena *arena, size_t size);
+
+// Resize the allocation at ptr (old_size bytes). The most recent allocation
+// grows in place when its chunk has room; otherwise the bytes are copied.
+void *arena_grow(struct arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+// Open-ended allocation: returns room for at least max bytes at the end of
+// the arena. Nothing else may be allocated until arena_commit() says how
+// many of them were used.
+char *arena_reserve(struct arena *arena, size_t max);
+void arena_commit(struct arena *arena, size_t used);
+
+// Drop every allocation. The largest chunk is kept (up to a cap), so once a
+// connection has seen its biggest request the next ones allocate nothing.
+void arena_reset(struct arena *arena);
+void arena_free(struct arena *arena);
+
+// Process-wide count of chunk mallocs, for allocations-per-request figures
+unsigned long arena_malloc_count(void);
+
+// ---------- OUTPUT BUFFERS ----------
+// Growable byte buffer with an explicit length, used for command output and
+// the responses built from it. Lives in an arena, or on the heap when arena
+// is NULL. Bytes past limit are dropped and counted. data is always
+// NUL-terminated for convenience but may contain NULs itself.
+struct outbuf {
+    char *data;
+    size_t len, cap;
+    size_t limit;
+    size_t dropped;
+    struct arena *arena;
+};
+
+void outbuf_init(struct outbuf *out, struct arena *arena, size_t limit);
+void outbuf_append(struct outbuf *out, const char *data, size_t len);
+void outbuf_printf(struct outbuf *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Room for up to max more bytes (fewer near the limit, possibly 0); the
+// caller writes into it and reports what it used with outbuf_commit()
+char *outbuf_reserve(struct outbuf *out, size_t max, size_t *room);
+void outbuf_commit(struct outbuf *out, size_t used);
+
+// Heap-backed buffers only
+void outbuf_free(struct outbuf *out);
+
+#endif
@@ -0,0 +1,228 @@
+// Differential fuzzer for json_escape() and url_decode(). Each input is run
+// through both and compared with byte-at-a-time reference versions:
+//   - the escaped output must equal the reference exactly, or be a prefix of
+//     it that ends on an escape boundary when the outbuf limit cut it short,
+//     and must never exceed the limit;
+//   - the decoded output must equal the reference truncated to the buffer
+//     size, with the bytes after the buffer untouched.
+// The first input byte picks the limits, so the truncation paths get fuzzed
+// as well. Seeds are in bench/corpus/escape.
+//
+// Standalone (runs the given files, then random inputs):
+//   gcc -O2 -g -fsanitize=address,undefined bench/escape_fuzz.c escape.c arena.c textscan.c -o escape_fuzz
+//   ./escape_fuzz [-n iterations] bench/corpus/escape/*
+//   for s in avx2 sse2 scalar; do WEBSHELL_SIMD=$s ./escape_fuzz bench/corpus/escape/*; done
+// libFuzzer:
+//   clang -O1 -g -fsanitize=fuzzer,address,undefined -DESCAPE_FUZZ_LIBFUZZER
+//         bench/escape_fuzz.c escape.c arena.c textscan.c -o escape_fuzz
+//   ./escape_fuzz bench/corpus/escape
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../escape.h"
+#include "../textscan.h"
+
+#define GUARD 64
+
+static void fail(const char *what, const uint8_t *data, size_t size) {
+    fprintf(stderr, "escape_fuzz: %s (input of %zu bytes, saved to escape_fuzz.crash)\n", what, size);
+    FILE *f = fopen("escape_fuzz.crash", "wb");
+    if (f) {
+        fwrite(data, 1, size, f);
+        fclose(f);
+    }
+    abort();
+}
+
+// ---------- REFERENCES ----------
+
+static size_t ref_utf8(const unsigned char *s, size_t len) {
+    uint32_t cp;
+    size_t n;
+    if (s[0] < 0x80) return 0;
+    else if ((s[0] & 0xe0) == 0xc0) { n = 2; cp = s[0] & 0x1f; }
+    else if ((s[0] & 0xf0) == 0xe0) { n = 3; cp = s[0] & 0x0f; }
+    else if ((s[0] & 0xf8) == 0xf0) { n = 4; cp = s[0] & 0x07; }
+    else return 0;
+    if (len < n) return 0;
+    for (size_t i = 1; i < n; i++) {
+        if ((s[i] & 0xc0) != 0x80) return 0;
+        cp = cp << 6 | (s[i] & 0x3f);
+    }
+    static const uint32_t min[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (cp < min[n] || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) return 0;
+    return n;
+}
+
+// Escapes of the whole input, one unit per input character: ends[k] is the
+// output length after unit k, so any prefix cut must land on one of them
+static size_t ref_escape(const unsigned char *s, size_t len, char *out, size_t *ends, size_t *units) {
+    size_t j = 0, k = 0;
+    for (size_t i = 0; i < len;) {
+        size_t n = ref_utf8(s + i, len - i);
+        if (n) {
+            memcpy(out + j, s + i, n);
+            j += n;
+            i += n;
+        } else {
+            unsigned char c = s[i++];
+            if (c == '"') j += sprintf(out + j, "\\\"");
+            else if (c == '\\') j += sprintf(out + j, "\\\\");
+            else if (c == '\n') j += sprintf(out + j, "\\n");
+            else if (c == '\r') j += sprintf(out + j, "\\r");
+            else if (c == '\t') j += sprintf(out + j, "\\t");
+            else if (c == '\b') j += sprintf(out + j, "\\b");
+            else if (c == '\f') j += sprintf(out + j, "\\f");
+            else if (c < 0x20) j += sprintf(out + j, "\\u%04x", c);
+            else if (c >= 0x80) j += sprintf(out + j, "\\ufffd");
+            else out[j++] = c;
+        }
+        ends[k++] = j;
+    }
+    *units = k;
+    return j;
+}
+
+static size_t ref_decode(const char *s, size_t len, char *out) {
+    size_t j = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '+') out[j++] = ' ';
+        else if (s[i] == '%' && i + 2 < len && isxdigit((unsigned char)s[i + 1]) &&
+                 isxdigit((unsigned char)s[i + 2])) {
+            char hex[3] = { s[i + 1], s[i + 2], 0 };
+            out[j++] = strtol(hex, NULL, 16);
+            i += 2;
+        } else {
+            out[j++] = s[i];
+        }
+    }
+    return j;
+}
+
+// ---------- ONE INPUT ----------
+
+static void check_escape(const uint8_t *data, size_t size, const uint8_t *src, size_t len, size_t limit) {
+    char *want = malloc(len * 6 + 1);
+    size_t *ends = malloc((len + 1) * sizeof(size_t)), units;
+    size_t want_len = ref_escape(src, len, want, ends, &units);
+
+    // Start with some output already in the buffer, as the server does
+    struct outbuf out;
+    outbuf_init(&out, NULL, limit + 12);
+    outbuf_append(&out, "{\"output\": \"", 12);
+    json_escape(&out, (const char *)src, len);
+    size_t got = out.len - 12;
+
+    if (out.len > limit + 12) fail("json_escape exceeded the limit", data, size);
+    if (got > want_len || memcmp(out.data + 12, want, got) != 0) fail("json_escape output differs", data, size);
+    if (got < want_len) {
+        // Cut short: must be at a unit boundary, and the next unit must not have fit
+        size_t k = 0;
+        while (ends[k] < got) k++;
+        if (got && ends[k] != got) fail("json_escape stopped mid-escape", data, size);
+        size_t done = got ? k + 1 : 0;
+        if (ends[done] <= limit) fail("json_escape stopped early", data, size);
+    }
+    outbuf_free(&out);
+    free(ends);
+    free(want);
+}
+
+static void check_decode(const uint8_t *data, size_t size, const char *src, size_t len, size_t room) {
+    char *want = malloc(len + 1);
+    size_t want_len = ref_decode(src, len, want);
+    char *dst = malloc(room + GUARD);
+    memset(dst, 0xa5, room + GUARD);
+    size_t got = url_decode(dst, room, src, len);
+
+    size_t expect = want_len < room - 1 ? want_len : room - 1;
+    // A cut can fall inside a %XX escape only at its start, so the prefix matches
+    if (got != expect || memcmp(dst, want, got) != 0 || dst[got] != '\0')
+        fail("url_decode output differs", data, size);
+    for (size_t i = room; i < room + GUARD; i++)
+        if ((unsigned char)dst[i] != 0xa5) fail("url_decode wrote past the buffer", data, size);
+    free(dst);
+    free(want);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) return 0;
+    // Low bits of the first byte: 0 means no limit, otherwise a small limit
+    size_t len = size - 1, sel = data[0];
+    size_t escape_limit = sel & 0x0f ? (sel & 0x0f) * len / 8 + (sel >> 4) : SIZE_MAX - 64;
+    size_t decode_room = sel & 0x0f ? (sel & 0x0f) * len / 16 + 1 : len + 1;
+    check_escape(data, size, data + 1, len, escape_limit);
+    check_decode(data, size, (const char *)data + 1, len, decode_room);
+    return 0;
+}
+
+// ---------- STANDALONE DRIVER ----------
+
+#ifndef ESCAPE_FUZZ_LIBFUZZER
+static void run_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    static uint8_t buf[1 << 20];
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    // Every limit selector over each seed
+    uint8_t *input = malloc(n + 1);
+    memcpy(input, buf, n);
+    for (int sel = 0; sel < 256; sel++) {
+        if (n) input[0] = sel;
+        LLVMFuzzerTestOneInput(input, n);
+    }
+    free(input);
+}
+
+// Random input biased towards the interesting bytes, long enough to cross
+// the SIMD widths and the json_escape block size
+static size_t random_input(uint8_t *buf, size_t max, unsigned *seed) {
+    static const char special[] = "\"\\\n\r\t\x01\x1f\x7f%+0aF ";
+    static const uint8_t utf8[][4] = { { 0xc3, 0xa9 }, { 0xe2, 0x82, 0xac }, { 0xf0, 0x9f, 0x98, 0x80 },
+                                       { 0xed, 0xa0, 0x80 }, { 0xc0, 0xaf }, { 0xf4, 0x90, 0x80, 0x80 } };
+    size_t len = rand_r(seed) % 4 == 0 ? rand_r(seed) % max : (size_t)(rand_r(seed) % 80);
+    size_t i = 0;
+    buf[i++] = rand_r(seed);
+    int density = rand_r(seed) % 64 + 1;
+    while (i < len) {
+        int r = rand_r(seed) % density;
+        if (r == 0) buf[i++] = special[rand_r(seed) % (sizeof(special) - 1)];
+        else if (r == 1 && i + 4 <= len) {
+            const uint8_t *seq = utf8[rand_r(seed) % 6];
+            size_t n = rand_r(seed) % 8 == 0 ? 1 : (seq[0] >= 0xf0 ? 4 : seq[0] >= 0xe0 ? 3 : 2);
+            memcpy(buf + i, seq, n);
+            i += n;
+        } else if (r == 2) buf[i++] = rand_r(seed);
+        else buf[i++] = 'a' + rand_r(seed) % 26;
+    }
+    return i;
+}
+
+int main(int argc, char **argv) {
+    long iterations = 200000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') iterations = atol(optarg);
+        else {
+            fprintf(stderr, "usage: %s [-n iterations] [corpus_file...]\n", argv[0]);
+            return 2;
+        }
+    }
+    for (int i = optind; i < argc; i++) run_file(argv[i]);
+
+    static uint8_t buf[3 * 4096 + 100];
+    unsigned seed = 1;
+    for (long i = 0; i < iterations; i++)
+        LLVMFuzzerTestOneInput(buf, random_input(buf, sizeof(buf), &seed));
+    printf("escape_fuzz: %d files, %ld random inputs ok (%s)\n", argc - optind, iterations, scan_impl());
+    return 0;
+}
+#endif
@@ -0,0 +1,132 @@
+// In-process wc/grep/head/tail versus the coreutils binaries on a large
+// generated log file. Both go through execute_shell_command(); the system
+// versions are named by path (/usr/bin/wc) so they are spawned as usual.
+// Also reports the throughput of each textscan kernel on the file.
+//
+// Build (from the repo root):
+//   gcc -O2 -pthread bench/filter_bench.c shell.c session.c metrics.c lexer.c arena.c textscan.c result_cache.c history.c -o filter_bench
+// Run:
+//   ./filter_bench [size_mb] [runs]            (default 1024 MB, best of 3)
+//   for s in avx2 sse2 scalar; do WEBSHELL_SIMD=$s ./filter_bench; done
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../shell.h"
+#include "../textscan.h"
+
+#define FILE_PATH "/tmp/filter_bench.log"
+#define OUTPUT_LIMIT (64 << 20)
+
+// Each pair is run with %s replaced by the file
+static const char *commands[][2] = {
+    { "wc -l %s",                 "/usr/bin/wc -l %s" },
+    { "wc %s",                    "/usr/bin/wc %s" },
+    { "grep -c ERROR %s",         "/usr/bin/grep -c ERROR %s" },
+    { "grep -n ERROR %s",         "/usr/bin/grep -n ERROR %s" },
+    { "grep -vc status %s",       "/usr/bin/grep -vc status %s" },
+    { "head -n 1000 %s",          "/usr/bin/head -n 1000 %s" },
+    { "tail -n 1000 %s",          "/usr/bin/tail -n 1000 %s" },
+    { "cat %s | wc -l",           "cat %s | /usr/bin/wc -l" },
+    { "cat %s | grep -c ERROR",   "cat %s | /usr/bin/grep -c ERROR" },
+};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Log-like lines with a rare ERROR, until the file has size bytes
+static int generate(off_t size) {
+    struct stat st;
+    if (stat(FILE_PATH, &st) == 0 && st.st_size == size) return 0;
+    FILE *file = fopen(FILE_PATH, "w");
+    if (!file) return -1;
+    char line[256];
+    for (unsigned long i = 0; ftello(file) < size; i++) {
+        int n = snprintf(line, sizeof(line),
+                         "2024-05-01T12:%02lu:%02lu host%02lu api[%lu]: GET /v1/items/%lu %s took=%lums\n",
+                         i / 60 % 60, i % 60, i % 17, 1000 + i % 300, i * 7919 % 100000,
+                         i % 9973 == 0 ? "ERROR upstream reset" : "status=200", i % 250);
+        if (ftello(file) + n > size) n = size - ftello(file);
+        fwrite(line, 1, n, file);
+    }
+    fclose(file);
+    return truncate(FILE_PATH, size);
+}
+
+// Best wall time of runs executions; keeps the last output in out
+static double best_time(const char *command, struct outbuf *out, int runs) {
+    double best = 1e9;
+    for (int i = 0; i < runs; i++) {
+        char input[256];
+        snprintf(input, sizeof(input), command, FILE_PATH);
+        outbuf_free(out);
+        outbuf_init(out, NULL, OUTPUT_LIMIT);
+        double start = now_s();
+        execute_shell_command(input, out);
+        double elapsed = now_s() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    long size_mb = argc > 1 ? atol(argv[1]) : 1024;
+    int runs = argc > 2 ? atoi(argv[2]) : 3;
+    if (size_mb < 1) size_mb = 1;
+    if (runs < 1) runs = 1;
+    double gb = size_mb / 1024.0;
+
+    executor_start();
+    if (generate((off_t)size_mb << 20) < 0) {
+        perror(FILE_PATH);
+        return 1;
+    }
+
+    // Kernels alone, over the mapped file
+    int fd = open(FILE_PATH, O_RDONLY);
+    size_t len = (size_t)size_mb << 20;
+    const char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    printf("%ld MB, kernels: %s, best of %d\n\n", size_mb, scan_impl(), runs);
+    double start = now_s();
+    volatile size_t sink = scan_count(map, len, '\n');
+    printf("%-34s %8.3f s  %6.2f GB/s\n", "scan_count('\\n')", now_s() - start, gb / (now_s() - start));
+    int in_word = 0;
+    start = now_s();
+    sink += scan_words(map, len, &in_word);
+    printf("%-34s %8.3f s  %6.2f GB/s\n", "scan_words", now_s() - start, gb / (now_s() - start));
+    start = now_s();
+    sink += scan_find(map, len, "no such text", 12) != NULL;
+    printf("%-34s %8.3f s  %6.2f GB/s\n\n", "scan_find (no match)", now_s() - start, gb / (now_s() - start));
+    munmap((void *)map, len);
+    (void)sink;
+
+    printf("%-34s %10s %10s %8s\n", "command", "in-process", "coreutils", "speedup");
+    struct outbuf builtin = {0}, system = {0};
+    int mismatches = 0;
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        double ours = best_time(commands[i][0], &builtin, runs);
+        double theirs = best_time(commands[i][1], &system, runs);
+        int same = builtin.len == system.len && memcmp(builtin.data, system.data, builtin.len) == 0;
+        mismatches += !same;
+        char name[64];
+        snprintf(name, sizeof(name), commands[i][0], "log");
+        printf("%-34s %8.3f s %8.3f s %7.2fx%s\n", name, ours, theirs, theirs / ours, same ? "" : "  OUTPUT DIFFERS");
+    }
+    outbuf_free(&builtin);
+    outbuf_free(&system);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+// Lexer throughput: the arena-backed quoting lexer (lexer.c) versus the old
+// copy + strtok_r split, in tokens per second over a corpus of typical
+// command lines. With several threads every thread lexes the corpus with its
+// own arena, which also exercises the lexer's reentrancy.
+//
+// Build (from the repo root):
+//   gcc -O2 -pthread bench/lexer_bench.c lexer.c arena.c -o lexer_bench
+// Run:
+//   ./lexer_bench [passes] [threads]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../lexer.h"
+
+#define BUFFER_SIZE 4096
+#define MAX_ARGS 100
+
+static const char *corpus[] = {
+    "ls -la",
+    "ls | grep .c | wc -l",
+    "cat server.c | grep -n include",
+    "ps aux --sort=-%mem | head -n 20",
+    "df -h",
+    "du -sh /var/log/* 2>&1 | sort -h | tail -5",
+    "grep -rn \"TODO\" --include='*.c' .",
+    "find . -name '*.o' -type f -newer Makefile",
+    "echo 'hello, world' > greeting.txt",
+    "cat < input.txt | tr a-z A-Z >> upper.txt",
+    "git log --oneline -n 20 --author=\"Jane Doe\"",
+    "tar czf backup.tar.gz src/ include/ docs/",
+    "awk -F: '{ print $1, $7 }' /etc/passwd | column -t",
+    "sed -e 's/foo/bar/g' -e \"s/\\\"quoted\\\"/plain/\" notes.txt",
+    "curl -s -H 'Accept: application/json' http://localhost:5000/status",
+    "uname -a",
+    "whoami",
+    "mkdir my\\ project",
+    "cd /tmp",
+    "cal 2026",
+    "head -c 1024 /dev/urandom | base64 | head -3",
+    "journalctl -u nginx --since \"1 hour ago\" | grep -i error",
+    "cut -d, -f2,5 data.csv | sort | uniq -c | sort -rn | head",
+    "stat -c '%n %s %y' *.c",
+};
+
+#define CORPUS_SIZE (int)(sizeof(corpus) / sizeof(corpus[0]))
+
+struct run {
+    int passes;
+    long tokens;
+    double seconds;
+    int use_lexer;
+};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// What parse_input() used to do
+static int strtok_split(const char *line, char **args) {
+    char temp[BUFFER_SIZE];
+    snprintf(temp, sizeof(temp), "%s", line);
+    char *save;
+    int n = 0;
+    for (char *tok = strtok_r(temp, " \t\n", &save); tok && n < MAX_ARGS - 1;
+         tok = strtok_r(NULL, " \t\n", &save))
+        args[n++] = tok;
+    args[n] = NULL;
+    return n;
+}
+
+static void *run_bench(void *arg) {
+    struct run *run = arg;
+    struct arena arena = ARENA_INIT;
+    char *args[MAX_ARGS];
+    long tokens = 0;
+
+    double start = now_s();
+    for (int pass = 0; pass < run->passes; pass++) {
+        for (int i = 0; i < CORPUS_SIZE; i++) {
+            if (run->use_lexer) {
+                struct lexer lx;
+                struct token tok;
+                lexer_init(&lx, corpus[i], &arena);
+                while (lexer_next(&lx, &tok) != TOK_END) tokens++;
+                arena_reset(&arena);
+            } else {
+                tokens += strtok_split(corpus[i], args);
+            }
+        }
+    }
+    run->seconds = now_s() - start;
+    run->tokens = tokens;
+    arena_free(&arena);
+    return NULL;
+}
+
+static void report(const char *name, int passes, int threads, int use_lexer) {
+    pthread_t tids[threads];
+    struct run runs[threads];
+    for (int t = 0; t < threads; t++) {
+        runs[t] = (struct run){ passes, 0, 0, use_lexer };
+        pthread_create(&tids[t], NULL, run_bench, &runs[t]);
+    }
+
+    long tokens = 0;
+    double slowest = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        tokens += runs[t].tokens;
+        if (runs[t].seconds > slowest) slowest = runs[t].seconds;
+    }
+    long lines = (long)passes * CORPUS_SIZE * threads;
+    printf("%-8s %12.0f tokens/s   %8.1f ns/line   (%ld tokens)\n",
+           name, tokens / slowest, slowest * 1e9 * threads / lines, tokens);
+}
+
+int main(int argc, char **argv) {
+    int passes = argc > 1 ? atoi(argv[1]) : 200000;
+    int threads = argc > 2 ? atoi(argv[2]) : 1;
+    if (passes < 1) passes = 1;
+    if (threads < 1) threads = 1;
+
+    printf("%d command lines x %d passes, %d thread(s)\n", CORPUS_SIZE, passes, threads);
+    report("strtok", passes, threads, 0);
+    report("lexer", passes, threads, 1);
+    return 0;
+}
@@ -0,0 +1,364 @@
+// HTTP load generator for the server, over loopback only. Each connection
+// is a thread that sends a request, reads the whole response and sends the
+// next, for a fixed time; latencies of every request are kept and reported
+// as percentiles. Like a browser, each connection keeps the session cookie
+// its first command is given and sends it with the rest.
+//
+// Build (from the repo root):
+//   gcc -O2 -pthread bench/loadgen.c -o loadgen
+// Run (with ./server listening):
+//   ./loadgen [-c connections] [-d seconds] [-p port] [-r get|execute|mix]
+//             [-C command] [-n] [-j]
+//   -n opens a new connection for every request instead of keep-alive;
+//   -j prints one JSON object instead of the table.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+enum route { ROUTE_GET, ROUTE_EXECUTE, ROUTE_MIX };
+
+struct options {
+    int connections;
+    double seconds;
+    int port;
+    enum route route;
+    const char *command;
+    int keep_alive;
+    int json;
+};
+
+struct worker {
+    pthread_t thread;
+    const struct options *opt;
+    double deadline;
+    long long *latencies;        // ns per completed request
+    size_t count, cap;
+    unsigned long errors;
+    unsigned long long bytes;    // response body bytes received
+    char *execute;               // execute_request with this worker's cookie
+    size_t execute_len;
+};
+
+static char get_request[256];
+static char execute_request[8192];
+static size_t get_len, execute_len;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int open_connection(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n, len -= n;
+    }
+    return 0;
+}
+
+// Buffered reader over a connection; bytes past one response stay for the next
+struct reader {
+    int fd;
+    char *buf;
+    size_t cap, pos, len;
+};
+
+static int reader_fill(struct reader *r) {
+    if (r->pos > 0) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    if (r->len == r->cap) return -1;
+    ssize_t n;
+    while ((n = recv(r->fd, r->buf + r->len, r->cap - r->len, 0)) < 0 && errno == EINTR)
+        ;
+    if (n <= 0) return -1;
+    r->len += n;
+    return 0;
+}
+
+// Next CRLF-terminated line, NUL-terminated in place; valid until the next read
+static char *reader_line(struct reader *r) {
+    while (1) {
+        char *end = memmem(r->buf + r->pos, r->len - r->pos, "\r\n", 2);
+        if (end) {
+            char *line = r->buf + r->pos;
+            *end = '\0';
+            r->pos = end + 2 - r->buf;
+            return line;
+        }
+        if (reader_fill(r) < 0) return NULL;
+    }
+}
+
+static int reader_skip(struct reader *r, size_t n) {
+    while (1) {
+        size_t take = r->len - r->pos < n ? r->len - r->pos : n;
+        r->pos += take;
+        n -= take;
+        if (n == 0) return 0;
+        if (reader_fill(r) < 0) return -1;
+    }
+}
+
+// Read one response. Returns its body size, or -1 on error; *closes is set
+// when the server will close the connection after it, and cookie to a
+// Set-Cookie's name=value if there is one.
+static long read_response(struct reader *r, int *status, int *closes, char *cookie, size_t cookie_size) {
+    char *line = reader_line(r);
+    if (!line || strncmp(line, "HTTP/1.", 7) != 0) return -1;
+    *status = atoi(line + 9);
+
+    long content_length = -1;
+    int chunked = 0;
+    *closes = 0;
+    while ((line = reader_line(r)) && *line) {
+        if (strncasecmp(line, "Content-Length:", 15) == 0) content_length = atol(line + 15);
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked")) chunked = 1;
+        else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line, "close")) *closes = 1;
+        else if (strncasecmp(line, "Set-Cookie: ", 12) == 0)
+            snprintf(cookie, cookie_size, "%.*s", (int)strcspn(line + 12, ";"), line + 12);
+    }
+    if (!line) return -1;
+
+    if (chunked) {
+        long body = 0;
+        while (1) {
+            if (!(line = reader_line(r))) return -1;
+            long size = strtol(line, NULL, 16);
+            if (size == 0) break;
+            if (reader_skip(r, size) < 0 || !reader_line(r)) return -1;
+            body += size;
+        }
+        while ((line = reader_line(r)) && *line)   // trailers
+            ;
+        return line ? body : -1;
+    }
+    if (content_length >= 0)
+        return reader_skip(r, content_length) < 0 ? -1 : content_length;
+
+    // No length: the body runs to EOF
+    *closes = 1;
+    long body = r->len - r->pos;
+    r->pos = r->len;
+    while (reader_fill(r) == 0) {
+        body += r->len;
+        r->pos = r->len;
+    }
+    return body;
+}
+
+static void record(struct worker *w, long long ns) {
+    if (w->count == w->cap) {
+        w->cap = w->cap ? w->cap * 2 : 4096;
+        w->latencies = realloc(w->latencies, w->cap * sizeof(long long));
+        if (!w->latencies) abort();
+    }
+    w->latencies[w->count++] = ns;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    const struct options *opt = w->opt;
+    struct reader r = { -1, malloc(1 << 16), 1 << 16, 0, 0 };
+    for (unsigned long i = 0; now_s() < w->deadline; i++) {
+        int execute = opt->route == ROUTE_EXECUTE || (opt->route == ROUTE_MIX && i % 2);
+        long long start = now_ns();
+        if (r.fd == -1) {
+            if ((r.fd = open_connection(opt->port)) == -1) {
+                w->errors++;
+                usleep(1000);
+                continue;
+            }
+            r.pos = r.len = 0;
+        }
+
+        int status = 0, closes = 1;
+        long body = -1;
+        char cookie[256] = "";
+        if (send_all(r.fd, execute ? w->execute : get_request, execute ? w->execute_len : get_len) == 0)
+            body = read_response(&r, &status, &closes, cookie, sizeof(cookie));
+        if (cookie[0]) {
+            // Insert "Cookie:" after the request line
+            size_t line_len = strchr(execute_request, '\n') + 1 - execute_request;
+            if (w->execute != execute_request) free(w->execute);
+            w->execute_len = execute_len + strlen(cookie) + 10;
+            w->execute = malloc(w->execute_len + 1);
+            sprintf(w->execute, "%.*sCookie: %s\r\n%s", (int)line_len, execute_request, cookie,
+                    execute_request + line_len);
+        }
+        if (body >= 0 && status == 200) {
+            record(w, now_ns() - start);
+            w->bytes += body;
+        } else {
+            w->errors++;
+        }
+        if (body < 0 || closes || !opt->keep_alive) {
+            close(r.fd);
+            r.fd = -1;
+        }
+    }
+    if (r.fd != -1) close(r.fd);
+    free(r.buf);
+    if (w->execute != execute_request) free(w->execute);
+    return NULL;
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static size_t form_encode(char *dst, size_t cap, const char *src) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t n = 0;
+    for (; *src && n + 4 < cap; src++) {
+        unsigned char c = *src;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || strchr("-_.~", c)) {
+            dst[n++] = c;
+        } else if (c == ' ') {
+            dst[n++] = '+';
+        } else {
+            dst[n++] = '%', dst[n++] = hex[c >> 4], dst[n++] = hex[c & 15];
+        }
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-c connections] [-d seconds] [-p port] [-r get|execute|mix] "
+                    "[-C command] [-n] [-j]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    struct options opt = { 16, 10, 5000, ROUTE_EXECUTE, "echo hello", 1, 0 };
+    int c;
+    while ((c = getopt(argc, argv, "c:d:p:r:C:nj")) != -1) {
+        switch (c) {
+        case 'c': opt.connections = atoi(optarg); break;
+        case 'd': opt.seconds = atof(optarg); break;
+        case 'p': opt.port = atoi(optarg); break;
+        case 'r':
+            if (strcmp(optarg, "get") == 0) opt.route = ROUTE_GET;
+            else if (strcmp(optarg, "execute") == 0) opt.route = ROUTE_EXECUTE;
+            else if (strcmp(optarg, "mix") == 0) opt.route = ROUTE_MIX;
+            else usage(argv[0]);
+            break;
+        case 'C': opt.command = optarg; break;
+        case 'n': opt.keep_alive = 0; break;
+        case 'j': opt.json = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (opt.connections < 1 || opt.seconds <= 0) usage(argv[0]);
+
+    const char *connection = opt.keep_alive ? "keep-alive" : "close";
+    get_len = snprintf(get_request, sizeof(get_request),
+                       "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: %s\r\n\r\n", connection);
+    char form[4096] = "command=";
+    size_t form_len = 8 + form_encode(form + 8, sizeof(form) - 8, opt.command);
+    execute_len = snprintf(execute_request, sizeof(execute_request),
+                           "POST /execute HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: %s\r\n"
+                           "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %zu\r\n\r\n%s",
+                           connection, form_len, form);
+
+    struct worker *workers = calloc(opt.connections, sizeof(*workers));
+    double start = now_s();
+    for (int i = 0; i < opt.connections; i++) {
+        workers[i].opt = &opt;
+        workers[i].execute = execute_request;
+        workers[i].execute_len = execute_len;
+        workers[i].deadline = start + opt.seconds;
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    size_t total = 0;
+    unsigned long errors = 0;
+    unsigned long long bytes = 0;
+    for (int i = 0; i < opt.connections; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].count;
+        errors += workers[i].errors;
+        bytes += workers[i].bytes;
+    }
+    double elapsed = now_s() - start;
+
+    long long *all = malloc((total ? total : 1) * sizeof(long long));
+    for (int i = 0, at = 0; i < opt.connections; i++) {
+        memcpy(all + at, workers[i].latencies, workers[i].count * sizeof(long long));
+        at += workers[i].count;
+        free(workers[i].latencies);
+    }
+    qsort(all, total, sizeof(long long), compare_ll);
+#define PERCENTILE(p) (total ? all[(size_t)((total - 1) * (p))] / 1e3 : 0)
+    double rps = total / elapsed;
+    const char *route = opt.route == ROUTE_GET ? "get" : opt.route == ROUTE_EXECUTE ? "execute" : "mix";
+
+    if (opt.json) {
+        // The command as a JSON string body
+        char json_command[2 * sizeof(form)];
+        size_t n = 0;
+        for (const char *p = opt.command; *p && n + 2 < sizeof(json_command); p++) {
+            if (*p == '"' || *p == '\\') json_command[n++] = '\\';
+            json_command[n++] = (unsigned char)*p < 0x20 ? ' ' : *p;
+        }
+        json_command[n] = '\0';
+        printf("{\"bench\": \"loadgen\", \"route\": \"%s\", \"command\": \"%s\", \"connections\": %d, "
+               "\"keep_alive\": %s, \"seconds\": %.3f, \"requests\": %zu, \"errors\": %lu, "
+               "\"rps\": %.1f, \"mb_per_s\": %.2f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, "
+               "\"max_us\": %.1f}\n",
+               route, opt.route == ROUTE_GET ? "" : json_command, opt.connections,
+               opt.keep_alive ? "true" : "false", elapsed, total, errors, rps, bytes / elapsed / 1e6,
+               PERCENTILE(0.5), PERCENTILE(0.99), PERCENTILE(0.999), PERCENTILE(1.0));
+    } else {
+        if (opt.route == ROUTE_GET) printf("%s", route);
+        else printf("%s `%s`", route, opt.command);
+        printf(", %d connections (%s), %.1f s\n", opt.connections, connection, elapsed);
+        printf("requests %zu   errors %lu   %.1f req/s   %.2f MB/s\n", total, errors, rps, bytes / elapsed / 1e6);
+        printf("latency  p50 %.1f us   p99 %.1f us   p999 %.1f us   max %.1f us\n",
+               PERCENTILE(0.5), PERCENTILE(0.99), PERCENTILE(0.999), PERCENTILE(1.0));
+    }
+    free(all);
+    free(workers);
+    return errors && !total;
+}
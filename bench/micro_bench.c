@@ -0,0 +1,317 @@
+// Microbenchmarks for the request hot path: json_escape() and url_decode()
+// on typical payloads, lexing a command line, recording a request's metrics,
+// and execute_shell_command() on built-ins, external commands and a pipeline,
+// and tab completion against a 10^6-command history, $PATH and a directory
+// of 10^5 files. Each case repeats for about the given time and reports ns
+// per call (and MB/s for the byte-oriented ones).
+//
+// Build (from the repo root):
+//   gcc -O2 -pthread bench/micro_bench.c escape.c shell.c session.c metrics.c lexer.c arena.c textscan.c result_cache.c history.c -o micro_bench
+// Run:
+//   ./micro_bench [-t seconds_per_case] [-j]
+//   -j prints one JSON object per case, for comparing runs across commits.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "../escape.h"
+#include "../lexer.h"
+#include "../shell.h"
+#include "../metrics.h"
+#include "../history.h"
+
+static double case_seconds = 0.3;
+static int json_output;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Time fn(arg) until case_seconds have passed; bytes is the input size per call
+static void run_case(const char *bench, const char *name, void (*fn)(void *), void *arg, size_t bytes) {
+    fn(arg);                                   // warm up
+    unsigned long calls = 0, batch = 1;
+    double start = now_s(), elapsed;
+    do {
+        for (unsigned long i = 0; i < batch; i++) fn(arg);
+        calls += batch;
+        if (batch < (1u << 20)) batch *= 2;
+        elapsed = now_s() - start;
+    } while (elapsed < case_seconds);
+
+    double ns = elapsed * 1e9 / calls;
+    double mb = bytes ? bytes * (double)calls / elapsed / 1e6 : 0;
+    if (json_output)
+        printf("{\"bench\": \"%s\", \"case\": \"%s\", \"calls\": %lu, \"ns_per_op\": %.1f, \"mb_per_s\": %.1f}\n",
+               bench, name, calls, ns, mb);
+    else if (bytes)
+        printf("%-18s %-22s %12.1f ns/op %10.1f MB/s\n", bench, name, ns, mb);
+    else
+        printf("%-18s %-22s %12.1f ns/op\n", bench, name, ns);
+    fflush(stdout);
+}
+
+// ---------- PAYLOADS ----------
+
+// Output of a typical listing: mostly clean text with newlines
+static char *make_listing(size_t size) {
+    char *text = malloc(size + 1);
+    size_t len = 0;
+    for (int i = 0; len < size; i++) {
+        char line[128];
+        int n = snprintf(line, sizeof(line), "-rw-r--r-- 1 www-data www-data %7d Oct %2d 12:%02d file_%d.log\n",
+                         i * 37 % 1000000, i % 28 + 1, i % 60, i);
+        memcpy(text + len, line, len + n > size ? size - len : (size_t)n);
+        len += len + n > size ? size - len : (size_t)n;
+    }
+    text[size] = '\0';
+    return text;
+}
+
+// JSON-heavy output: quotes and backslashes on every line
+static char *make_quoted(size_t size) {
+    char *text = malloc(size + 1);
+    const char *line = "{\"path\": \"C:\\\\logs\\\\app.log\", \"level\": \"warn\"}\n";
+    for (size_t i = 0; i < size; i++) text[i] = line[i % strlen(line)];
+    text[size] = '\0';
+    return text;
+}
+
+// Non-ASCII text: UTF-8 names and messages
+static char *make_utf8(size_t size) {
+    char *text = malloc(size + 1);
+    const char *line = "Résumé_2024.pdf  日本語のファイル.txt  Ünïcødé ✓ 😀\n";
+    for (size_t i = 0; i < size; i++) text[i] = line[i % strlen(line)];
+    text[size] = '\0';
+    return text;
+}
+
+// Binary output (cat of a compressed file)
+static char *make_binary(size_t size) {
+    char *data = malloc(size + 1);
+    unsigned int x = 12345;
+    for (size_t i = 0; i < size; i++) {
+        x = x * 1103515245 + 12345;
+        data[i] = x >> 16;
+    }
+    data[size] = '\0';
+    return data;
+}
+
+// ---------- CASES ----------
+
+struct escape_case {
+    const char *data;
+    size_t len;
+    struct outbuf out;
+};
+
+static void escape_fn(void *arg) {
+    struct escape_case *c = arg;
+    c->out.len = 0;
+    json_escape(&c->out, c->data, c->len);
+}
+
+struct decode_case {
+    const char *data;
+    size_t len;
+    char *dst;
+};
+
+static void decode_fn(void *arg) {
+    struct decode_case *c = arg;
+    url_decode(c->dst, c->len + 1, c->data, c->len);
+}
+
+struct lex_case {
+    const char *line;
+    struct arena arena;
+};
+
+static void lex_fn(void *arg) {
+    struct lex_case *c = arg;
+    struct lexer lex;
+    arena_reset(&c->arena);
+    lexer_init(&lex, c->line, &c->arena);
+    struct token token;
+    enum token_kind kind;
+    do kind = lexer_next(&lex, &token);
+    while (kind != TOK_END && kind != TOK_ERROR);
+}
+
+// What the server adds to every request: two clock reads and one histogram update
+static void metrics_fn(void *arg) {
+    (void)arg;
+    int64_t start = metrics_now();
+    metrics_observe(METRIC_REQUEST_STATIC, metrics_now() - start);
+}
+
+struct exec_case {
+    const char *command;
+    struct arena arena;
+};
+
+static void exec_fn(void *arg) {
+    struct exec_case *c = arg;
+    char input[256];
+    struct outbuf out;
+    arena_reset(&c->arena);
+    outbuf_init(&out, &c->arena, 1 << 20);
+    snprintf(input, sizeof(input), "%s", c->command);
+    execute_shell_command(input, &out);
+}
+
+struct complete_case {
+    struct history *history;
+    const char *line;
+    struct arena arena;
+};
+
+static void count_match(const char *text, size_t len, void *arg) {
+    (void)text;
+    *(size_t *)arg += len;
+}
+
+static void history_complete_fn(void *arg) {
+    struct complete_case *c = arg;
+    size_t total = 0;
+    history_complete(c->history, c->line, strlen(c->line), 50, count_match, &total);
+}
+
+static void shell_complete_fn(void *arg) {
+    struct complete_case *c = arg;
+    struct completion result;
+    arena_reset(&c->arena);
+    shell_complete(NULL, c->line, 50, &c->arena, &result);
+}
+
+// A throwaway history of count commands, in the fashion of a real one:
+// a few programs with varying arguments, many of them repeated
+static struct history *make_history(char *dir, int count) {
+    setenv("WEBSHELL_HISTORY_DIR", dir, 1);
+    struct history *h = history_open("bench");
+    static const char *programs[] = { "ls -la", "git commit -m", "grep -rn", "make -j", "cd" };
+    char line[128];
+    for (int i = 0; h && i < count; i++) {
+        snprintf(line, sizeof(line), "%s %d /tmp/dir%d", programs[i % 5], i / 7, i % 97);
+        history_add(h, line);
+    }
+    return h;
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:j")) != -1) {
+        if (opt == 't') case_seconds = atof(optarg);
+        else if (opt == 'j') json_output = 1;
+        else {
+            fprintf(stderr, "usage: %s [-t seconds_per_case] [-j]\n", argv[0]);
+            return 2;
+        }
+    }
+    executor_start();
+
+    struct { const char *name; char *data; size_t len; } payloads[] = {
+        { "listing_64k", make_listing(64 << 10), 64 << 10 },
+        { "listing_4m", make_listing(4 << 20), 4 << 20 },
+        { "quoted_64k", make_quoted(64 << 10), 64 << 10 },
+        { "utf8_64k", make_utf8(64 << 10), 64 << 10 },
+        { "binary_64k", make_binary(64 << 10), 64 << 10 },
+    };
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+        struct escape_case c = { payloads[i].data, payloads[i].len, { 0 } };
+        outbuf_init(&c.out, NULL, (size_t)-1);
+        run_case("json_escape", payloads[i].name, escape_fn, &c, c.len);
+        outbuf_free(&c.out);
+    }
+
+    // Form bodies as browsers send them: a short command, a long mostly
+    // plain one and one that is nearly all escapes
+    char *long_plain = make_listing(16 << 10);
+    for (char *p = long_plain; *p; p++) if (*p == ' ') *p = '+';
+    char *escaped = malloc((16 << 10) + 1);
+    for (int i = 0; i < (16 << 10); i++) escaped[i] = "%2F%3D"[i % 6];
+    escaped[16 << 10] = '\0';
+    struct { const char *name; const char *data; } forms[] = {
+        { "short_command", "ls+-la+%2Fvar%2Flog+%7C+grep+-c+error" },
+        { "plain_16k", long_plain },
+        { "escaped_16k", escaped },
+    };
+    for (size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); i++) {
+        struct decode_case c = { forms[i].data, strlen(forms[i].data), NULL };
+        c.dst = malloc(c.len + 1);
+        run_case("url_decode", forms[i].name, decode_fn, &c, c.len);
+        free(c.dst);
+    }
+
+    // Command-line parsing (the lexer behind execute_shell_command)
+    const char *lines[][2] = {
+        { "simple", "ls -la" },
+        { "pipeline", "cat server.c | grep -n include | wc -l" },
+        { "quoted", "grep -rn \"TODO: fix\" --include='*.c' . 2>&1 | head -n 20" },
+    };
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        struct lex_case c = { lines[i][1], ARENA_INIT };
+        run_case("parse", lines[i][0], lex_fn, &c, strlen(c.line));
+        arena_free(&c.arena);
+    }
+
+    run_case("metrics", "request", metrics_fn, NULL, 0);
+
+    const char *commands[][2] = {
+        { "builtin_echo", "echo hello" },
+        { "builtin_pwd", "pwd" },
+        { "external_true", "true" },
+        { "external_echo", "/bin/echo hello" },
+        { "pipeline", "echo hello | /bin/cat | wc -c" },
+    };
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        struct exec_case c = { commands[i][1], ARENA_INIT };
+        run_case("execute", commands[i][0], exec_fn, &c, 0);
+        arena_free(&c.arena);
+    }
+
+    // Completion, in a scratch directory removed afterwards
+    char dir[] = "/tmp/micro_bench.XXXXXX";
+    char files[sizeof(dir) + 8], path[sizeof(files) + 32];
+    if (mkdtemp(dir)) {
+        struct history *history = make_history(dir, 1000000);
+        snprintf(files, sizeof(files), "%s/files", dir);
+        mkdir(files, 0700);
+        for (int i = 0; i < 100000; i++) {
+            snprintf(path, sizeof(path), "%s/file_%d", files, i);
+            close(open(path, O_WRONLY | O_CREAT, 0600));
+        }
+        // Let the directory's mtime settle so its listing is reused
+        sleep(1);
+
+        char file_line[sizeof(files) + 32];
+        snprintf(file_line, sizeof(file_line), "cat %s/file_999", files);
+        struct complete_case cases[] = {
+            { history, "git commit -m 1234", ARENA_INIT },
+            { history, "ls", ARENA_INIT },
+            { NULL, "gr", ARENA_INIT },
+            { NULL, file_line, ARENA_INIT },
+        };
+        if (history) {
+            run_case("complete", "history_1m_narrow", history_complete_fn, &cases[0], 0);
+            run_case("complete", "history_1m_broad", history_complete_fn, &cases[1], 0);
+        }
+        run_case("complete", "path_command", shell_complete_fn, &cases[2], 0);
+        run_case("complete", "dir_100k", shell_complete_fn, &cases[3], 0);
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) arena_free(&cases[i].arena);
+        if (history) history_close(history);
+
+        char command[sizeof(dir) + 16];
+        snprintf(command, sizeof(command), "rm -rf %s", dir);
+        if (system(command) != 0) fprintf(stderr, "could not remove %s\n", dir);
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Pipeline launch benchmark: /bin/sh -c versus the native pipeline executor
+// on `ls | grep .c | wc -l`.
+//
+// Build (from the repo root):
+//   gcc -O2 -pthread bench/pipeline_bench.c shell.c session.c metrics.c lexer.c arena.c textscan.c result_cache.c history.c -o pipeline_bench
+// Run:
+//   ./pipeline_bench [iterations]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../shell.h"
+
+#define OUTPUT_SIZE 4096
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, int n) {
+    qsort(samples, n, sizeof(double), compare_doubles);
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += samples[i];
+    printf("%-8s mean %8.1f us   p50 %8.1f us   p99 %8.1f us\n",
+           name, sum / n, samples[n / 2], samples[(int)(n * 0.99)]);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 500;
+    if (iterations < 1) iterations = 1;
+    executor_start();
+
+    char command[] = "ls | grep .c | wc -l";
+    struct arena arena = ARENA_INIT;
+    struct outbuf sh_output, native_output;
+    double *sh_times = malloc(iterations * sizeof(double));
+    double *native_times = malloc(iterations * sizeof(double));
+
+    // Warm up the page cache and check both paths agree
+    outbuf_init(&sh_output, &arena, OUTPUT_SIZE);
+    outbuf_init(&native_output, &arena, OUTPUT_SIZE);
+    handle_redirection_and_piping(command, &sh_output);
+    execute_shell_command(command, &native_output);
+    if (strcmp(sh_output.data, native_output.data) != 0) {
+        fprintf(stderr, "outputs differ:\nsh:     %snative: %s", sh_output.data, native_output.data);
+        return 1;
+    }
+
+    // Interleave the two so drift in system load affects both equally
+    for (int i = 0; i < iterations; i++) {
+        arena_reset(&arena);
+        outbuf_init(&sh_output, &arena, OUTPUT_SIZE);
+        outbuf_init(&native_output, &arena, OUTPUT_SIZE);
+
+        double start = now_us();
+        handle_redirection_and_piping(command, &sh_output);
+        sh_times[i] = now_us() - start;
+
+        start = now_us();
+        execute_shell_command(command, &native_output);
+        native_times[i] = now_us() - start;
+    }
+
+    printf("`%s`, %d iterations\n", command, iterations);
+    report("sh -c", sh_times, iterations);
+    report("native", native_times, iterations);
+
+    free(sh_times);
+    free(native_times);
+    arena_free(&arena);
+    return 0;
+}
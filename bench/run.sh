@@ -0,0 +1,45 @@
+#!/bin/bash
+# Build the server and the benchmarks, start the server on loopback and run
+# the load generator and the microbenchmarks. Results go to stdout and to
+# bench-<commit>.jsonl, one JSON object per case tagged with the commit, so
+# two runs can be compared with e.g. `join` or jq.
+#
+# Usage (from the repo root): bench/run.sh [seconds_per_load_case]
+set -e
+
+cd "$(dirname "$0")/.."
+seconds=${1:-5}
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+out=bench-$commit.jsonl
+build=$(mktemp -d)
+trap 'kill $server 2>/dev/null; rm -rf "$build"' EXIT
+
+if (exec 3<>/dev/tcp/127.0.0.1/5000) 2>/dev/null; then
+    echo "port 5000 is in use; stop the running server first" >&2
+    exit 1
+fi
+
+cc=${CC:-gcc}
+shell_sources="shell.c session.c metrics.c lexer.c arena.c textscan.c result_cache.c history.c"
+$cc -O2 -pthread server.c http.c websocket.c json.c escape.c $shell_sources -o "$build/server"
+$cc -O2 -pthread bench/loadgen.c -o "$build/loadgen"
+$cc -O2 -pthread bench/micro_bench.c escape.c $shell_sources -o "$build/micro_bench"
+$cc -O2 bench/terminal_latency.c websocket.c -o "$build/terminal_latency"
+
+"$build/server" > "$build/server.log" 2>&1 &
+server=$!
+sleep 0.5
+
+tag() { sed "s/^{/{\"commit\": \"$commit\", /"; }
+
+{
+    "$build/micro_bench" -j
+    "$build/loadgen" -j -d "$seconds" -c 16 -r get
+    "$build/loadgen" -j -d "$seconds" -c 16 -r execute -C "echo hello"
+    "$build/loadgen" -j -d "$seconds" -c 16 -r execute -C "ls -l"
+    "$build/loadgen" -j -d "$seconds" -c 16 -r execute -C "ls | wc -l"
+    "$build/loadgen" -j -d "$seconds" -c 16 -r mix -n
+    "$build/terminal_latency" -j
+} | tag | tee "$out"
+
+echo "results in $out" >&2
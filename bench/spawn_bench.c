@@ -0,0 +1,96 @@
+// Process launch latency versus parent RSS: fork()+exec against posix_spawn().
+// fork() copies the parent's page tables, so its cost grows with RSS; glibc's
+// posix_spawn() uses clone(CLONE_VM | CLONE_VFORK) and should stay flat.
+//
+// Build (from the repo root):
+//   gcc -O2 bench/spawn_bench.c -o spawn_bench
+// Run:
+//   ./spawn_bench [iterations] [rss_mb ...]      (default: 200 10 100 250 500 1000)
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *samples, int n) {
+    qsort(samples, n, sizeof(double), compare_doubles);
+    return samples[n / 2];
+}
+
+static void run_fork(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+static void run_spawn(char *const argv[]) {
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], NULL, NULL, argv, environ) == 0)
+        waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    int default_sizes[] = { 10, 100, 250, 500, 1000 };
+    int size_count = argc > 2 ? argc - 2 : 5;
+    if (iterations < 1) iterations = 1;
+
+    char *child[] = { "/bin/true", NULL };
+    double *fork_times = malloc(iterations * sizeof(double));
+    double *spawn_times = malloc(iterations * sizeof(double));
+    char *ballast = NULL;
+    size_t ballast_size = 0;
+
+    printf("%8s %14s %14s\n", "rss_mb", "fork_exec_us", "posix_spawn_us");
+    for (int s = 0; s < size_count; s++) {
+        int mb = argc > 2 ? atoi(argv[s + 2]) : default_sizes[s];
+
+        // Grow the parent to the target size and touch every page so it is resident
+        size_t size = (size_t)mb << 20;
+        if (size > ballast_size) {
+            ballast = realloc(ballast, size);
+            if (!ballast) {
+                perror("realloc");
+                return 1;
+            }
+            memset(ballast + ballast_size, 1, size - ballast_size);
+            ballast_size = size;
+        }
+
+        for (int i = 0; i < iterations; i++) {
+            double start = now_us();
+            run_fork(child);
+            fork_times[i] = now_us() - start;
+
+            start = now_us();
+            run_spawn(child);
+            spawn_times[i] = now_us() - start;
+        }
+        printf("%8d %14.1f %14.1f\n", mb, median(fork_times, iterations), median(spawn_times, iterations));
+    }
+
+    free(ballast);
+    free(fork_times);
+    free(spawn_times);
+    return 0;
+}
@@ -0,0 +1,186 @@
+// Keystroke round trip through the WebSocket terminal, over loopback. Opens
+// GET /terminal, waits for the shell's prompt, then types one character at a
+// time and times how long each takes to come back as echo. Every 64
+// characters the line is wiped with ^U so the shell never runs anything.
+// Reports percentiles of the round trip in microseconds.
+//
+// Build (from the repo root):
+//   gcc -O2 bench/terminal_latency.c websocket.c -o terminal_latency
+// Run (with ./server listening):
+//   ./terminal_latency [-n keystrokes] [-p port] [-j]
+//   -j prints one JSON object instead of the table.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../websocket.h"
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int send_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Send a masked binary frame, as a browser would
+static int send_frame(int fd, int opcode, const void *data, size_t len) {
+    unsigned char frame[WS_MAX_HEADER + 256];
+    if (len > 256) return -1;
+    size_t n = ws_frame_header(frame, opcode, len);
+    frame[1] |= 0x80;
+    unsigned char mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    memcpy(frame + n, mask, 4);
+    memcpy(frame + n + 4, data, len);
+    ws_unmask(frame + n + 4, len, mask);
+    return send_all(fd, frame, n + 4 + len);
+}
+
+// Read until at least one byte of frame data has arrived or timeout_ms
+// passes. Server frames are unmasked, so only their headers are skipped.
+// Returns the payload bytes seen, -1 on close or error.
+static long drain(int fd, int timeout_ms) {
+    static unsigned char buf[1 << 16];
+    static size_t len;
+    long payload = 0;
+    while (1) {
+        // Consume whole frames already buffered
+        while (len >= 2) {
+            size_t size = buf[1] & 0x7F, head = 2;
+            if (size == 126) {
+                if (len < 4) break;
+                size = (size_t)buf[2] << 8 | buf[3];
+                head = 4;
+            } else if (size == 127) {
+                if (len < 10) break;
+                size = 0;
+                for (int i = 2; i < 10; i++) size = size << 8 | buf[i];
+                head = 10;
+            }
+            if (len < head + size) break;
+            if ((buf[0] & 0x0F) == WS_CLOSE) return -1;
+            payload += size;
+            memmove(buf, buf + head + size, len - head - size);
+            len -= head + size;
+        }
+        if (payload > 0) return payload;
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready == 0) return 0;
+        if (ready < 0 && errno == EINTR) continue;
+        ssize_t n = read(fd, buf + len, sizeof(buf) - len);
+        if (n <= 0) return -1;
+        len += n;
+    }
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+    int count = 2000, port = 5000, json = 0, opt;
+    while ((opt = getopt(argc, argv, "n:p:j")) != -1) {
+        if (opt == 'n') count = atoi(optarg);
+        else if (opt == 'p') port = atoi(optarg);
+        else if (opt == 'j') json = 1;
+        else {
+            fprintf(stderr, "usage: %s [-n keystrokes] [-p port] [-j]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (count < 1) count = 1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("connect");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    char request[512];
+    int n = snprintf(request, sizeof(request),
+        "GET /terminal?cols=80&rows=24 HTTP/1.1\r\nHost: 127.0.0.1:%d\r\n"
+        "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n", port);
+    send_all(fd, request, n);
+
+    // The 101 response, byte by byte so no frame data is swallowed with it
+    char response[1024];
+    size_t len = 0;
+    while (len < sizeof(response) - 1 && (len < 4 || memcmp(response + len - 4, "\r\n\r\n", 4) != 0)) {
+        if (read(fd, response + len, 1) != 1) {
+            fprintf(stderr, "connection closed during the handshake\n");
+            return 1;
+        }
+        len++;
+    }
+    response[len] = '\0';
+    if (strncmp(response, "HTTP/1.1 101", 12) != 0 || !strstr(response, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")) {
+        fprintf(stderr, "handshake failed:\n%s", response);
+        return 1;
+    }
+
+    // Let the shell print its prompt and settle
+    while (drain(fd, 300) > 0)
+        ;
+
+    long long *rtt = malloc(count * sizeof(*rtt));
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && i % 64 == 0) {
+            send_frame(fd, WS_BINARY, "\x15", 1);
+            while (drain(fd, 50) > 0)
+                ;
+        }
+        long long start = now_ns();
+        if (send_frame(fd, WS_BINARY, "x", 1) == -1 || drain(fd, 2000) <= 0) {
+            fprintf(stderr, "no echo for keystroke %d\n", i);
+            return 1;
+        }
+        rtt[i] = now_ns() - start;
+    }
+    send_frame(fd, WS_CLOSE, "\x03\xe8", 2);
+    close(fd);
+
+    qsort(rtt, count, sizeof(*rtt), compare_ll);
+    long long total = 0;
+    for (int i = 0; i < count; i++) total += rtt[i];
+    double mean = total / 1e3 / count, p50 = rtt[count / 2] / 1e3, p99 = rtt[(int)(count * 0.99)] / 1e3;
+    double max = rtt[count - 1] / 1e3;
+    if (json) {
+        printf("{\"bench\": \"terminal_latency\", \"keystrokes\": %d, \"mean_us\": %.1f, \"p50_us\": %.1f, "
+               "\"p99_us\": %.1f, \"max_us\": %.1f}\n", count, mean, p50, p99, max);
+    } else {
+        printf("keystrokes  %d\n", count);
+        printf("mean        %.1f us\n", mean);
+        printf("p50         %.1f us\n", p50);
+        printf("p99         %.1f us\n", p99);
+        printf("max         %.1f us\n", max);
+    }
+    free(rtt);
+    return 0;
+}
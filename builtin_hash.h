@@ -0,0 +1,17 @@
+// Generated by tools/gen_builtin_hash.c from builtins.def. Do not edit.
+#ifndef BUILTIN_HASH_H
+#define BUILTIN_HASH_H
+
+#define BUILTIN_HASH_COUNT 27
+#define BUILTIN_HASH_SEED 835u
+#define BUILTIN_HASH_SIZE 64
+
+// Index into builtins[] for each slot, -1 if empty
+static const signed char builtin_slots[BUILTIN_HASH_SIZE] = {
+    14, -1, -1, 3, -1, 25, 1, 17, 13, -1, -1, 23, -1, -1, 26, -1,
+    -1, 8, -1, 11, 12, -1, -1, 18, 19, -1, 22, -1, -1, 20, 5, -1,
+    -1, -1, 0, -1, -1, 10, 4, -1, 9, -1, -1, -1, 24, 21, -1, -1,
+    -1, -1, -1, 7, 16, -1, -1, -1, -1, -1, 6, -1, -1, -1, 2, 15
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+// Built-in handler. argv/argc are the unquoted words (argv[0] is the command
+// name); args is the arguments joined by single spaces, for commands that take
+// a single free-form argument such as a file name with spaces. Output is
+// appended to out.
+typedef void builtin_fn(int argc, char **argv, char *args, struct outbuf *out);
+
+struct builtin {
+    const char *name;
+    builtin_fn *handler;
+    int min_args, max_args;   // arguments after the name; max -1 = unlimited
+    const char *usage;
+    const char *description;
+};
+
+// Hash used by the generated lookup table in builtin_hash.h. The generator
+// (tools/gen_builtin_hash.c) picks a seed for which every name in
+// builtins.def lands in its own slot, so a lookup is one hash and one strcmp.
+static inline uint32_t builtin_hash(const char *name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+// Look up a built-in by name; NULL if there is none
+const struct builtin *builtin_find(const char *name);
+
+// Every built-in, in builtins.def order
+extern const struct builtin builtins[];
+extern const int builtin_count;
+
+#endif
@@ -0,0 +1,136 @@
+#include <string.h>
+#include "escape.h"
+#include "textscan.h"
+
+#define ESCAPE_BLOCK 4096    // input bytes escaped per outbuf_reserve()
+// Clean runs are scanned inline up to this length and then handed to the
+// SIMD scanner, which only pays off once it can skip whole vectors
+#define INLINE_RUN 16
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// What each byte becomes in a JSON string: 0 if it is copied as is, the
+// letter after the backslash for two-byte escapes, 'u' for \u00XX and 1 for
+// the lead of a (possibly invalid) UTF-8 sequence
+static const char json_escapes[256] = {
+    [0x00 ... 0x07] = 'u', ['\b'] = 'b', ['\t'] = 't', ['\n'] = 'n', [0x0b] = 'u', ['\f'] = 'f',
+    ['\r'] = 'r', [0x0e ... 0x1f] = 'u', ['"'] = '"', ['\\'] = '\\', [0x80 ... 0xff] = 1,
+};
+
+// Length of the valid UTF-8 sequence starting at s (len bytes available),
+// or 0 if it is malformed, overlong, a surrogate or cut short
+static size_t utf8_sequence(const unsigned char *s, size_t len) {
+    unsigned char lo = 0x80, hi = 0xbf;
+    size_t n;
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) n = 2;
+    else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        n = 3;
+        if (s[0] == 0xe0) lo = 0xa0;
+        else if (s[0] == 0xed) hi = 0x9f;
+    } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        n = 4;
+        if (s[0] == 0xf0) lo = 0x90;
+        else if (s[0] == 0xf4) hi = 0x8f;
+    } else {
+        return 0;
+    }
+    if (len < n || s[1] < lo || s[1] > hi) return 0;
+    for (size_t i = 2; i < n; i++)
+        if (s[i] < 0x80 || s[i] > 0xbf) return 0;
+    return n;
+}
+
+// Escape special characters for safe JSON output, appending to dst. Clean
+// runs are found with the SIMD scanner and copied in bulk; '"', '\' and
+// control characters are escaped, valid UTF-8 passes through and invalid
+// bytes become U+FFFD. Stops before an escape that would not fit under
+// dst's limit, so the output is always a well-formed string body.
+void json_escape(struct outbuf *dst, const char *src, size_t len) {
+    const unsigned char *s = (const unsigned char *)src;
+    size_t i = 0;
+    while (i < len) {
+        size_t block = len - i < ESCAPE_BLOCK ? len - i : ESCAPE_BLOCK, room;
+        // Every input byte escapes to at most six (\u00XX or \ufffd)
+        char *out = outbuf_reserve(dst, block * 6, &room);
+        size_t j = 0, stop = i + block;
+        int full = 0;
+        while (i < stop && !full) {
+            size_t run = 0;
+            while (run < INLINE_RUN && i + run < stop && !json_escapes[s[i + run]]) run++;
+            if (run == INLINE_RUN) run += scan_json_plain(src + i + run, stop - i - run);
+            if (run > room - j) {
+                run = room - j;
+                full = 1;
+            }
+            memcpy(out + j, src + i, run);
+            i += run;
+            j += run;
+            if (i == stop || full) break;
+
+            char escape = json_escapes[s[i]];
+            size_t n = escape == 1 ? utf8_sequence(s + i, len - i) : 0;
+            size_t need = n ? n : escape == 1 || escape == 'u' ? 6 : 2;
+            if (room - j < need) {
+                full = 1;
+            } else if (n) {
+                memcpy(out + j, src + i, n);
+                i += n;
+                j += n;
+            } else if (escape == 1) {
+                memcpy(out + j, "\\ufffd", 6);
+                i++;
+                j += 6;
+            } else if (escape == 'u') {
+                memcpy(out + j, "\\u00", 4);
+                out[j + 4] = hex_digits[s[i] >> 4];
+                out[j + 5] = hex_digits[s[i] & 15];
+                i++;
+                j += 6;
+            } else {
+                out[j] = '\\';
+                out[j + 1] = escape;
+                i++;
+                j += 2;
+            }
+        }
+        outbuf_commit(dst, j);
+        if (full) return;
+    }
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decode len bytes of URL-encoded form data (e.g., %20 → space) into dst,
+// writing at most size - 1 bytes and a terminating NUL; size must be at
+// least 1. Returns the decoded length.
+size_t url_decode(char *dst, size_t size, const char *src, size_t len) {
+    size_t i = 0, j = 0;
+    while (i < len && j + 1 < size) {
+        size_t run = 0;
+        while (run < INLINE_RUN && i + run < len && src[i + run] != '%' && src[i + run] != '+') run++;
+        if (run == INLINE_RUN) run += scan_url_plain(src + i + run, len - i - run);
+        if (run > size - 1 - j) run = size - 1 - j;
+        memcpy(dst + j, src + i, run);
+        i += run;
+        j += run;
+        if (i == len || j + 1 == size) break;
+
+        int hi, lo;
+        if (src[i] == '+') {
+            dst[j++] = ' ';
+            i++;
+        } else if (len - i >= 3 && (hi = hex_value(src[i + 1])) >= 0 && (lo = hex_value(src[i + 2])) >= 0) {
+            dst[j++] = (char)(hi << 4 | lo);
+            i += 3;
+        } else {
+            dst[j++] = src[i++];
+        }
+    }
+    dst[j] = '\0';
+    return j;
+}
@@ -0,0 +1,19 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Text encodings used by the HTTP server
+
+// Escape len bytes of src as the inside of a JSON string, appending to dst.
+// Controls become \u00XX, valid UTF-8 is kept and invalid bytes become
+// \ufffd. Output never exceeds dst's limit and never ends mid-escape.
+void json_escape(struct outbuf *dst, const char *src, size_t len);
+
+// Decode len bytes of URL-encoded form data (e.g., %20 → space) into dst,
+// writing at most size - 1 bytes plus a NUL (len + 1 always suffices).
+// Returns the decoded length.
+size_t url_decode(char *dst, size_t size, const char *src, size_t len);
+
+#endif
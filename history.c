@@ -0,0 +1,436 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "history.h"
+
+#define HISTORY_TAIL 4096            // commands indexed outside the index file before a merge
+#define HISTORY_LINE_MAX 16384       // longer commands are not logged
+#define HISTORY_MAP_MIN (1 << 20)    // address space reserved for a log, at least
+#define HISTORY_LOGS_MAX 4096        // logs kept, well over the sessions held in memory
+
+// The index file: this header, then count log offsets sorted by the text
+// of the line at each one
+struct index_header {
+    char magic[8];
+    uint64_t covered;            // log bytes indexed; later lines are in the tail
+    uint64_t count;
+};
+
+static const char index_magic[8] = "WSHIDX1";
+
+struct history {
+    char base[PATH_MAX + 64];    // path of the files, without .log or .idx
+    int log_fd;
+    const char *log;             // log_map bytes are mapped, log_len of them are the log
+    size_t log_len, log_map;
+    void *index_map;             // the index file, or NULL
+    size_t index_map_len;
+    const uint64_t *index;
+    size_t index_count;
+    uint64_t covered;
+    uint64_t *tail;              // distinct commands after covered that the index lacks, sorted
+    size_t tail_count, tail_cap;
+};
+
+static pthread_once_t dir_once = PTHREAD_ONCE_INIT;
+static char history_dir[PATH_MAX];   // empty: persistent history is off
+
+static void dir_init(void) {
+    const char *dir = getenv("WEBSHELL_HISTORY_DIR");
+    const char *home = getenv("HOME");
+    if (dir) snprintf(history_dir, sizeof(history_dir), "%s", dir);
+    else if (home) snprintf(history_dir, sizeof(history_dir), "%s/.local/state/webshell", home);
+    if (!history_dir[0]) return;
+
+    // mkdir -p
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", history_dir);
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(path, 0700);
+        *p = '/';
+    }
+    if (mkdir(path, 0700) == -1 && access(path, W_OK) == -1) {
+        perror("history directory");
+        history_dir[0] = '\0';
+    }
+}
+
+// ---------- ENTRIES ----------
+// An entry is the log line at an offset, without its newline
+
+static size_t entry_len(const struct history *h, uint64_t off) {
+    const char *nl = memchr(h->log + off, '\n', h->log_len - off);
+    return nl ? (size_t)(nl - (h->log + off)) : h->log_len - off;
+}
+
+// Order of the entry at off against key, by bytes
+static int entry_compare(const struct history *h, uint64_t off, const char *key, size_t len) {
+    size_t n = entry_len(h, off);
+    int c = memcmp(h->log + off, key, n < len ? n : len);
+    return c ? c : (n > len) - (n < len);
+}
+
+static int offset_compare(const void *a, const void *b, void *arg) {
+    const struct history *h = arg;
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return entry_compare(h, x, h->log + y, entry_len(h, y));
+}
+
+// First of count sorted offsets whose entry is not below key
+static size_t lower_bound(const struct history *h, const uint64_t *offs, size_t count, const char *key, size_t len) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entry_compare(h, offs[mid], key, len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int contains(const struct history *h, const uint64_t *offs, size_t count, const char *key, size_t len) {
+    size_t i = lower_bound(h, offs, count, key, len);
+    return i < count && entry_compare(h, offs[i], key, len) == 0;
+}
+
+static int has_prefix(const struct history *h, uint64_t off, const char *prefix, size_t len) {
+    return entry_len(h, off) >= len && memcmp(h->log + off, prefix, len) == 0;
+}
+
+// ---------- FILES ----------
+
+// Map the log with room to grow to at least need bytes; appends past the
+// end of the file show up in a shared mapping without remapping
+static int map_log(struct history *h, size_t need) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t cap = need * 2 > HISTORY_MAP_MIN ? need * 2 : HISTORY_MAP_MIN;
+    cap = (cap + page - 1) & ~(page - 1);
+    void *map = mmap(NULL, cap, PROT_READ, MAP_SHARED, h->log_fd, 0);
+    if (map == MAP_FAILED) return -1;
+    if (h->log) munmap((void *)h->log, h->log_map);
+    h->log = map;
+    h->log_map = cap;
+    return 0;
+}
+
+// Map the index file if it exists and fits the log
+static int map_index(struct history *h) {
+    char path[PATH_MAX + 72];
+    snprintf(path, sizeof(path), "%s.idx", h->base);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct index_header))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const struct index_header *header = map;
+    if (memcmp(header->magic, index_magic, sizeof(index_magic)) != 0 || header->covered > h->log_len ||
+        (header->covered > 0 && h->log[header->covered - 1] != '\n') ||
+        header->count != (st.st_size - sizeof(*header)) / sizeof(uint64_t)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    const uint64_t *offs = (const uint64_t *)(header + 1);
+    for (uint64_t i = 0; i < header->count; i++) {
+        if (offs[i] >= header->covered || (offs[i] > 0 && h->log[offs[i] - 1] != '\n')) {
+            munmap(map, st.st_size);
+            return -1;
+        }
+    }
+    if (h->index_map) munmap(h->index_map, h->index_map_len);
+    h->index_map = map;
+    h->index_map_len = st.st_size;
+    h->index = offs;
+    h->index_count = header->count;
+    h->covered = header->covered;
+    return 0;
+}
+
+// Replace the index file with count sorted offsets covering the whole log
+static int write_index(struct history *h, const uint64_t *offs, size_t count) {
+    char path[PATH_MAX + 72], tmp[PATH_MAX + 72];
+    snprintf(path, sizeof(path), "%s.idx", h->base);
+    snprintf(tmp, sizeof(tmp), "%s.idx.tmp", h->base);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) return -1;
+
+    struct index_header header = { .covered = h->log_len, .count = count };
+    memcpy(header.magic, index_magic, sizeof(index_magic));
+    const char *parts[2] = { (const char *)&header, (const char *)offs };
+    size_t sizes[2] = { sizeof(header), count * sizeof(*offs) };
+    for (int i = 0; i < 2; i++) {
+        while (sizes[i] > 0) {
+            ssize_t n = write(fd, parts[i], sizes[i]);
+            if (n <= 0) {
+                close(fd);
+                unlink(tmp);
+                return -1;
+            }
+            parts[i] += n;
+            sizes[i] -= n;
+        }
+    }
+    close(fd);
+    if (rename(tmp, path) == -1) {
+        unlink(tmp);
+        return -1;
+    }
+    return map_index(h);
+}
+
+// Index the whole log from scratch
+static int rebuild(struct history *h) {
+    size_t count = 0;
+    for (const char *p = h->log, *end = h->log + h->log_len; p < end; p++)
+        count += *p == '\n';
+    uint64_t *offs = malloc((count ? count : 1) * sizeof(*offs));
+    if (!offs) return -1;
+
+    size_t n = 0;
+    for (uint64_t off = 0; off < h->log_len; off += entry_len(h, off) + 1)
+        offs[n++] = off;
+    qsort_r(offs, n, sizeof(*offs), offset_compare, h);
+    size_t unique = 0;
+    for (size_t i = 0; i < n; i++)
+        if (unique == 0 || offset_compare(&offs[unique - 1], &offs[i], h) != 0) offs[unique++] = offs[i];
+
+    int result = write_index(h, offs, unique);
+    free(offs);
+    if (result == 0) h->tail_count = 0;
+    return result;
+}
+
+// Fold the tail into the index file. If it cannot be written the tail just
+// keeps growing.
+static void merge(struct history *h) {
+    size_t count = h->index_count + h->tail_count;
+    uint64_t *merged = malloc(count * sizeof(*merged));
+    if (!merged) return;
+    size_t i = 0, j = 0, n = 0;
+    while (i < h->index_count || j < h->tail_count) {
+        if (j == h->tail_count || (i < h->index_count && offset_compare(&h->index[i], &h->tail[j], h) < 0))
+            merged[n++] = h->index[i++];
+        else
+            merged[n++] = h->tail[j++];
+    }
+    if (write_index(h, merged, n) == 0) h->tail_count = 0;
+    free(merged);
+}
+
+// Index the entry at off unless the same command already is
+static void index_entry(struct history *h, uint64_t off) {
+    const char *text = h->log + off;
+    size_t len = entry_len(h, off);
+    if (contains(h, h->index, h->index_count, text, len) || contains(h, h->tail, h->tail_count, text, len)) return;
+
+    if (h->tail_count == h->tail_cap) {
+        size_t cap = h->tail_cap ? h->tail_cap * 2 : 256;
+        uint64_t *tail = realloc(h->tail, cap * sizeof(*tail));
+        if (!tail) return;
+        h->tail = tail;
+        h->tail_cap = cap;
+    }
+    size_t pos = lower_bound(h, h->tail, h->tail_count, text, len);
+    memmove(h->tail + pos + 1, h->tail + pos, (h->tail_count - pos) * sizeof(*h->tail));
+    h->tail[pos] = off;
+    h->tail_count++;
+    if (h->tail_count >= HISTORY_TAIL && h->tail_count % HISTORY_TAIL == 0) merge(h);
+}
+
+// ---------- DIRECTORY CAP ----------
+// Every session that keeps its cookie leaves a log, so the directory holds
+// at most HISTORY_LOGS_MAX of them. Past that the least recently written
+// go, down to three quarters of the cap: one scan per thousand new logs.
+
+static pthread_mutex_t logs_lock = PTHREAD_MUTEX_INITIALIZER;
+static long logs_count = -1;         // logs in the directory; -1 until counted
+
+struct log_age {
+    long long mtime_ns;
+    char id[NAME_MAX + 1];
+};
+
+static int age_compare(const void *a, const void *b) {
+    long long x = ((const struct log_age *)a)->mtime_ns, y = ((const struct log_age *)b)->mtime_ns;
+    return (x > y) - (x < y);
+}
+
+static void remove_files(const char *id) {
+    char path[PATH_MAX + NAME_MAX + 8];
+    snprintf(path, sizeof(path), "%s/%s.log", history_dir, id);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%s.idx", history_dir, id);
+    unlink(path);
+}
+
+// Count the logs and delete the oldest if there are too many (logs_lock held)
+static void prune_logs(void) {
+    DIR *dir = opendir(history_dir);
+    if (!dir) return;
+    struct log_age *logs = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent *e;
+    struct stat st;
+    while ((e = readdir(dir))) {
+        size_t len = strlen(e->d_name);
+        if (len <= 4 || strcmp(e->d_name + len - 4, ".log") != 0) continue;
+        if (fstatat(dirfd(dir), e->d_name, &st, 0) == -1) continue;
+        if (count == cap) {
+            struct log_age *grown = realloc(logs, (cap ? cap * 2 : 256) * sizeof(*logs));
+            if (!grown) break;
+            logs = grown;
+            cap = cap ? cap * 2 : 256;
+        }
+        logs[count].mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        snprintf(logs[count].id, sizeof(logs[count].id), "%.*s", (int)(len - 4), e->d_name);
+        count++;
+    }
+    closedir(dir);
+    logs_count = count;
+    if (count > HISTORY_LOGS_MAX) {
+        qsort(logs, count, sizeof(*logs), age_compare);
+        for (size_t i = 0; i < count - HISTORY_LOGS_MAX * 3 / 4; i++) remove_files(logs[i].id);
+        logs_count = HISTORY_LOGS_MAX * 3 / 4;
+    }
+    free(logs);
+}
+
+// ---------- API ----------
+
+int history_exists(const char *id) {
+    pthread_once(&dir_once, dir_init);
+    if (!history_dir[0]) return 0;
+    char path[PATH_MAX + 72];
+    snprintf(path, sizeof(path), "%s/%s.log", history_dir, id);
+    return access(path, F_OK) == 0;
+}
+
+void history_remove(const char *id) {
+    pthread_once(&dir_once, dir_init);
+    if (!history_dir[0]) return;
+    remove_files(id);
+    pthread_mutex_lock(&logs_lock);
+    if (logs_count > 0) logs_count--;
+    pthread_mutex_unlock(&logs_lock);
+}
+
+struct history *history_open(const char *id) {
+    pthread_once(&dir_once, dir_init);
+    if (!history_dir[0]) return NULL;
+    struct history *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    snprintf(h->base, sizeof(h->base), "%s/%s", history_dir, id);
+
+    char path[PATH_MAX + 72];
+    snprintf(path, sizeof(path), "%s.log", h->base);
+    if (access(path, F_OK) == -1) {
+        pthread_mutex_lock(&logs_lock);
+        if (logs_count < 0 || logs_count >= HISTORY_LOGS_MAX) prune_logs();
+        logs_count++;
+        pthread_mutex_unlock(&logs_lock);
+    }
+    h->log_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    struct stat st;
+    if (h->log_fd == -1 || fstat(h->log_fd, &st) == -1) {
+        if (h->log_fd != -1) close(h->log_fd);
+        free(h);
+        return NULL;
+    }
+    // A line cut short by a crash gets its newline
+    char last = '\n';
+    if (st.st_size > 0 && pread(h->log_fd, &last, 1, st.st_size - 1) == 1 && last != '\n' &&
+        write(h->log_fd, "\n", 1) == 1)
+        st.st_size++;
+    h->log_len = st.st_size;
+    if (map_log(h, h->log_len) == -1) {
+        history_close(h);
+        return NULL;
+    }
+
+    // Catch the index up with lines logged after it was last written
+    size_t behind = 0;
+    if (map_index(h) == 0)
+        for (const char *p = h->log + h->covered, *end = h->log + h->log_len; p < end && behind <= HISTORY_TAIL; p++)
+            behind += *p == '\n';
+    if (!h->index_map || behind > HISTORY_TAIL) {
+        if (rebuild(h) == -1) {
+            history_close(h);
+            return NULL;
+        }
+    } else {
+        for (uint64_t off = h->covered; off < h->log_len; off += entry_len(h, off) + 1)
+            index_entry(h, off);
+    }
+    return h;
+}
+
+void history_close(struct history *h) {
+    if (!h) return;
+    if (h->log) munmap((void *)h->log, h->log_map);
+    if (h->index_map) munmap(h->index_map, h->index_map_len);
+    if (h->log_fd != -1) close(h->log_fd);
+    free(h->tail);
+    free(h);
+}
+
+void history_add(struct history *h, const char *line) {
+    size_t len = strlen(line);
+    if (len == 0 || len > HISTORY_LINE_MAX) return;
+    char *entry = malloc(len + 1);
+    if (!entry) return;
+    for (size_t i = 0; i < len; i++)
+        entry[i] = line[i] == '\n' || line[i] == '\r' ? ' ' : line[i];
+    entry[len] = '\n';
+    ssize_t written = write(h->log_fd, entry, len + 1);
+    free(entry);
+    if (written != (ssize_t)(len + 1)) return;
+
+    uint64_t off = h->log_len;
+    if (off + len + 1 > h->log_map && map_log(h, off + len + 1) == -1) return;
+    h->log_len += len + 1;
+    index_entry(h, off);
+}
+
+int history_complete(struct history *h, const char *prefix, size_t len, int max,
+                     void (*fn)(const char *text, size_t len, void *arg), void *arg) {
+    // Both arrays are sorted, so their matches are two runs to merge
+    size_t i = lower_bound(h, h->index, h->index_count, prefix, len);
+    size_t j = lower_bound(h, h->tail, h->tail_count, prefix, len);
+    int found = 0;
+    while (found <= max) {
+        int from_index = i < h->index_count && has_prefix(h, h->index[i], prefix, len);
+        int from_tail = j < h->tail_count && has_prefix(h, h->tail[j], prefix, len);
+        if (!from_index && !from_tail) break;
+        if (from_index && from_tail) from_index = offset_compare(&h->index[i], &h->tail[j], h) < 0;
+        uint64_t off = from_index ? h->index[i++] : h->tail[j++];
+        if (found++ < max) fn(h->log + off, entry_len(h, off), arg);
+    }
+    return found;
+}
+
+int history_last(struct history *h, int count, void (*fn)(const char *text, size_t len, void *arg), void *arg) {
+    // Walk back over count newlines, then forward again
+    size_t start = h->log_len;
+    int n = 0;
+    while (n < count && start > 0) {
+        const char *nl = start > 1 ? memrchr(h->log, '\n', start - 1) : NULL;
+        start = nl ? (size_t)(nl - h->log) + 1 : 0;
+        n++;
+    }
+    for (uint64_t off = start; off < h->log_len; off += entry_len(h, off) + 1)
+        fn(h->log + off, entry_len(h, off), arg);
+    return n;
+}
@@ -0,0 +1,45 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+
+// Persistent command history of one session. Commands are appended to a
+// log, <dir>/<session id>.log, one per line, and its distinct commands are
+// indexed for prefix search in <id>.idx: a sorted array of log offsets, so
+// a completion is a binary search plus a walk over the matches however
+// long the log grows. Log and index are both mmap'd. New commands go into
+// a small sorted tail that is merged into the index file once it fills,
+// keeping appends cheap. The log survives restarts; an index that is
+// missing or behind the log is brought up to date when the log is opened.
+// The directory is WEBSHELL_HISTORY_DIR, by default
+// $HOME/.local/state/webshell; set it empty to keep history in memory only.
+// It holds a few thousand logs at most, dropping the least recently written.
+// Not thread-safe: the session's lock guards each history.
+
+struct history;
+
+// Open (or create) the history of session id; NULL if persistent history is
+// off or the files cannot be opened
+struct history *history_open(const char *id);
+void history_close(struct history *h);
+
+// Whether session id has a log, e.g. from before a restart
+int history_exists(const char *id);
+
+// Delete session id's log and index (close its history first)
+void history_remove(const char *id);
+
+// Log a command. Newlines in it are stored as spaces.
+void history_add(struct history *h, const char *line);
+
+// Call fn for each distinct logged command starting with prefix, in byte
+// order, up to max of them. Returns how many matched, counting no further
+// than max + 1, so a result over max means some were left out.
+int history_complete(struct history *h, const char *prefix, size_t len, int max,
+                     void (*fn)(const char *text, size_t len, void *arg), void *arg);
+
+// Call fn for the last count commands logged, oldest first. Returns how
+// many there were.
+int history_last(struct history *h, int count, void (*fn)(const char *text, size_t len, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,280 @@
+#include <string.h>
+#include <strings.h>
+#include "http.h"
+
+#define MAX_CHUNK_LINE 1024      // chunk size line or trailer line
+
+enum { REQUEST_LINE, HEADERS, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILERS, DONE };
+
+void http_request_init(struct http_request *req, size_t max_header, size_t max_body) {
+    memset(req, 0, sizeof(*req));
+    req->max_header = max_header;
+    req->max_body = max_body;
+}
+
+static enum http_result fail(struct http_request *req, int status) {
+    req->error = status;
+    return HTTP_ERROR;
+}
+
+// Find the end of the line starting at req->pos. Returns the offset just
+// past its '\n' and sets *line_len to its length without CR LF, or returns 0
+// if the line has not fully arrived.
+static size_t next_line(struct http_request *req, const char *buf, size_t len, size_t *line_len) {
+    if (req->scan < req->pos) req->scan = req->pos;
+    const char *nl = memchr(buf + req->scan, '\n', len - req->scan);
+    if (!nl) {
+        req->scan = len;
+        return 0;
+    }
+    size_t end = nl - buf;
+    *line_len = end - req->pos;
+    if (*line_len > 0 && buf[end - 1] == '\r') (*line_len)--;
+    return end + 1;
+}
+
+static int span_equals(const char *text, size_t len, const char *word) {
+    return strlen(word) == len && strncasecmp(text, word, len) == 0;
+}
+
+// Whether a comma-separated header value lists token (any case)
+static int list_has(const char *value, size_t len, const char *token) {
+    const char *end = value + len;
+    while (value < end) {
+        const char *item_end = memchr(value, ',', end - value);
+        if (!item_end) item_end = end;
+        const char *a = value, *b = item_end;
+        while (a < b && (*a == ' ' || *a == '\t')) a++;
+        while (b > a && (b[-1] == ' ' || b[-1] == '\t')) b--;
+        if (span_equals(a, b - a, token)) return 1;
+        value = item_end + 1;
+    }
+    return 0;
+}
+
+// METHOD SP target SP HTTP/1.x
+static enum http_result parse_request_line(struct http_request *req, const char *line, size_t len) {
+    const char *end = line + len;
+    const char *sp1 = memchr(line, ' ', len);
+    if (!sp1 || sp1 == line) return fail(req, 400);
+    const char *target = sp1 + 1;
+    const char *sp2 = memchr(target, ' ', end - target);
+    if (!sp2 || sp2 == target) return fail(req, 400);
+    const char *version = sp2 + 1;
+
+    for (const char *c = line; c < sp1; c++)
+        if (*c < 'A' || *c > 'Z') return fail(req, 400);
+    if (end - version != 8 || strncmp(version, "HTTP/", 5) != 0 || version[6] != '.')
+        return fail(req, 400);
+    if (version[5] != '1' || (version[7] != '0' && version[7] != '1')) return fail(req, 505);
+
+    size_t start = line - req->base;
+    req->method = (struct http_span){ start, sp1 - line };
+    req->target = (struct http_span){ target - req->base, sp2 - target };
+    const char *query = memchr(target, '?', sp2 - target);
+    if (query) {
+        req->path = (struct http_span){ req->target.off, query - target };
+        req->query = (struct http_span){ query + 1 - req->base, sp2 - query - 1 };
+    } else {
+        req->path = req->target;
+        req->query = (struct http_span){ sp2 - req->base, 0 };
+    }
+    req->minor_version = version[7] - '0';
+    return HTTP_INCOMPLETE;
+}
+
+// name ":" OWS value OWS
+static enum http_result parse_header(struct http_request *req, const char *line, size_t len) {
+    // Folded continuation lines are obsolete and a smuggling risk
+    if (*line == ' ' || *line == '\t') return fail(req, 400);
+    const char *colon = memchr(line, ':', len);
+    if (!colon || colon == line) return fail(req, 400);
+    for (const char *c = line; c < colon; c++)
+        if (*c == ' ' || *c == '\t') return fail(req, 400);
+    if (req->header_count == HTTP_MAX_HEADERS) return fail(req, 431);
+
+    const char *value = colon + 1, *end = line + len;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    struct http_header *h = &req->headers[req->header_count++];
+    h->name = (struct http_span){ line - req->base, colon - line };
+    h->value = (struct http_span){ value - req->base, end - value };
+    return HTTP_INCOMPLETE;
+}
+
+// Work out the body framing and connection handling once the headers are in
+static enum http_result finish_headers(struct http_request *req) {
+    int have_length = 0, close = 0, keep_alive = 0;
+    for (int i = 0; i < req->header_count; i++) {
+        const char *name = http_text(req, req->headers[i].name);
+        size_t name_len = req->headers[i].name.len;
+        const char *value = http_text(req, req->headers[i].value);
+        size_t len = req->headers[i].value.len;
+
+        if (span_equals(name, name_len, "Content-Length")) {
+            size_t n = 0;
+            if (len == 0) return fail(req, 400);
+            for (size_t j = 0; j < len; j++) {
+                if (value[j] < '0' || value[j] > '9') return fail(req, 400);
+                n = n * 10 + (value[j] - '0');
+                if (n > req->max_body) return fail(req, 413);
+            }
+            // Repeats must agree, or two parsers could frame the body differently
+            if (have_length && n != req->content_length) return fail(req, 400);
+            req->content_length = n;
+            have_length = 1;
+        } else if (span_equals(name, name_len, "Transfer-Encoding")) {
+            // Only plain chunked is supported; it must be the last coding
+            if (!span_equals(value, len, "chunked")) return fail(req, 501);
+            req->chunked = 1;
+        } else if (span_equals(name, name_len, "Connection")) {
+            close |= list_has(value, len, "close");
+            keep_alive |= list_has(value, len, "keep-alive");
+        } else if (span_equals(name, name_len, "Expect")) {
+            if (!span_equals(value, len, "100-continue")) return fail(req, 417);
+            req->expect_continue = 1;
+        }
+    }
+    if (req->chunked && have_length) return fail(req, 400);
+
+    // HTTP/1.1 keeps the connection open unless told otherwise; HTTP/1.0 is the reverse
+    req->keep_alive = req->minor_version >= 1 ? !close : keep_alive;
+    req->body = (struct http_span){ req->pos, 0 };
+    if (req->chunked) req->state = CHUNK_SIZE;
+    else if (req->content_length > 0) req->state = BODY;
+    else req->state = DONE;
+    return HTTP_INCOMPLETE;
+}
+
+// hex-size [; extensions]
+static enum http_result parse_chunk_size(struct http_request *req, const char *line, size_t len) {
+    size_t size = 0, i = 0;
+    for (; i < len; i++) {
+        char c = line[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) break;
+        size = size * 16 + digit;
+        if (size > req->max_body) return fail(req, 413);
+    }
+    if (i == 0 || (i < len && line[i] != ';' && line[i] != ' ' && line[i] != '\t')) return fail(req, 400);
+    if (size > req->max_body - req->body.len) return fail(req, 413);
+    req->chunk_left = size;
+    req->state = size ? CHUNK_DATA : TRAILERS;
+    return HTTP_INCOMPLETE;
+}
+
+enum http_result http_parse(struct http_request *req, char *buf, size_t len) {
+    req->base = buf;
+    while (req->state != DONE) {
+        size_t line_len, next;
+        enum http_result result = HTTP_INCOMPLETE;
+
+        switch (req->state) {
+            case REQUEST_LINE:
+            case HEADERS:
+                next = next_line(req, buf, len, &line_len);
+                if (!next) {
+                    if (len > req->max_header) return fail(req, req->state == REQUEST_LINE ? 414 : 431);
+                    return HTTP_INCOMPLETE;
+                }
+                if (next > req->max_header) return fail(req, req->state == REQUEST_LINE ? 414 : 431);
+                if (req->state == REQUEST_LINE) {
+                    // Stray blank lines before a request (e.g. after a POST body) are ignored
+                    if (line_len > 0) {
+                        result = parse_request_line(req, buf + req->pos, line_len);
+                        req->state = HEADERS;
+                    }
+                    req->pos = next;
+                } else if (line_len > 0) {
+                    result = parse_header(req, buf + req->pos, line_len);
+                    req->pos = next;
+                } else {
+                    req->pos = next;
+                    result = finish_headers(req);
+                }
+                break;
+
+            case BODY:
+                if (len - req->pos < req->content_length) return HTTP_INCOMPLETE;
+                req->body.len = req->content_length;
+                req->pos += req->content_length;
+                req->state = DONE;
+                break;
+
+            case CHUNK_SIZE:
+            case CHUNK_END:
+            case TRAILERS:
+                next = next_line(req, buf, len, &line_len);
+                if (!next) return len - req->pos > MAX_CHUNK_LINE ? fail(req, 400) : HTTP_INCOMPLETE;
+                if (next - req->pos > MAX_CHUNK_LINE) return fail(req, 400);
+                if (req->state == CHUNK_SIZE) {
+                    result = parse_chunk_size(req, buf + req->pos, line_len);
+                } else if (req->state == CHUNK_END) {
+                    // The CR LF that closes a chunk's data
+                    if (line_len != 0) return fail(req, 400);
+                    req->state = CHUNK_SIZE;
+                } else if (line_len == 0) {
+                    req->state = DONE;
+                } else {
+                    // Trailers are dropped, but count against the header limit
+                    req->chunk_left += next - req->pos;
+                    if (req->chunk_left > req->max_header) return fail(req, 431);
+                }
+                req->pos = next;
+                break;
+
+            case CHUNK_DATA: {
+                // Slide the data down over the framing so the body ends up contiguous
+                size_t n = len - req->pos < req->chunk_left ? len - req->pos : req->chunk_left;
+                if (n == 0) return HTTP_INCOMPLETE;
+                memmove(buf + req->body.off + req->body.len, buf + req->pos, n);
+                req->body.len += n;
+                req->pos += n;
+                req->chunk_left -= n;
+                if (req->chunk_left == 0) req->state = CHUNK_END;
+                break;
+            }
+        }
+        if (result == HTTP_ERROR) return result;
+    }
+    req->length = req->pos;
+    return HTTP_COMPLETE;
+}
+
+int http_in_body(const struct http_request *req) {
+    return req->state >= BODY && req->state != DONE;
+}
+
+const char *http_header(const struct http_request *req, const char *name, size_t *len) {
+    for (int i = 0; i < req->header_count; i++) {
+        if (span_equals(http_text(req, req->headers[i].name), req->headers[i].name.len, name)) {
+            *len = req->headers[i].value.len;
+            return http_text(req, req->headers[i].value);
+        }
+    }
+    return NULL;
+}
+
+int http_header_lists(const struct http_request *req, const char *name, const char *token) {
+    size_t len;
+    const char *value = http_header(req, name, &len);
+    return value && list_has(value, len, token);
+}
+
+int http_span_is(const struct http_request *req, struct http_span span, const char *text) {
+    return strlen(text) == span.len && memcmp(http_text(req, span), text, span.len) == 0;
+}
+
+const char *http_reason(int status) {
+    switch (status) {
+        case 400: return "Bad Request";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 417: return "Expectation Failed";
+        case 431: return "Request Header Fields Too Large";
+        case 501: return "Not Implemented";
+        case 505: return "HTTP Version Not Supported";
+        default:  return "Error";
+    }
+}
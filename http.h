@@ -0,0 +1,76 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <stddef.h>
+
+// Incremental HTTP/1.1 request parser. Bytes may arrive in any number of
+// pieces: each http_parse() call resumes where the previous one stopped, so
+// nothing is scanned twice. Nothing is copied either: the request line and
+// headers are spans of the caller's buffer, and a chunked body is decoded
+// in place. The buffer may be moved or grown between calls as long as its
+// contents stay the same.
+
+#define HTTP_MAX_HEADERS 32
+
+// Text at buffer offset off; offsets survive the buffer being reallocated
+struct http_span {
+    size_t off, len;
+};
+
+struct http_header {
+    struct http_span name, value;
+};
+
+enum http_result { HTTP_INCOMPLETE, HTTP_COMPLETE, HTTP_ERROR };
+
+struct http_request {
+    // Parser state
+    int state;
+    size_t pos;                  // start of the first unparsed line or body byte
+    size_t scan;                 // how far the current line was searched for '\n'
+    size_t chunk_left;           // bytes left in the current body chunk
+    size_t max_header;           // limit on request line + headers
+    size_t max_body;             // limit on the (decoded) body
+
+    // Available once the headers are in (expect_continue, content_length)
+    // or the whole request is (everything else)
+    const char *base;            // buffer given to the latest http_parse()
+    struct http_span method, target, path, query;   // path and query split target at '?'
+    int minor_version;           // HTTP/1.<minor_version>
+    struct http_header headers[HTTP_MAX_HEADERS];
+    int header_count;
+    int keep_alive;              // from the version and the Connection header
+    int chunked;                 // Transfer-Encoding: chunked
+    int expect_continue;         // client waits for "100 Continue" before the body
+    size_t content_length;
+    struct http_span body;       // decoded body
+    size_t length;               // bytes the request took in the buffer
+    int error;                   // HTTP_ERROR: status code to answer with
+};
+
+void http_request_init(struct http_request *req, size_t max_header, size_t max_body);
+
+// Parse as much of the request at the start of buf as len bytes allow
+enum http_result http_parse(struct http_request *req, char *buf, size_t len);
+
+// Whether the headers are complete and the body has not fully arrived
+int http_in_body(const struct http_request *req);
+
+// Value of the first header called name (any case), or NULL
+const char *http_header(const struct http_request *req, const char *name, size_t *len);
+
+// Whether the first header called name is a comma-separated list holding
+// token (any case), as in "Connection: keep-alive, Upgrade"
+int http_header_lists(const struct http_request *req, const char *name, const char *token);
+
+// Whether span holds exactly text
+int http_span_is(const struct http_request *req, struct http_span span, const char *text);
+
+static inline const char *http_text(const struct http_request *req, struct http_span span) {
+    return req->base + span.off;
+}
+
+// Reason phrase for the status codes the parser reports
+const char *http_reason(int status);
+
+#endif
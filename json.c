@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+
+void json_reader_init(struct json_reader *r, const char *data, size_t len) {
+    r->p = data;
+    r->end = data + len;
+    r->failed = 0;
+}
+
+static void skip_space(struct json_reader *r) {
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r')) r->p++;
+}
+
+static int fail(struct json_reader *r) {
+    r->failed = 1;
+    return 0;
+}
+
+// Consume c after any whitespace
+static int expect(struct json_reader *r, char c) {
+    skip_space(r);
+    if (r->failed || r->p == r->end || *r->p != c) return fail(r);
+    r->p++;
+    return 1;
+}
+
+// Consume the literal word
+static int literal(struct json_reader *r, const char *word) {
+    size_t len = strlen(word);
+    if ((size_t)(r->end - r->p) < len || memcmp(r->p, word, len) != 0) return fail(r);
+    r->p += len;
+    return 1;
+}
+
+enum json_type json_peek(struct json_reader *r) {
+    skip_space(r);
+    if (r->failed) return JSON_INVALID;
+    if (r->p == r->end) return JSON_END;
+    switch (*r->p) {
+        case '"': return JSON_STRING;
+        case '[': return JSON_ARRAY;
+        case '{': return JSON_OBJECT;
+        case 't': case 'f': return JSON_BOOL;
+        case 'n': return JSON_NULL;
+        case '-': case '0' ... '9': return JSON_NUMBER;
+        default: return JSON_INVALID;
+    }
+}
+
+int json_enter(struct json_reader *r, char open) {
+    return expect(r, open);
+}
+
+int json_next(struct json_reader *r, char close, int index) {
+    skip_space(r);
+    if (r->failed || r->p == r->end) return fail(r);
+    if (*r->p == close) {
+        r->p++;
+        return 0;
+    }
+    return index == 0 || expect(r, ',');
+}
+
+static int hex4(const char *p) {
+    int value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        int digit = c >= '0' && c <= '9' ? c - '0'
+                  : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) return -1;
+        value = value << 4 | digit;
+    }
+    return value;
+}
+
+static size_t put_utf8(char *out, unsigned int cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xc0 | cp >> 6);
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | cp >> 12);
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | cp >> 18);
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// Decode the string body [s, end) into out; returns its length, or -1 if
+// it holds a control character, a bad escape or a NUL
+static long decode_string(const char *s, const char *end, char *out) {
+    static const char from[] = "\"\\/bfnrt", to[] = "\"\\/\b\f\n\r\t";
+    size_t n = 0;
+    while (s < end) {
+        if ((unsigned char)*s < 0x20) return -1;
+        if (*s != '\\') {
+            out[n++] = *s++;
+            continue;
+        }
+        char e = s[1];
+        s += 2;
+        if (e != 'u') {
+            const char *found = e ? strchr(from, e) : NULL;
+            if (!found) return -1;
+            out[n++] = to[found - from];
+            continue;
+        }
+        int cp = end - s >= 4 ? hex4(s) : -1;
+        s += 4;
+        // A high surrogate only counts with its low half right after it
+        if (cp >= 0xd800 && cp <= 0xdbff && end - s >= 6 && s[0] == '\\' && s[1] == 'u') {
+            int low = hex4(s + 2);
+            if (low >= 0xdc00 && low <= 0xdfff) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                s += 6;
+            }
+        }
+        if (cp <= 0 || (cp >= 0xd800 && cp <= 0xdfff)) return -1;
+        n += put_utf8(out + n, (unsigned int)cp);
+    }
+    return (long)n;
+}
+
+// The closing quote of the string whose body starts at p, or NULL
+static const char *string_end(struct json_reader *r, const char *p) {
+    while (p < r->end && *p != '"') p += *p == '\\' ? 2 : 1;
+    return p < r->end ? p : NULL;
+}
+
+char *json_string(struct json_reader *r, struct arena *arena) {
+    if (!expect(r, '"')) return NULL;
+    const char *end = string_end(r, r->p);
+    if (!end) {
+        fail(r);
+        return NULL;
+    }
+    // Decoding never makes a string longer
+    char *out = arena_alloc(arena, end - r->p + 1);
+    long len = decode_string(r->p, end, out);
+    if (len < 0) {
+        fail(r);
+        return NULL;
+    }
+    out[len] = '\0';
+    r->p = end + 1;
+    return out;
+}
+
+char *json_key(struct json_reader *r, struct arena *arena) {
+    char *key = json_string(r, arena);
+    return key && expect(r, ':') ? key : NULL;
+}
+
+int json_bool(struct json_reader *r) {
+    if (json_peek(r) != JSON_BOOL) return fail(r) - 1;
+    if (*r->p == 't') return literal(r, "true") ? 1 : -1;
+    return literal(r, "false") ? 0 : -1;
+}
+
+double json_number(struct json_reader *r) {
+    if (json_peek(r) != JSON_NUMBER) return fail(r);
+    // The input is not NUL-terminated, so strtod() gets a copy
+    char text[64];
+    size_t len = 0;
+    while (r->p + len < r->end && len < sizeof(text) - 1 && strchr("+-.0123456789eE", r->p[len])) len++;
+    memcpy(text, r->p, len);
+    text[len] = '\0';
+    char *stop;
+    double value = strtod(text, &stop);
+    if ((size_t)(stop - text) != len) return fail(r);
+    r->p += len;
+    return value;
+}
+
+void json_skip(struct json_reader *r) {
+    int depth = 0;
+    do {
+        switch (json_peek(r)) {
+            case JSON_STRING: {
+                const char *end = string_end(r, r->p + 1);
+                if (!end) {
+                    fail(r);
+                    return;
+                }
+                r->p = end + 1;
+                break;
+            }
+            case JSON_NUMBER: json_number(r); break;
+            case JSON_BOOL: json_bool(r); break;
+            case JSON_NULL: literal(r, "null"); break;
+            case JSON_ARRAY: case JSON_OBJECT:
+                if (++depth > JSON_MAX_DEPTH) {
+                    fail(r);
+                    return;
+                }
+                r->p++;
+                skip_space(r);
+                if (r->p == r->end || (*r->p != ']' && *r->p != '}')) continue;   // first member next
+                r->p++;
+                depth--;
+                break;
+            default:
+                fail(r);
+                return;
+        }
+        if (r->failed) return;
+        // After a value: commas, colons and closing brackets decide what
+        // comes next. Keys are skipped as strings, so structure is only
+        // checked loosely.
+        skip_space(r);
+        while (depth > 0 && r->p < r->end && (*r->p == ']' || *r->p == '}')) {
+            r->p++;
+            depth--;
+            skip_space(r);
+        }
+        if (depth > 0) {
+            if (r->p < r->end && (*r->p == ',' || *r->p == ':')) r->p++;
+            else fail(r);
+        }
+    } while (depth > 0 && !r->failed);
+}
+
+int json_ok(struct json_reader *r) {
+    return json_peek(r) == JSON_END;
+}
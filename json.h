@@ -0,0 +1,53 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Pull reader for the small JSON documents clients send (POST
+// /execute_batch). The caller walks the document in the order it expects
+// and the reader checks each step; the first mismatch marks the reader
+// failed and every later call then fails too, so a caller can read a whole
+// structure and test json_ok() once at the end. Strings are decoded into
+// an arena; nothing else is copied.
+
+#define JSON_MAX_DEPTH 32        // nesting json_skip() follows
+
+enum json_type { JSON_END, JSON_INVALID, JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+struct json_reader {
+    const char *p, *end;
+    int failed;
+};
+
+void json_reader_init(struct json_reader *r, const char *data, size_t len);
+
+// Type of the next value, without consuming it
+enum json_type json_peek(struct json_reader *r);
+
+// Step into an array or object: open is '[' or '{'
+int json_enter(struct json_reader *r, char open);
+
+// Whether another element follows in the array or object just entered
+// (index is how many came before it); consumes the separator, or the
+// closing bracket when there are no more. For objects, read the key next.
+int json_next(struct json_reader *r, char close, int index);
+
+// A string (or an object key, with its ':'), NUL-terminated in arena.
+// Strings holding NUL are refused. NULL on failure.
+char *json_string(struct json_reader *r, struct arena *arena);
+char *json_key(struct json_reader *r, struct arena *arena);
+
+// true or false as 1 or 0; -1 on failure
+int json_bool(struct json_reader *r);
+
+// A number; 0 on failure
+double json_number(struct json_reader *r);
+
+// Pass over the next value, whatever it is
+void json_skip(struct json_reader *r);
+
+// Nothing failed and only whitespace is left
+int json_ok(struct json_reader *r);
+
+#endif
@@ -0,0 +1,141 @@
+#include <string.h>
+#include "lexer.h"
+
+// Character classes, looked up once per input byte
+enum {
+    C_BLANK = 1,         // ends a word
+    C_OPERATOR = 2,      // ends a word and starts an operator
+    C_SH = 4,            // unquoted: something only sh can expand
+    C_QUOTE = 8,         // ' " or backslash
+};
+
+static const unsigned char char_class[256] = {
+    [' '] = C_BLANK, ['\t'] = C_BLANK, ['\n'] = C_BLANK,
+    ['|'] = C_OPERATOR, ['&'] = C_OPERATOR, [';'] = C_OPERATOR,
+    ['<'] = C_OPERATOR, ['>'] = C_OPERATOR, ['('] = C_OPERATOR, [')'] = C_OPERATOR,
+    ['$'] = C_SH, ['`'] = C_SH, ['*'] = C_SH, ['?'] = C_SH, ['['] = C_SH, [']'] = C_SH,
+    ['{'] = C_SH, ['}'] = C_SH, ['~'] = C_SH, ['#'] = C_SH, ['!'] = C_SH, ['='] = C_SH,
+    ['\''] = C_QUOTE, ['"'] = C_QUOTE, ['\\'] = C_QUOTE,
+};
+
+#define CLASS(c) char_class[(unsigned char)(c)]
+
+static int is_blank(char c) {
+    return CLASS(c) & C_BLANK;
+}
+
+// End of a word: NUL, blank or operator
+static int ends_word(char c) {
+    return c == '\0' || (CLASS(c) & (C_BLANK | C_OPERATOR));
+}
+
+void lexer_init(struct lexer *lx, const char *input, struct arena *arena) {
+    lx->pos = input;
+    lx->end = input + strlen(input);
+    lx->arena = arena;
+}
+
+// Operator at lx->pos (known to start with an operator character)
+static enum token_kind lex_operator(struct lexer *lx) {
+    const char *p = lx->pos;
+    enum token_kind kind = TOK_SH_OP;
+    size_t len = 1;
+
+    if (p[0] == '|') {
+        if (p[1] == '|') len = 2;
+        else kind = TOK_PIPE;
+    } else if (p[0] == '&') {
+        if (p[1] == '&') len = 2;
+        else if (p[1] != '>') kind = TOK_BACKGROUND;
+    } else if (p[0] == '<') {
+        if (p[1] == '<' || p[1] == '&' || p[1] == '>') len = 2;
+        else kind = TOK_IN;
+    } else if (p[0] == '>') {
+        if (p[1] == '>') len = 2, kind = TOK_APPEND;
+        else if (p[1] == '&' || p[1] == '|') len = 2;
+        else kind = TOK_OUT;
+    }
+    lx->pos += len;
+    return kind;
+}
+
+enum token_kind lexer_next(struct lexer *lx, struct token *tok) {
+    while (is_blank(*lx->pos)) lx->pos++;
+    tok->word = NULL;
+    tok->needs_sh = 0;
+
+    const char *p = lx->pos;
+    if (!*p) return tok->kind = TOK_END;
+
+    // Redirections of stderr: 2>&1 natively, any other 2>... through sh
+    if (p[0] == '2' && p[1] == '>') {
+        if (strncmp(p, "2>&1", 4) == 0 && ends_word(p[4])) {
+            lx->pos += 4;
+            return tok->kind = TOK_ERR_TO_OUT;
+        }
+        lx->pos += p[2] == '>' ? 3 : 2;
+        return tok->kind = TOK_SH_OP;
+    }
+    if (CLASS(*p) & C_OPERATOR)
+        return tok->kind = lex_operator(lx);
+
+    // A word can only shrink when unquoted, so the rest of the input bounds it
+    char *out = arena_reserve(lx->arena, (size_t)(lx->end - p) + 1);
+    size_t len = 0;
+    while (!ends_word(*p)) {
+        // Plain characters, the common case
+        unsigned char c = CLASS(*p);
+        if (!(c & C_QUOTE)) {
+            if (c & C_SH) tok->needs_sh = 1;
+            out[len++] = *p++;
+            continue;
+        }
+
+        if (*p == '\'') {
+            const char *close = strchr(p + 1, '\'');
+            if (!close) goto unterminated;
+            memcpy(out + len, p + 1, close - p - 1);
+            len += close - p - 1;
+            p = close + 1;
+        } else if (*p == '"') {
+            for (p++; *p != '"'; p++) {
+                if (!*p) goto unterminated;
+                if (*p == '$' || *p == '`') tok->needs_sh = 1;
+                // Inside double quotes a backslash only escapes these
+                if (*p == '\\' && p[1] && strchr("$`\"\\\n", p[1])) p++;
+                out[len++] = *p;
+            }
+            p++;
+        } else {
+            if (p[1] == '\n') {
+                p += 2;        // line continuation
+                continue;
+            }
+            if (p[1]) p++;
+            out[len++] = *p++;
+        }
+    }
+    out[len] = '\0';
+    arena_commit(lx->arena, len + 1);
+    lx->pos = p;
+    tok->word = out;
+    return tok->kind = TOK_WORD;
+
+unterminated:
+    arena_commit(lx->arena, 0);
+    lx->pos = lx->end;
+    return tok->kind = TOK_ERROR;
+}
+
+void word_list_push(struct word_list *list, struct arena *arena, char *word) {
+    // Keep room for the terminating NULL
+    if (list->count + 1 >= list->cap) {
+        int cap = list->cap ? list->cap * 2 : 16;
+        char **words = arena_alloc(arena, cap * sizeof(char *));
+        if (list->count) memcpy(words, list->words, list->count * sizeof(char *));
+        list->words = words;
+        list->cap = cap;
+    }
+    list->words[list->count++] = word;
+    list->words[list->count] = NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "arena.h"
+
+// Tokens of a command line. Only the operators the native executor runs get
+// their own kind; everything else that means something to sh is TOK_SH_OP.
+enum token_kind {
+    TOK_END,
+    TOK_WORD,
+    TOK_PIPE,            // |
+    TOK_IN,              // <
+    TOK_OUT,             // >
+    TOK_APPEND,          // >>
+    TOK_ERR_TO_OUT,      // 2>&1
+    TOK_BACKGROUND,      // & (not && or &>)
+    TOK_SH_OP,           // ; && || ( ) 2> << >& ...
+    TOK_ERROR            // unterminated quote
+};
+
+struct token {
+    enum token_kind kind;
+    char *word;          // TOK_WORD: unquoted text, NUL-terminated, in the arena
+    int needs_sh;        // TOK_WORD: unquoted $ * ~ ... that only sh can expand
+};
+
+// Lexer state. Holds no global or static state, so any number of threads
+// can lex at once as long as each uses its own arena.
+struct lexer {
+    const char *pos;
+    const char *end;
+    struct arena *arena;
+};
+
+void lexer_init(struct lexer *lx, const char *input, struct arena *arena);
+
+// Read the next token. Quotes and backslashes are removed while the word is
+// copied into the arena, in the same pass that finds its end.
+enum token_kind lexer_next(struct lexer *lx, struct token *tok);
+
+// Growable NULL-terminated word vector living in an arena
+struct word_list {
+    char **words;
+    int count, cap;
+};
+
+void word_list_push(struct word_list *list, struct arena *arena, char *word);
+
+#endif
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "metrics.h"
+
+#define SUB_BITS 3                   // 8 buckets per power of two
+#define SUB_COUNT (1 << SUB_BITS)
+#define MAX_EXP 40                   // values from 2^41 ns (~37 min) share the last bucket
+#define BUCKETS ((MAX_EXP - SUB_BITS + 2) * SUB_COUNT)
+#define EXPORT_MIN_EXP 10            // exported bounds: 2^10 ns (~1 us) ...
+#define EXPORT_MAX_EXP 36            // ... to 2^36 ns (~69 s), then +Inf
+
+struct histogram {
+    _Atomic uint64_t buckets[BUCKETS];
+    _Atomic uint64_t sum_ns;
+};
+
+// One thread's figures. Only that thread writes them, so an update is a
+// relaxed load and store rather than a locked add; scrapes read them racily
+// but never see torn values.
+struct shard {
+    _Atomic uint64_t counters[METRIC_COUNTERS];
+    struct histogram histograms[METRIC_HISTOGRAMS];
+    struct shard *next;
+};
+
+// Shards are never freed, so the totals stay monotonic as threads come and go
+static _Atomic(struct shard *) shards;
+static __thread struct shard *own_shard;
+
+// Counters and histograms with the same name are one metric with different
+// labels and must be listed next to each other; only the first has the help
+static const struct {
+    const char *name, *labels, *help;
+} counter_info[METRIC_COUNTERS] = {
+    [METRIC_PIPE_BYTES] = { "webshell_command_output_bytes_total", NULL, "Bytes read from command output pipes." },
+    [METRIC_TRUNCATIONS] = { "webshell_output_truncations_total", NULL,
+                             "Command outputs cut off at the output limit." },
+    [METRIC_SPAWN_FAILURES] = { "webshell_spawn_failures_total", NULL, "Pipelines that could not be started." },
+    [METRIC_CONNECTIONS] = { "webshell_connections_total", NULL, "Client connections accepted." },
+    [METRIC_STOPS_TIMEOUT] = { "webshell_commands_stopped_total", "reason=\"timeout\"",
+                               "Commands stopped at their deadline or by a CPU or file size limit." },
+    [METRIC_STOPS_CPU] = { "webshell_commands_stopped_total", "reason=\"cpu_limit\"", NULL },
+    [METRIC_STOPS_FILE_SIZE] = { "webshell_commands_stopped_total", "reason=\"file_size_limit\"", NULL },
+};
+
+static const struct {
+    const char *name, *labels, *help;
+} histogram_info[METRIC_HISTOGRAMS] = {
+    [METRIC_REQUEST_STATIC] = { "webshell_request_duration_seconds", "route=\"static\"",
+                                "Time from a request being complete to its response headers being queued." },
+    [METRIC_REQUEST_EXECUTE] = { "webshell_request_duration_seconds", "route=\"execute\"", NULL },
+    [METRIC_REQUEST_STATUS] = { "webshell_request_duration_seconds", "route=\"status\"", NULL },
+    [METRIC_REQUEST_METRICS] = { "webshell_request_duration_seconds", "route=\"metrics\"", NULL },
+    [METRIC_REQUEST_JOBS] = { "webshell_request_duration_seconds", "route=\"jobs\"", NULL },
+    [METRIC_REQUEST_TERMINAL] = { "webshell_request_duration_seconds", "route=\"terminal\"", NULL },
+    [METRIC_REQUEST_BATCH] = { "webshell_request_duration_seconds", "route=\"execute_batch\"", NULL },
+    [METRIC_REQUEST_COMPLETE] = { "webshell_request_duration_seconds", "route=\"complete\"", NULL },
+    [METRIC_REQUEST_HISTORY] = { "webshell_request_duration_seconds", "route=\"history\"", NULL },
+    [METRIC_REQUEST_OTHER] = { "webshell_request_duration_seconds", "route=\"other\"", NULL },
+    [METRIC_SPAWN] = { "webshell_spawn_duration_seconds", NULL,
+                       "Time to start a pipeline, through the executor or in-process." },
+    [METRIC_COMMAND_WALL] = { "webshell_command_duration_seconds", NULL,
+                              "Wall time of commands run to completion, from launch to exit." },
+    [METRIC_COMMAND_CPU] = { "webshell_command_cpu_seconds", NULL,
+                             "User plus system time of those commands' stages." },
+};
+
+int64_t metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static struct shard *shard_get(void) {
+    if (own_shard) return own_shard;
+    struct shard *shard = calloc(1, sizeof(*shard));
+    if (!shard) abort();
+    shard->next = atomic_load(&shards);
+    while (!atomic_compare_exchange_weak(&shards, &shard->next, shard))
+        ;
+    return own_shard = shard;
+}
+
+static inline void bump(_Atomic uint64_t *value, uint64_t n) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Bucket of a value: exact below 8, then 8 per power of two
+static int bucket_index(uint64_t v) {
+    if (v < SUB_COUNT) return (int)v;
+    int exp = 63 - __builtin_clzll(v);
+    if (exp > MAX_EXP) return BUCKETS - 1;
+    return (exp - SUB_BITS + 1) * SUB_COUNT + (int)((v >> (exp - SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+void metrics_count(enum metric_counter counter, uint64_t n) {
+    bump(&shard_get()->counters[counter], n);
+}
+
+void metrics_observe(enum metric_histogram histogram, int64_t ns) {
+    struct histogram *h = &shard_get()->histograms[histogram];
+    if (ns < 0) ns = 0;
+    bump(&h->buckets[bucket_index(ns)], 1);
+    bump(&h->sum_ns, ns);
+}
+
+// ---------- EXPORT ----------
+
+void metrics_print(struct outbuf *out, const char *type, const char *name, const char *help, double value) {
+    outbuf_printf(out, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+}
+
+static void write_histogram(struct outbuf *out, int index) {
+    uint64_t buckets[BUCKETS] = { 0 }, sum_ns = 0;
+    for (struct shard *s = atomic_load(&shards); s; s = s->next) {
+        struct histogram *h = &s->histograms[index];
+        for (int i = 0; i < BUCKETS; i++)
+            buckets[i] += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        sum_ns += atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+    }
+
+    const char *name = histogram_info[index].name, *labels = histogram_info[index].labels;
+    if (histogram_info[index].help)
+        outbuf_printf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_info[index].help, name);
+
+    // Powers of two are bucket edges, so each bound's count is exact
+    uint64_t count = 0;
+    int next = 0;
+    for (int exp = EXPORT_MIN_EXP; exp <= EXPORT_MAX_EXP; exp++) {
+        int end = (exp - SUB_BITS + 1) * SUB_COUNT;   // first bucket at or above 2^exp
+        while (next < end) count += buckets[next++];
+        outbuf_printf(out, "%s_bucket{%s%sle=\"%.12g\"} %llu\n", name, labels ? labels : "", labels ? "," : "",
+                      (double)(1ULL << exp) / 1e9, (unsigned long long)count);
+    }
+    while (next < BUCKETS) count += buckets[next++];
+    outbuf_printf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels ? labels : "", labels ? "," : "",
+                  (unsigned long long)count);
+    outbuf_printf(out, "%s_sum%s%s%s %.9f\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+                  sum_ns / 1e9);
+    outbuf_printf(out, "%s_count%s%s%s %llu\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+                  (unsigned long long)count);
+}
+
+void metrics_write(struct outbuf *out) {
+    for (int i = 0; i < METRIC_COUNTERS; i++) {
+        uint64_t total = 0;
+        for (struct shard *s = atomic_load(&shards); s; s = s->next)
+            total += atomic_load_explicit(&s->counters[i], memory_order_relaxed);
+        const char *name = counter_info[i].name, *labels = counter_info[i].labels;
+        if (counter_info[i].help)
+            outbuf_printf(out, "# HELP %s %s\n# TYPE %s counter\n", name, counter_info[i].help, name);
+        outbuf_printf(out, "%s%s%s%s %llu\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+                      (unsigned long long)total);
+    }
+    for (int i = 0; i < METRIC_HISTOGRAMS; i++)
+        write_histogram(out, i);
+}
@@ -0,0 +1,57 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include "arena.h"
+
+// Counters and latency histograms for GET /metrics (Prometheus text format).
+// Each thread updates its own shard with plain stores, so recording costs a
+// few nanoseconds and never contends; a scrape sums the shards. Histograms
+// are log-linear like HdrHistogram: 8 buckets per power of two, so any
+// value is placed within 12.5%. Thread-safe.
+
+enum metric_counter {
+    METRIC_PIPE_BYTES,           // bytes read from command output pipes
+    METRIC_TRUNCATIONS,          // outputs cut off at the output limit
+    METRIC_SPAWN_FAILURES,       // pipelines that could not be started
+    METRIC_CONNECTIONS,          // client connections accepted
+    // Commands stopped early, by reason (shell_stop_reason())
+    METRIC_STOPS_TIMEOUT,
+    METRIC_STOPS_CPU,
+    METRIC_STOPS_FILE_SIZE,
+    METRIC_COUNTERS
+};
+
+enum metric_histogram {
+    // Request latency by route, from the request being complete to its
+    // response headers being queued (the first byte, for streamed output)
+    METRIC_REQUEST_STATIC,
+    METRIC_REQUEST_EXECUTE,
+    METRIC_REQUEST_STATUS,
+    METRIC_REQUEST_METRICS,
+    METRIC_REQUEST_JOBS,
+    METRIC_REQUEST_TERMINAL,
+    METRIC_REQUEST_BATCH,
+    METRIC_REQUEST_COMPLETE,
+    METRIC_REQUEST_HISTORY,
+    METRIC_REQUEST_OTHER,
+    METRIC_SPAWN,                // starting a pipeline: fork/exec or the executor round trip
+    METRIC_COMMAND_WALL,         // launch to exit of commands run to completion
+    METRIC_COMMAND_CPU,          // user + system time of their stages (wait4)
+    METRIC_HISTOGRAMS
+};
+
+// CLOCK_MONOTONIC in nanoseconds
+int64_t metrics_now(void);
+
+void metrics_count(enum metric_counter counter, uint64_t n);
+void metrics_observe(enum metric_histogram histogram, int64_t ns);
+
+// Append one value with its HELP and TYPE lines, for figures the caller
+// keeps itself (gauges such as queue depth)
+void metrics_print(struct outbuf *out, const char *type, const char *name, const char *help, double value);
+
+// Append every counter and histogram, summed over all threads
+void metrics_write(struct outbuf *out);
+
+#endif
@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "result_cache.h"
+#include "shell.h"
+
+#define CACHE_BUCKETS 1024           // power of two
+#define CACHE_DEFAULT_TTL 10.0       // seconds
+#define CACHE_DEFAULT_BYTES (16 << 20)
+#define CACHE_MAX_COMMANDS 64
+
+// One cached result. Stamps, key and output share the entry's allocation.
+struct cache_entry {
+    struct cache_entry *hash_next;
+    struct cache_entry *lru_prev, *lru_next;   // most recently used first
+    uint64_t hash;
+    long long expires_ns;
+    size_t size;                 // bytes charged against the budget
+    size_t key_len, output_len;
+    int stamp_count, code_count;
+    int codes[MAX_STAGES];
+    struct cache_stamp *stamps;
+    char *key, *output;
+    char data[];
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static struct cache_entry *buckets[CACHE_BUCKETS];
+static struct cache_entry lru = { .lru_prev = &lru, .lru_next = &lru };
+static struct result_cache_stats stats;
+
+// Configuration, read once from the environment
+static char *allowed[CACHE_MAX_COMMANDS];
+static int allowed_count;
+static long long ttl_ns;
+
+static void cache_init(void) {
+    const char *list = getenv("WEBSHELL_CACHE");
+    if (list) {
+        char *copy = strdup(list), *save = NULL;
+        for (char *name = strtok_r(copy, ", ", &save); name && allowed_count < CACHE_MAX_COMMANDS;
+             name = strtok_r(NULL, ", ", &save))
+            allowed[allowed_count++] = name;
+    }
+    const char *ttl = getenv("WEBSHELL_CACHE_TTL");
+    double seconds = ttl ? strtod(ttl, NULL) : CACHE_DEFAULT_TTL;
+    ttl_ns = (long long)((seconds > 0 ? seconds : 0) * 1e9);
+    const char *bytes = getenv("WEBSHELL_CACHE_BYTES");
+    stats.budget = bytes ? strtoull(bytes, NULL, 10) : CACHE_DEFAULT_BYTES;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t key_hash(const char *key, size_t len) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)key[i]) * 1099511628211ull;
+    return h;
+}
+
+int result_cache_allows(const char *command) {
+    pthread_once(&cache_once, cache_init);
+    for (int i = 0; i < allowed_count; i++)
+        if (strcmp(allowed[i], command) == 0) return 1;
+    return 0;
+}
+
+static struct cache_entry **entry_slot(uint64_t hash, const char *key, size_t key_len) {
+    struct cache_entry **slot = &buckets[hash & (CACHE_BUCKETS - 1)];
+    for (; *slot; slot = &(*slot)->hash_next)
+        if ((*slot)->hash == hash && (*slot)->key_len == key_len && memcmp((*slot)->key, key, key_len) == 0)
+            break;
+    return slot;
+}
+
+static void lru_unlink(struct cache_entry *entry) {
+    entry->lru_prev->lru_next = entry->lru_next;
+    entry->lru_next->lru_prev = entry->lru_prev;
+}
+
+static void lru_push(struct cache_entry *entry) {
+    entry->lru_next = lru.lru_next;
+    entry->lru_prev = &lru;
+    lru.lru_next->lru_prev = entry;
+    lru.lru_next = entry;
+}
+
+// Unlink and free the entry in *slot
+static void entry_remove(struct cache_entry **slot) {
+    struct cache_entry *entry = *slot;
+    *slot = entry->hash_next;
+    lru_unlink(entry);
+    stats.bytes -= entry->size;
+    stats.entries--;
+    free(entry);
+}
+
+int result_cache_get(const char *key, size_t key_len, const struct cache_stamp *stamps, int stamp_count,
+                     struct outbuf *out, int *codes, int *code_count) {
+    pthread_once(&cache_once, cache_init);
+    uint64_t hash = key_hash(key, key_len);
+    pthread_mutex_lock(&cache_lock);
+    struct cache_entry **slot = entry_slot(hash, key, key_len);
+    struct cache_entry *entry = *slot;
+    if (entry && (now_ns() > entry->expires_ns || entry->stamp_count != stamp_count ||
+                  memcmp(entry->stamps, stamps, stamp_count * sizeof(*stamps)) != 0)) {
+        entry_remove(slot);
+        entry = NULL;
+        stats.stale++;
+    }
+    if (!entry) {
+        stats.misses++;
+        pthread_mutex_unlock(&cache_lock);
+        return 0;
+    }
+
+    lru_unlink(entry);
+    lru_push(entry);
+    outbuf_append(out, entry->output, entry->output_len);
+    memcpy(codes, entry->codes, entry->code_count * sizeof(int));
+    *code_count = entry->code_count;
+    stats.hits++;
+    pthread_mutex_unlock(&cache_lock);
+    return 1;
+}
+
+void result_cache_put(const char *key, size_t key_len, const struct cache_stamp *stamps, int stamp_count,
+                      const char *output, size_t output_len, const int *codes, int code_count) {
+    pthread_once(&cache_once, cache_init);
+    size_t size = sizeof(struct cache_entry) + stamp_count * sizeof(*stamps) + key_len + output_len;
+    // One result may not take more than a quarter of the cache
+    if (ttl_ns == 0 || size > stats.budget / 4 || code_count > MAX_STAGES) return;
+
+    struct cache_entry *entry = malloc(size);
+    if (!entry) return;
+    entry->hash = key_hash(key, key_len);
+    entry->expires_ns = now_ns() + ttl_ns;
+    entry->size = size;
+    entry->key_len = key_len;
+    entry->output_len = output_len;
+    entry->stamp_count = stamp_count;
+    entry->code_count = code_count;
+    memcpy(entry->codes, codes, code_count * sizeof(int));
+    entry->stamps = (struct cache_stamp *)entry->data;
+    entry->key = entry->data + stamp_count * sizeof(*stamps);
+    entry->output = entry->key + key_len;
+    memcpy(entry->stamps, stamps, stamp_count * sizeof(*stamps));
+    memcpy(entry->key, key, key_len);
+    memcpy(entry->output, output, output_len);
+
+    pthread_mutex_lock(&cache_lock);
+    struct cache_entry **slot = entry_slot(entry->hash, key, key_len);
+    if (*slot) entry_remove(slot);
+    while (stats.bytes + size > stats.budget && lru.lru_prev != &lru) {
+        struct cache_entry *victim = lru.lru_prev;
+        entry_remove(entry_slot(victim->hash, victim->key, victim->key_len));
+        stats.evictions++;
+    }
+    slot = entry_slot(entry->hash, key, key_len);
+    entry->hash_next = NULL;
+    *slot = entry;
+    lru_push(entry);
+    stats.bytes += size;
+    stats.entries++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void result_cache_stats(struct result_cache_stats *out) {
+    pthread_once(&cache_once, cache_init);
+    pthread_mutex_lock(&cache_lock);
+    *out = stats;
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,45 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "arena.h"
+
+// Output cache for read-only commands that dashboards poll (ls -l, df, du,
+// ...). Off unless WEBSHELL_CACHE lists the commands that may be cached,
+// e.g. WEBSHELL_CACHE=ls,df,du,uptime. An entry lives WEBSHELL_CACHE_TTL
+// seconds (default 10) and the least recently used ones are evicted to keep
+// the total under WEBSHELL_CACHE_BYTES (default 16 MB). Thread-safe.
+
+// Identity of a file an entry depends on; any change invalidates the entry.
+// All zero when the path did not exist.
+struct cache_stamp {
+    dev_t dev;
+    ino_t ino;
+    long long mtime_ns, ctime_ns;
+    off_t size;
+};
+
+struct result_cache_stats {
+    unsigned long hits, misses;
+    unsigned long stale;         // misses on an entry that had expired or changed
+    unsigned long evictions;     // entries dropped to stay under the budget
+    size_t bytes, budget;
+    int entries;
+};
+
+// Whether command (argv[0]) is on the allowlist; always 0 when disabled
+int result_cache_allows(const char *command);
+
+// Append the cached output for key to out and copy its exit statuses to
+// codes. Returns 0 on a miss, including an entry whose stamps no longer match.
+int result_cache_get(const char *key, size_t key_len, const struct cache_stamp *stamps, int stamp_count,
+                     struct outbuf *out, int *codes, int *code_count);
+
+// Remember a command's output and exit statuses under key
+void result_cache_put(const char *key, size_t key_len, const struct cache_stamp *stamps, int stamp_count,
+                      const char *output, size_t output_len, const int *codes, int code_count);
+
+void result_cache_stats(struct result_cache_stats *stats);
+
+#endif
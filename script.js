@@ -9,17 +9,25 @@ const clearBtn = document.getElementById("clearBtn");
 const downloadBtn = document.getElementById("downloadBtn");
 const themeToggle = document.getElementById("themeToggle");
 
-let commandHistory = JSON.parse(localStorage.getItem("commandHistory") || "[]");
-let historyIndex = commandHistory.length;
+// History lives on the server, per session, and survives restarts
+let commandHistory = [];
+let historyIndex = 0;
 let logBuffer = "";
 
+fetch("/history")
+  .then((response) => (response.ok ? response.json() : { history: [] }))
+  .then((data) => {
+    commandHistory = data.history.concat(commandHistory);
+    historyIndex = commandHistory.length;
+  })
+  .catch(() => {});
+
 // ===== EVENT LISTENERS =====
 commandInput.addEventListener("keydown", async (e) => {
   if (e.key === "Enter") {
     const command = commandInput.value.trim();
     if (command) {
       commandHistory.push(command);
-      localStorage.setItem("commandHistory", JSON.stringify(commandHistory));
       historyIndex = commandHistory.length;
 
       displayCommand(command);
@@ -41,6 +49,9 @@ commandInput.addEventListener("keydown", async (e) => {
       historyIndex = commandHistory.length;
       commandInput.value = "";
     }
+  } else if (e.key === "Tab") {
+    e.preventDefault();
+    await completeCommand();
   } else if (e.key === "l" && e.ctrlKey) {
     e.preventDefault();
     clearTerminal();
@@ -60,11 +71,21 @@ function displayCommand(command) {
 }
 
 function displayOutput(text, isError = false) {
+  const outputLine = createOutputLine(isError);
+  appendOutput(outputLine, text);
+  logBuffer += "\n";
+}
+
+function createOutputLine(isError = false) {
   const outputLine = document.createElement("div");
   outputLine.className = isError ? "output error" : "output";
-  outputLine.textContent = text;
   output.appendChild(outputLine);
-  logBuffer += text + "\n";
+  return outputLine;
+}
+
+function appendOutput(outputLine, text) {
+  outputLine.textContent += text;
+  logBuffer += text;
   scrollToBottom();
 }
 
@@ -75,13 +96,17 @@ async function executeCommand(command) {
     clearTerminal();
     return;
   }
+  if (command === "terminal") {
+    openTerminal();
+    return;
+  }
 
-  // Send command to backend
+  // Send command to backend; output streams back while the command runs
   try {
     const response = await fetch("/execute", {
       method: "POST",
       headers: { "Content-Type": "application/x-www-form-urlencoded" },
-      body: `command=${encodeURIComponent(command)}`,
+      body: `command=${encodeURIComponent(command)}&stream=1`,
     });
 
     if (!response.ok) {
@@ -89,13 +114,75 @@ async function executeCommand(command) {
       return;
     }
 
-    const data = await response.json();
-    if (data.output) displayOutput(data.output.trim());
+    // Render each chunk as soon as it arrives
+    const outputLine = createOutputLine();
+    const reader = response.body.getReader();
+    const decoder = new TextDecoder();
+    while (true) {
+      const { done, value } = await reader.read();
+      if (done) break;
+      appendOutput(outputLine, decoder.decode(value, { stream: true }));
+    }
+    appendOutput(outputLine, decoder.decode());
+
+    // Match the old trimmed display: drop the trailing newline, hide empty output
+    outputLine.textContent = outputLine.textContent.replace(/\s+$/, "");
+    if (!outputLine.textContent) outputLine.remove();
+    logBuffer += "\n";
   } catch (error) {
     displayOutput(`Error: ${error.message}`, true);
   }
 }
 
+// ===== TAB COMPLETION =====
+function commonPrefix(words) {
+  let prefix = words[0];
+  for (const word of words) {
+    while (!word.startsWith(prefix)) prefix = prefix.slice(0, -1);
+  }
+  return prefix;
+}
+
+// Complete the word before the cursor: a single match is filled in, several
+// are extended to what they share or else listed, along with earlier
+// commands that start with the same text
+async function completeCommand() {
+  const cursor = commandInput.selectionStart;
+  const line = commandInput.value.slice(0, cursor);
+  let result;
+  try {
+    const response = await fetch(`/complete?line=${encodeURIComponent(line)}`);
+    if (!response.ok) return;
+    result = await response.json();
+  } catch (error) {
+    return;
+  }
+  // Typing went on while the request was out
+  if (commandInput.value.slice(0, commandInput.selectionStart) !== line) return;
+
+  const rest = commandInput.value.slice(cursor);
+  let word = line.slice(result.start);
+  if (result.matches.length === 1) {
+    word = result.matches[0];
+    if (!word.endsWith("/")) word += " ";
+  } else if (result.matches.length > 1) {
+    word = commonPrefix(result.matches);
+  }
+  if (word !== line.slice(result.start)) {
+    commandInput.value = line.slice(0, result.start) + word + rest;
+    const end = result.start + word.length;
+    commandInput.setSelectionRange(end, end);
+    return;
+  }
+
+  const candidates = result.matches.map((match) =>
+    result.kind === "file" ? match.slice(match.lastIndexOf("/", match.length - 2) + 1) : match
+  );
+  if (result.more) candidates.push("…");
+  if (candidates.length > 0) displayOutput(candidates.join("  "));
+  if (result.history.length > 0) displayOutput(result.history.map((command) => `↑ ${command}`).join("\n"));
+}
+
 // ===== UTILITIES =====
 function clearTerminal() {
   output.innerHTML =
@@ -118,6 +205,507 @@ function escapeHtml(text) {
   return text.replace(/[&<>"']/g, (m) => map[m]);
 }
 
+// ===== INTERACTIVE TERMINAL =====
+// `terminal` swaps the line prompt for a real shell on a pseudo-terminal,
+// reached over a WebSocket (GET /terminal), for programs that need one: vim,
+// top, less, ssh. Keys go out as the bytes a terminal sends; the output is
+// run through the small VT100/xterm screen model below and drawn into a
+// <pre> at most once per animation frame. Closing the shell brings the line
+// prompt back.
+
+// Cell attributes packed in one number: foreground and background colour
+// (0-255, 256 = default) and three flags
+const ATTR_DEFAULT = 256 | (256 << 9);
+const ATTR_BOLD = 1 << 18;
+const ATTR_UNDERLINE = 1 << 19;
+const ATTR_INVERSE = 1 << 20;
+
+const PALETTE = (() => {
+  const base = [
+    "#0d1117", "#ff5555", "#50fa7b", "#f1fa8c", "#6272ff", "#ff79c6", "#00d4ff", "#e6edf3",
+    "#6e7681", "#ff6e6e", "#69ff94", "#ffffa5", "#8b9bff", "#ff92df", "#00ffcc", "#ffffff",
+  ];
+  const colors = base.slice();
+  const level = [0, 95, 135, 175, 215, 255];
+  for (let i = 0; i < 216; i++)
+    colors.push(`rgb(${level[Math.floor(i / 36)]},${level[Math.floor(i / 6) % 6]},${level[i % 6]})`);
+  for (let i = 0; i < 24; i++) colors.push(`rgb(${8 + i * 10},${8 + i * 10},${8 + i * 10})`);
+  return colors;
+})();
+
+class Screen {
+  constructor(cols, rows, reply) {
+    this.reply = reply;          // answers to status queries go back to the shell
+    this.scrolledOff = [];       // lines that left the top of the main screen, as HTML
+    this.reset(cols, rows);
+  }
+
+  reset(cols, rows) {
+    this.cols = cols;
+    this.rows = rows;
+    this.attr = ATTR_DEFAULT;
+    this.lines = this.blankLines(rows);
+    this.other = null;           // the main screen while the alternate one is shown
+    this.x = this.y = 0;
+    this.top = 0;
+    this.bottom = rows - 1;
+    this.saved = { x: 0, y: 0, attr: ATTR_DEFAULT };
+    this.wrapPending = false;
+    this.cursorVisible = true;
+    this.appCursor = false;
+    this.state = "ground";
+    this.params = "";
+  }
+
+  blankLine() {
+    return Array.from({ length: this.cols }, () => [" ", this.attr & ~(ATTR_BOLD | ATTR_UNDERLINE)]);
+  }
+
+  blankLines(n) {
+    return Array.from({ length: n }, () => this.blankLine());
+  }
+
+  resize(cols, rows) {
+    const fit = (line) => {
+      line = line.slice(0, cols);
+      while (line.length < cols) line.push([" ", ATTR_DEFAULT]);
+      return line;
+    };
+    for (const screen of [this, this.other]) {
+      if (!screen) continue;
+      let lines = screen.lines.map(fit);
+      // Shrinking drops lines from the top, keeping the cursor's in view
+      while (lines.length > rows && screen === this && this.y > 0) {
+        if (!this.other) this.scrolledOff.push(this.lineHtml(lines[0]));
+        lines.shift();
+        this.y--;
+      }
+      lines = lines.slice(0, rows);
+      while (lines.length < rows) lines.push(fit([]));
+      screen.lines = lines;
+    }
+    this.cols = cols;
+    this.rows = rows;
+    this.top = 0;
+    this.bottom = rows - 1;
+    this.x = Math.min(this.x, cols - 1);
+    this.y = Math.min(this.y, rows - 1);
+  }
+
+  // Scroll the region up by n lines; the main screen keeps what leaves the top
+  scrollUp(n = 1) {
+    for (let i = 0; i < n; i++) {
+      const [gone] = this.lines.splice(this.top, 1);
+      if (this.top === 0 && !this.other) this.scrolledOff.push(this.lineHtml(gone));
+      this.lines.splice(this.bottom, 0, this.blankLine());
+    }
+  }
+
+  scrollDown(n = 1) {
+    for (let i = 0; i < n; i++) {
+      this.lines.splice(this.bottom, 1);
+      this.lines.splice(this.top, 0, this.blankLine());
+    }
+  }
+
+  lineFeed() {
+    if (this.y === this.bottom) this.scrollUp();
+    else if (this.y < this.rows - 1) this.y++;
+  }
+
+  put(ch) {
+    if (this.wrapPending) {
+      this.x = 0;
+      this.lineFeed();
+      this.wrapPending = false;
+    }
+    this.lines[this.y][this.x] = [ch, this.attr];
+    if (this.x === this.cols - 1) this.wrapPending = true;
+    else this.x++;
+  }
+
+  moveTo(x, y) {
+    this.x = Math.max(0, Math.min(this.cols - 1, x));
+    this.y = Math.max(0, Math.min(this.rows - 1, y));
+    this.wrapPending = false;
+  }
+
+  // Blank cells [from, to) of line y
+  erase(y, from, to) {
+    const line = this.lines[y];
+    for (let x = from; x < to; x++) line[x] = [" ", this.attr & ~(ATTR_BOLD | ATTR_UNDERLINE)];
+  }
+
+  write(text) {
+    for (const ch of text) {
+      const code = ch.codePointAt(0);
+      switch (this.state) {
+        case "ground":
+          if (code >= 32 && code !== 127) this.put(ch);
+          else this.control(code);
+          break;
+        case "escape":
+          this.escape(ch);
+          break;
+        case "charset":          // ESC ( B and friends: one character, ignored
+          this.state = "ground";
+          break;
+        case "csi":
+          if (code >= 0x40 && code <= 0x7e) {
+            this.state = "ground";
+            this.csi(ch, this.params);
+          } else if (code < 32) {
+            this.control(code);
+          } else {
+            this.params += ch;
+          }
+          break;
+        case "osc":              // window titles and the like, up to BEL or ST
+          if (code === 7) this.state = "ground";
+          else if (code === 27) this.state = "osc-escape";
+          break;
+        case "osc-escape":
+          this.state = ch === "\\" ? "ground" : "osc";
+          break;
+      }
+    }
+  }
+
+  control(code) {
+    switch (code) {
+      case 8: if (this.x > 0) this.moveTo(this.x - 1, this.y); break;
+      case 9: this.moveTo((Math.floor(this.x / 8) + 1) * 8, this.y); break;
+      case 10: case 11: case 12: this.lineFeed(); this.wrapPending = false; break;
+      case 13: this.moveTo(0, this.y); break;
+      case 27: this.state = "escape"; break;
+    }
+  }
+
+  escape(ch) {
+    this.state = "ground";
+    switch (ch) {
+      case "[": this.state = "csi"; this.params = ""; break;
+      case "]": this.state = "osc"; break;
+      case "(": case ")": case "*": case "+": this.state = "charset"; break;
+      case "7": this.saved = { x: this.x, y: this.y, attr: this.attr }; break;
+      case "8": this.moveTo(this.saved.x, this.saved.y); this.attr = this.saved.attr; break;
+      case "D": this.lineFeed(); break;
+      case "E": this.moveTo(0, this.y); this.lineFeed(); break;
+      case "M":
+        if (this.y === this.top) this.scrollDown();
+        else this.moveTo(this.x, this.y - 1);
+        break;
+      case "c": this.reset(this.cols, this.rows); break;
+    }
+  }
+
+  csi(final, raw) {
+    const priv = raw.startsWith("?");
+    const args = (priv ? raw.slice(1) : raw).split(";").map((p) => parseInt(p, 10));
+    const n = (i, fallback = 1) => (Number.isNaN(args[i]) || args[i] === undefined || args[i] === 0 ? fallback : args[i]);
+    const { x, y } = this;
+    switch (final) {
+      case "A": this.moveTo(x, Math.max(y - n(0), y >= this.top ? this.top : 0)); break;
+      case "B": this.moveTo(x, Math.min(y + n(0), y <= this.bottom ? this.bottom : this.rows - 1)); break;
+      case "C": this.moveTo(x + n(0), y); break;
+      case "D": this.moveTo(x - n(0), y); break;
+      case "E": this.moveTo(0, y + n(0)); break;
+      case "F": this.moveTo(0, y - n(0)); break;
+      case "G": case "`": this.moveTo(n(0) - 1, y); break;
+      case "d": this.moveTo(x, n(0) - 1); break;
+      case "H": case "f": this.moveTo(n(1) - 1, n(0) - 1); break;
+      case "J":
+        if (n(0, 0) === 0) {
+          this.erase(y, x, this.cols);
+          for (let i = y + 1; i < this.rows; i++) this.erase(i, 0, this.cols);
+        } else if (n(0, 0) === 1) {
+          for (let i = 0; i < y; i++) this.erase(i, 0, this.cols);
+          this.erase(y, 0, x + 1);
+        } else {
+          for (let i = 0; i < this.rows; i++) this.erase(i, 0, this.cols);
+        }
+        break;
+      case "K": {
+        const mode = n(0, 0);
+        this.erase(y, mode === 0 ? x : 0, mode === 1 ? x + 1 : this.cols);
+        break;
+      }
+      case "L": case "M":
+        if (y >= this.top && y <= this.bottom) {
+          const top = this.top;
+          this.top = y;
+          if (final === "L") this.scrollDown(Math.min(n(0), this.bottom - y + 1));
+          else this.scrollUpInPlace(Math.min(n(0), this.bottom - y + 1));
+          this.top = top;
+          this.moveTo(0, y);
+        }
+        break;
+      case "@": {
+        const line = this.lines[y];
+        const count = Math.min(n(0), this.cols - x);
+        line.splice(x, 0, ...Array.from({ length: count }, () => [" ", this.attr]));
+        line.length = this.cols;
+        break;
+      }
+      case "P": {
+        const line = this.lines[y];
+        const count = Math.min(n(0), this.cols - x);
+        line.splice(x, count);
+        while (line.length < this.cols) line.push([" ", this.attr]);
+        break;
+      }
+      case "X": this.erase(y, x, Math.min(this.cols, x + n(0))); break;
+      case "S": this.scrollUpInPlace(n(0)); break;
+      case "T": this.scrollDown(n(0)); break;
+      case "m": this.sgr(args); break;
+      case "r":
+        this.top = n(0) - 1;
+        this.bottom = Math.min(n(1, this.rows), this.rows) - 1;
+        if (this.top >= this.bottom) { this.top = 0; this.bottom = this.rows - 1; }
+        this.moveTo(0, 0);
+        break;
+      case "s": this.saved = { x, y, attr: this.attr }; break;
+      case "u": this.moveTo(this.saved.x, this.saved.y); break;
+      case "h": case "l":
+        if (priv) for (const mode of args) this.setMode(mode, final === "h");
+        break;
+      case "n":
+        if (n(0, 0) === 6) this.reply(`\x1b[${y + 1};${x + 1}R`);
+        else if (n(0, 0) === 5) this.reply("\x1b[0n");
+        break;
+      case "c":
+        if (!priv && !raw.startsWith(">")) this.reply("\x1b[?1;2c");
+        break;
+    }
+  }
+
+  // Like scrollUp(), but nothing is kept: the lines leave a region, not the screen
+  scrollUpInPlace(n) {
+    for (let i = 0; i < n; i++) {
+      this.lines.splice(this.top, 1);
+      this.lines.splice(this.bottom, 0, this.blankLine());
+    }
+  }
+
+  setMode(mode, on) {
+    if (mode === 1) this.appCursor = on;
+    else if (mode === 25) this.cursorVisible = on;
+    else if ((mode === 1049 || mode === 1047 || mode === 47) && on !== !!this.other) {
+      if (on) {
+        if (mode === 1049) this.saved = { x: this.x, y: this.y, attr: this.attr };
+        this.other = { lines: this.lines };
+        this.lines = this.blankLines(this.rows);
+      } else {
+        this.lines = this.other.lines;
+        this.other = null;
+        if (mode === 1049) this.moveTo(this.saved.x, this.saved.y);
+      }
+    }
+  }
+
+  sgr(args) {
+    let fg = this.attr & 511, bg = (this.attr >> 9) & 511, flags = this.attr & ~((1 << 18) - 1);
+    for (let i = 0; i < args.length; i++) {
+      const a = Number.isNaN(args[i]) ? 0 : args[i];
+      if (a === 0) { fg = 256; bg = 256; flags = 0; }
+      else if (a === 1) flags |= ATTR_BOLD;
+      else if (a === 4) flags |= ATTR_UNDERLINE;
+      else if (a === 7) flags |= ATTR_INVERSE;
+      else if (a === 22) flags &= ~ATTR_BOLD;
+      else if (a === 24) flags &= ~ATTR_UNDERLINE;
+      else if (a === 27) flags &= ~ATTR_INVERSE;
+      else if (a >= 30 && a <= 37) fg = a - 30;
+      else if (a === 39) fg = 256;
+      else if (a >= 40 && a <= 47) bg = a - 40;
+      else if (a === 49) bg = 256;
+      else if (a >= 90 && a <= 97) fg = a - 90 + 8;
+      else if (a >= 100 && a <= 107) bg = a - 100 + 8;
+      else if (a === 38 || a === 48) {
+        // 256 colours (5;n) or true colour (2;r;g;b), the latter mapped onto the 6x6x6 cube
+        let color = 256;
+        if (args[i + 1] === 5) { color = args[i + 2] & 255; i += 2; }
+        else if (args[i + 1] === 2) {
+          const cube = (v) => (v < 48 ? 0 : v < 115 ? 1 : Math.floor((v - 35) / 40));
+          color = 16 + 36 * cube(args[i + 2]) + 6 * cube(args[i + 3]) + cube(args[i + 4]);
+          i += 4;
+        }
+        if (a === 38) fg = color;
+        else bg = color;
+      }
+    }
+    this.attr = fg | (bg << 9) | flags;
+  }
+
+  lineHtml(line, cursorX = -1) {
+    let html = "";
+    let run = "", runAttr = null;
+    const flush = () => {
+      if (!run) return;
+      html += runAttr === ATTR_DEFAULT ? run : `<span style="${attrStyle(runAttr)}">${run}</span>`;
+      run = "";
+    };
+    for (let x = 0; x < line.length; x++) {
+      let [ch, attr] = line[x];
+      if (x === cursorX) attr ^= ATTR_INVERSE;
+      if (attr !== runAttr) { flush(); runAttr = attr; }
+      run += ch === "<" ? "&lt;" : ch === ">" ? "&gt;" : ch === "&" ? "&amp;" : ch;
+    }
+    flush();
+    return html.replace(/\s+$/, "");
+  }
+
+  html() {
+    return this.lines
+      .map((line, y) => this.lineHtml(line, this.cursorVisible && y === this.y ? this.x : -1))
+      .join("\n");
+  }
+}
+
+function attrStyle(attr) {
+  let fg = attr & 511, bg = (attr >> 9) & 511;
+  if (attr & ATTR_BOLD && fg < 8) fg += 8;
+  let style = "";
+  if (attr & ATTR_INVERSE) {
+    style += `color:${bg === 256 ? "#0d1117" : PALETTE[bg]};`;
+    style += `background:${fg === 256 ? "var(--text-light)" : PALETTE[fg]};`;
+  } else {
+    if (fg !== 256) style += `color:${PALETTE[fg]};`;
+    if (bg !== 256) style += `background:${PALETTE[bg]};`;
+  }
+  if (attr & ATTR_BOLD) style += "font-weight:600;";
+  if (attr & ATTR_UNDERLINE) style += "text-decoration:underline;";
+  return style;
+}
+
+// Bytes a terminal sends for keys that are not plain characters
+const KEY_SEQUENCES = {
+  Enter: "\r", Backspace: "\x7f", Tab: "\t", Escape: "\x1b",
+  Home: "\x1b[H", End: "\x1b[F", Insert: "\x1b[2~", Delete: "\x1b[3~", PageUp: "\x1b[5~", PageDown: "\x1b[6~",
+  F1: "\x1bOP", F2: "\x1bOQ", F3: "\x1bOR", F4: "\x1bOS", F5: "\x1b[15~", F6: "\x1b[17~",
+  F7: "\x1b[18~", F8: "\x1b[19~", F9: "\x1b[20~", F10: "\x1b[21~", F11: "\x1b[23~", F12: "\x1b[24~",
+};
+const ARROWS = { ArrowUp: "A", ArrowDown: "B", ArrowRight: "C", ArrowLeft: "D" };
+
+let tty = null;                  // the open terminal session, if any
+
+function keyBytes(e, screen) {
+  if (ARROWS[e.key]) return (screen.appCursor ? "\x1bO" : "\x1b[") + ARROWS[e.key];
+  if (e.key === "Tab" && e.shiftKey) return "\x1b[Z";
+  if (KEY_SEQUENCES[e.key]) return KEY_SEQUENCES[e.key];
+  if (e.key.length !== 1) return null;
+  if (e.ctrlKey && !e.altKey) {
+    const code = e.key.toUpperCase().charCodeAt(0);
+    if (code >= 64 && code <= 95) return String.fromCharCode(code - 64);
+    if (e.key === " ") return "\0";
+    return null;
+  }
+  return e.altKey ? "\x1b" + e.key : e.key;
+}
+
+// Character cell size of the terminal font, for fitting cols x rows into the output area
+function cellSize(pre) {
+  const probe = document.createElement("span");
+  probe.textContent = "MMMMMMMMMM";
+  pre.appendChild(probe);
+  const rect = probe.getBoundingClientRect();
+  probe.remove();
+  return { width: rect.width / 10 || 9, height: rect.height || 18 };
+}
+
+function terminalSize(pre) {
+  const cell = cellSize(pre);
+  const style = getComputedStyle(output);
+  const width = output.clientWidth - parseFloat(style.paddingLeft) - parseFloat(style.paddingRight);
+  const height = output.clientHeight - parseFloat(style.paddingTop) - parseFloat(style.paddingBottom);
+  return {
+    cols: Math.max(20, Math.floor(width / cell.width)),
+    rows: Math.max(5, Math.floor(height / cell.height)),
+  };
+}
+
+function openTerminal() {
+  const inputLine = document.querySelector(".input-line");
+  const history = document.createElement("pre");
+  const pre = document.createElement("pre");
+  history.className = "tty tty-history";
+  pre.className = "tty";
+  output.innerHTML = "";
+  output.appendChild(history);
+  output.appendChild(pre);
+  output.classList.add("tty-mode");
+  inputLine.style.display = "none";
+
+  const { cols, rows } = terminalSize(pre);
+  const scheme = location.protocol === "https:" ? "wss" : "ws";
+  const ws = new WebSocket(`${scheme}://${location.host}/terminal?cols=${cols}&rows=${rows}`);
+  ws.binaryType = "arraybuffer";
+  const encoder = new TextEncoder();
+  const decoder = new TextDecoder();
+  const send = (text) => {
+    if (ws.readyState === WebSocket.OPEN) ws.send(encoder.encode(text));
+  };
+  const screen = new Screen(cols, rows, send);
+
+  let frame = 0;
+  const render = () => {
+    frame = 0;
+    if (screen.scrolledOff.length) {
+      history.insertAdjacentHTML("beforeend", screen.scrolledOff.join("\n") + "\n");
+      screen.scrolledOff = [];
+      // Keep a bounded scrollback: drop old text once it gets long
+      if (history.innerHTML.length > 2000000) history.innerHTML = history.innerHTML.slice(-1000000);
+    }
+    pre.innerHTML = screen.html();
+    scrollToBottom();
+  };
+  const schedule = () => {
+    if (!frame) frame = requestAnimationFrame(render);
+  };
+
+  const onKey = (e) => {
+    // Leave the browser its copy and paste shortcuts
+    if (e.ctrlKey && e.shiftKey) return;
+    const bytes = keyBytes(e, screen);
+    if (bytes === null) return;
+    e.preventDefault();
+    send(bytes);
+  };
+  const onPaste = (e) => {
+    e.preventDefault();
+    send(e.clipboardData.getData("text").replace(/\r?\n/g, "\r"));
+  };
+  const onResize = () => {
+    const size = terminalSize(pre);
+    if (size.cols === screen.cols && size.rows === screen.rows) return;
+    screen.resize(size.cols, size.rows);
+    if (ws.readyState === WebSocket.OPEN) ws.send(`resize ${size.cols} ${size.rows}`);
+    schedule();
+  };
+
+  ws.onmessage = (e) => {
+    screen.write(decoder.decode(new Uint8Array(e.data), { stream: true }));
+    schedule();
+  };
+  ws.onclose = () => {
+    document.removeEventListener("keydown", onKey);
+    document.removeEventListener("paste", onPaste);
+    window.removeEventListener("resize", onResize);
+    screen.write(decoder.decode());
+    render();
+    tty = null;
+    output.classList.remove("tty-mode");
+    inputLine.style.display = "";
+    displayOutput("[terminal closed]");
+    commandInput.focus();
+  };
+
+  document.addEventListener("keydown", onKey);
+  document.addEventListener("paste", onPaste);
+  window.addEventListener("resize", onResize);
+  commandInput.blur();
+  tty = { ws, screen };
+}
+
 // ===== BUTTON ACTIONS =====
 clearBtn.addEventListener("click", clearTerminal);
 
@@ -1,154 +1,1996 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <stddef.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
-#include <ctype.h>
+#include "shell.h"
+#include "result_cache.h"
+#include "escape.h"
+#include "http.h"
+#include "session.h"
+#include "metrics.h"
+#include "websocket.h"
+#include "json.h"
 
 #define PORT 5000
-#define BUFFER_SIZE 8192
-#define MAX_OUTPUT 4096
-#define MAX_COMMAND_LENGTH 1024
-
-// Function from shell.c
-extern int execute_shell_command(char *input, char *output, size_t output_size);
-
-// Escape special characters for safe JSON output
-void json_escape(char *dst, const char *src, size_t dst_size) {
-    size_t j = 0;
-    for (size_t i = 0; src[i] != '\0' && j < dst_size - 2; i++) {
-        switch (src[i]) {
-            case '"':  dst[j++] = '\\'; dst[j++] = '"'; break;
-            case '\\': dst[j++] = '\\'; dst[j++] = '\\'; break;
-            case '\n': dst[j++] = '\\'; dst[j++] = 'n'; break;
-            case '\r': dst[j++] = '\\'; dst[j++] = 'r'; break;
-            case '\t': dst[j++] = '\\'; dst[j++] = 't'; break;
-            default:   dst[j++] = src[i]; break;
-        }
-    }
-    dst[j] = '\0';
-}
-
-// Decode URL-encoded form data (e.g., %20 → space)
-void url_decode(char *dst, const char *src) {
-    char a, b;
-    while (*src) {
-        if ((*src == '%') && ((a = src[1]) && (b = src[2])) && (isxdigit(a) && isxdigit(b))) {
-            a = (a >= 'a') ? a - 'a' + 10 : (a >= 'A') ? a - 'A' + 10 : a - '0';
-            b = (b >= 'a') ? b - 'a' + 10 : (b >= 'A') ? b - 'A' + 10 : b - '0';
-            *dst++ = 16 * a + b;
-            src += 3;
-        } else if (*src == '+') {
-            *dst++ = ' ';
-            src++;
+#define BUFFER_SIZE 8192        // initial input buffer; also the limit on request line + headers
+#define MAX_EVENTS 64
+#define JOB_QUEUE_SIZE 256      // power of two; max commands queued or running
+#define MAX_SEGMENTS 16         // pieces of pending output per connection
+#define ASSET_INLINE_MAX (256 * 1024)   // larger assets stay on disk and go out via sendfile()
+#define STREAM_CHUNK 16384                 // bytes read from a command's pipe per event
+#define STREAM_HIGH_WATER (64 * 1024)      // stop reading the pipe while this much is unsent
+#define OUTPUT_LIMIT (64 * 1024 * 1024)     // default cap on one command's output
+#define BODY_LIMIT (1024 * 1024)           // default cap on a request body
+#define BODY_CHUNKED ((size_t)-1)          // queue_headers(): body follows in chunked encoding
+#define TERMINAL_FRAME_MAX (64 * 1024)     // largest WebSocket frame payload taken from a client
+#define TERMINAL_READ (64 * 1024)          // terminal output gathered into one frame
+#define BATCH_MAX 64                       // commands in one POST /execute_batch
+#define SESSION_COOKIE "webshell_session"
+
+// What an epoll registration points at
+enum watch_kind { WATCH_LISTENER, WATCH_COMPLETIONS, WATCH_ASSETS, WATCH_CLIENT, WATCH_PIPE, WATCH_REAPER };
+
+struct watch {
+    enum watch_kind kind;
+    int fd;
+};
+
+enum conn_state { CONN_READING, CONN_EXECUTING, CONN_STREAMING, CONN_WRITING, CONN_TERMINAL };
+
+// Immutable, reference-counted bytes that responses can point at instead of
+// copying: either a memory buffer or an open file sent with sendfile().
+// Only the event loop touches the count.
+struct blob {
+    int refs;
+    int fd;                      // >= 0: contents live in this file
+    size_t len;
+    char *data;                  // used when fd < 0
+};
+
+// One piece of pending output. Owned bytes live in conn->out (which may move
+// when it grows, hence the offset); borrowed bytes belong to a blob or to the
+// connection's arena, which is only reset once they have been sent.
+struct out_segment {
+    struct blob *blob;           // NULL: bytes are in base, or conn->out if base is NULL
+    const char *base;
+    size_t offset;
+    size_t len;
+};
+
+// One keep-alive client connection
+struct connection {
+    struct watch watch;          // must stay first: epoll data.ptr points here
+    enum conn_state state;
+    int keep_alive;              // keep the socket open after the current response
+    int closing;                 // peer went away while a command was running
+    int peer_eof;                // peer finished sending; close once answered
+    int dead;                    // closed; freed once the current epoll batch is done
+    struct connection *next_dead;
+    char *in;                    // received bytes; grows past BUFFER_SIZE only for large bodies
+    size_t in_len, in_cap;
+    struct http_request req;     // parse state of the request at the front of in
+    int continue_sent;           // answered Expect: 100-continue for that request
+    char set_cookie[SESSION_ID_LEN + 1];   // id of a new session, sent with the next response
+    int clear_cookie;            // the session ended: expire the cookie with the next response
+    enum metric_histogram route; // request latency histogram of the current request
+    int64_t request_ns;          // when it was complete; 0 once its response has started
+    char *out;                   // owned output bytes (headers, small bodies)
+    size_t out_len, out_cap;
+    struct out_segment segs[MAX_SEGMENTS];
+    int seg_count, seg_index;    // queued segments / first one not fully sent
+    size_t seg_sent;             // bytes of segs[seg_index] already sent
+    struct watch pipe;           // output pipe of a streaming command or master side of a terminal (fd -1 if none)
+    struct shell_process proc;   // stages of the streaming command, or the terminal's shell
+    size_t streamed;             // bytes of command output forwarded so far
+    // CONN_TERMINAL: the socket is a WebSocket. Input decoded from its frames
+    // collects at the front of in, ahead of the frames not parsed yet.
+    size_t pty_pending;          // input bytes the terminal has not taken yet
+    int ws_message;              // opcode of a fragmented message being received, or 0
+    int ws_closing;              // close frame queued; hang up once it is sent
+    struct batch *batch;         // POST /execute_batch being run, or NULL
+    struct arena arena;          // per-request memory, reset after each response
+};
+
+// A child whose output we no longer read, reaped when its pidfd turns readable
+struct reaper {
+    struct watch watch;
+    pid_t pid;
+};
+
+// What a worker does with a job
+enum exec_mode {
+    EXEC_BUFFERED,               // run the command to completion
+    EXEC_STREAM,                 // start the command and return its output pipe
+    EXEC_TERMINAL,               // start an interactive shell on a pseudo-terminal
+    EXEC_COMPLETE,               // GET /complete that has a directory, $PATH or a log to read
+    EXEC_HISTORY,                // GET /history whose log is not open yet
+};
+
+// A POST /execute or GET /terminal, or a lookup too slow for the event loop,
+// handed to the worker pool
+struct exec_job {
+    struct connection *conn;
+    enum exec_mode mode;
+    int out_fd;                  // streaming: pipe read end, or -1 if output is complete;
+                                 // terminal: its master side, or -1 if it did not start
+    struct shell_process proc;   // streaming, terminal: the started stages
+    int status[MAX_STAGES];      // buffered: exit status of each pipeline stage
+    int status_count;
+    int cache;                   // buffered: SHELL_CACHE_HIT, _MISS or _BYPASS
+    int job_id;                  // background job the command started, or 0
+    int64_t timeout_ms;          // deadline asked for with timeout=, or 0
+    const char *stop_reason;     // buffered: why the command was stopped early, or NULL
+    char *command;
+    int rows, cols;              // terminal: its size
+    char accept[WS_ACCEPT_LEN + 1];   // terminal: Sec-WebSocket-Accept for the handshake
+    int batch_index;             // command of conn->batch this runs, or -1
+    struct session *session;     // the client's shell state; the job holds a reference
+    int session_ended;           // the command was exit: the cookie goes
+    struct outbuf out;           // command output, in the connection's arena
+    int limit;                   // complete, history: matches or commands to list
+    struct completion completion;   // complete: matches for the last word
+    char **lines;                // complete, history: logged commands, in the connection's arena
+    int line_count;
+};
+
+enum batch_state { BATCH_WAITING, BATCH_RUNNING, BATCH_DONE };
+
+// One command of a batch. Commands run on several workers at once, so each
+// collects its output in an arena of its own rather than the connection's.
+struct batch_command {
+    char *command;
+    int after;                   // waits for the command before it; skipped unless that succeeded
+    enum batch_state state;
+    int failed;                  // done with a non-zero exit status, or skipped
+    int64_t start_ns;
+    struct arena arena;          // output while running
+    char *result;                // JSON object once done, in the connection's arena
+    size_t result_len;
+};
+
+// A POST /execute_batch: independent commands fan out over the worker pool,
+// at most limit at a time
+struct batch {
+    struct batch_command *commands;
+    int count;
+    int limit;
+    int running, done;
+    int stream;                  // send each result as a line of NDJSON as soon as it is done
+    int64_t timeout_ms;          // per command, as timeout= on /execute
+    struct session *session;     // reference held until the batch is answered
+};
+
+// Bounded lock-free multi-producer/multi-consumer ring (Vyukov's algorithm).
+// Each cell's sequence number says whether it is ready to be written or read.
+struct mpmc_cell {
+    _Atomic size_t seq;
+    void *data;
+};
+
+struct mpmc_queue {
+    struct mpmc_cell *cells;
+    size_t mask;
+    _Alignas(64) _Atomic size_t tail;   // next slot to push
+    _Alignas(64) _Atomic size_t head;   // next slot to pop
+};
+
+static int epoll_fd;
+
+// Worker pool state: jobs go in through job_queue, finished jobs come back
+// through done_queue and the completions eventfd wakes the event loop.
+static struct mpmc_queue job_queue, done_queue;
+static sem_t jobs_pending;
+static int worker_count;
+static size_t jobs_in_flight;            // event loop only
+static unsigned long jobs_submitted, jobs_rejected, jobs_completed;
+static struct watch completions = { WATCH_COMPLETIONS, -1 };
+static struct connection *graveyard;     // closed connections awaiting free
+static size_t output_limit = OUTPUT_LIMIT;
+static size_t body_limit = BODY_LIMIT;
+static unsigned long requests_handled;
+static int connections_active;
+static int terminals_active;
+
+// ---------- CONNECTION I/O ----------
+
+// Point epoll at whatever the connection is currently waiting for
+static void conn_watch(struct connection *conn) {
+    struct epoll_event ev = { 0 };
+    if (conn->state == CONN_READING) ev.events = EPOLLIN | EPOLLRDHUP;
+    else if (conn->state == CONN_WRITING) ev.events = EPOLLOUT;
+    else if (conn->state == CONN_STREAMING && conn->seg_index < conn->seg_count) ev.events = EPOLLOUT;
+    else if (conn->state == CONN_TERMINAL) {
+        // Take more input only once the terminal has all of the last
+        if (!conn->pty_pending && !conn->ws_closing) ev.events = EPOLLIN | EPOLLRDHUP;
+        if (conn->seg_index < conn->seg_count) ev.events |= EPOLLOUT;
+    }
+    ev.data.ptr = &conn->watch;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->watch.fd, &ev);
+
+    // Backpressure: leave the command blocked on its pipe while the client lags
+    if ((conn->state == CONN_STREAMING || conn->state == CONN_TERMINAL) && conn->pipe.fd >= 0) {
+        struct epoll_event pev = { 0 };
+        if (conn->out_len < STREAM_HIGH_WATER) pev.events = EPOLLIN;
+        if (conn->pty_pending) pev.events |= EPOLLOUT;
+        pev.data.ptr = &conn->pipe;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->pipe.fd, &pev);
+    }
+}
+
+// Reap a child without blocking the event loop
+static void reap_child(pid_t pid) {
+    if (pid <= 0 || waitpid(pid, NULL, WNOHANG) != 0) return;
+
+    int fd = syscall(SYS_pidfd_open, pid, 0);
+    if (fd == -1) {
+        perror("pidfd_open");
+        return;
+    }
+    struct reaper *reaper = malloc(sizeof(*reaper));
+    reaper->watch = (struct watch){ WATCH_REAPER, fd };
+    reaper->pid = pid;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &reaper->watch };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void reaper_ready(struct reaper *reaper) {
+    waitpid(reaper->pid, NULL, WNOHANG);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, reaper->watch.fd, NULL);
+    close(reaper->watch.fd);
+    free(reaper);
+}
+
+// Let go of a started command: the executor reaps its stages once we hang up,
+// in-process children are reaped here
+static void release_process(struct shell_process *proc) {
+    if (proc->channel >= 0) close(proc->channel);
+    proc->channel = -1;
+    for (int i = 0; i < proc->pid_count; i++)
+        reap_child(proc->pids[i]);
+    proc->pid_count = 0;
+}
+
+// Stop forwarding a streaming command's output; the child gets SIGPIPE if it keeps writing
+static void stream_detach(struct connection *conn) {
+    if (conn->pipe.fd < 0) return;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->pipe.fd, NULL);
+    close(conn->pipe.fd);
+    conn->pipe.fd = -1;
+    release_process(&conn->proc);
+}
+
+static struct blob *blob_new(char *data, int fd, size_t len) {
+    struct blob *blob = malloc(sizeof(*blob));
+    blob->refs = 1;
+    blob->fd = fd;
+    blob->len = len;
+    blob->data = data;
+    return blob;
+}
+
+static void blob_unref(struct blob *blob) {
+    if (!blob || --blob->refs > 0) return;
+    if (blob->fd >= 0) close(blob->fd);
+    free(blob->data);
+    free(blob);
+}
+
+// Drop all queued output and the blob references it holds
+static void conn_reset_output(struct connection *conn) {
+    for (int i = 0; i < conn->seg_count; i++)
+        blob_unref(conn->segs[i].blob);
+    conn->seg_count = conn->seg_index = 0;
+    conn->seg_sent = 0;
+    conn->out_len = 0;
+}
+
+// Events for this connection may still be pending in the current epoll batch,
+// so the memory is only released by free_dead_connections() afterwards
+static void conn_free(struct connection *conn) {
+    conn_reset_output(conn);
+    if (conn->state == CONN_TERMINAL) terminals_active--;
+    connections_active--;
+    conn->dead = 1;
+    conn->next_dead = graveyard;
+    graveyard = conn;
+}
+
+static void free_dead_connections(void) {
+    while (graveyard) {
+        struct connection *conn = graveyard;
+        graveyard = conn->next_dead;
+        arena_free(&conn->arena);
+        free(conn->in);
+        free(conn->out);
+        free(conn);
+    }
+}
+
+static void conn_close(struct connection *conn) {
+    if (conn->dead) return;
+    stream_detach(conn);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->watch.fd, NULL);
+    close(conn->watch.fd);
+    // A worker still holds a pointer; it is freed when the job (or the
+    // batch's last running command) completes
+    if (conn->state == CONN_EXECUTING || (conn->batch && conn->batch->running > 0)) {
+        conn->closing = 1;
+        return;
+    }
+    conn_free(conn);
+}
+
+// Append a copy of raw bytes to the connection's pending output
+static void conn_append(struct connection *conn, const char *data, size_t len) {
+    if (len == 0) return;
+    if (conn->out_len + len > conn->out_cap) {
+        size_t cap = conn->out_cap ? conn->out_cap : BUFFER_SIZE;
+        while (cap < conn->out_len + len) cap *= 2;
+        conn->out = realloc(conn->out, cap);
+        conn->out_cap = cap;
+    }
+    memcpy(conn->out + conn->out_len, data, len);
+
+    // Grow the last owned segment when it ends where these bytes start
+    struct out_segment *last = conn->seg_count ? &conn->segs[conn->seg_count - 1] : NULL;
+    if (last && !last->blob && !last->base && last->offset + last->len == conn->out_len) {
+        last->len += len;
+    } else {
+        conn->segs[conn->seg_count++] = (struct out_segment){ NULL, NULL, conn->out_len, len };
+    }
+    conn->out_len += len;
+}
+
+// Queue bytes from the connection's arena without copying them
+static void conn_append_arena(struct connection *conn, const char *data, size_t len) {
+    if (len == 0) return;
+    if (conn->seg_count >= MAX_SEGMENTS - 1) {
+        conn_append(conn, data, len);
+        return;
+    }
+    conn->segs[conn->seg_count++] = (struct out_segment){ NULL, data, 0, len };
+}
+
+// Queue a blob's bytes without copying them; the connection holds a reference
+static void conn_append_blob(struct connection *conn, struct blob *blob) {
+    if (blob->len == 0) return;
+    if (conn->seg_count >= MAX_SEGMENTS - 1 && blob->fd < 0) {
+        conn_append(conn, blob->data, blob->len);
+        return;
+    }
+    blob->refs++;
+    conn->segs[conn->seg_count++] = (struct out_segment){ blob, NULL, 0, blob->len };
+}
+
+// Queue the status line and headers of a response with a body_len-byte body
+// (none for 304 and 101). extra_headers is "" or complete CRLF-terminated lines.
+static void queue_headers(struct connection *conn, int status_code, const char *status_text,
+                          const char *content_type, const char *extra_headers, size_t body_len) {
+    char header[BUFFER_SIZE];
+    int header_len;
+    if (conn->request_ns) {
+        metrics_observe(conn->route, metrics_now() - conn->request_ns);
+        conn->request_ns = 0;
+    }
+    char cookie[128] = "";
+    if (conn->clear_cookie) {
+        snprintf(cookie, sizeof(cookie), "Set-Cookie: " SESSION_COOKIE "=; Path=/; Max-Age=0; HttpOnly; SameSite=Strict\r\n");
+        conn->clear_cookie = 0;
+        conn->set_cookie[0] = '\0';
+    } else if (conn->set_cookie[0]) {
+        snprintf(cookie, sizeof(cookie), "Set-Cookie: " SESSION_COOKIE "=%s; Path=/; HttpOnly; SameSite=Strict\r\n",
+                 conn->set_cookie);
+        conn->set_cookie[0] = '\0';
+    }
+    if (status_code == 304 || status_code == 101) {
+        header_len = snprintf(header, BUFFER_SIZE,
+            "HTTP/1.1 %d %s\r\n"
+            "%s%s"
+            "Connection: %s\r\n\r\n",
+            status_code, status_text, extra_headers, cookie,
+            status_code == 101 ? "Upgrade" : conn->keep_alive ? "keep-alive" : "close");
+    } else {
+        char length[48];
+        if (body_len == BODY_CHUNKED)
+            snprintf(length, sizeof(length), "Transfer-Encoding: chunked");
+        else
+            snprintf(length, sizeof(length), "Content-Length: %zu", body_len);
+        header_len = snprintf(header, BUFFER_SIZE,
+            "HTTP/1.1 %d %s\r\n"
+            "Content-Type: %s\r\n"
+            "%s\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "%s%s"
+            "Connection: %s\r\n\r\n",
+            status_code, status_text, content_type, length, extra_headers, cookie,
+            conn->keep_alive ? "keep-alive" : "close");
+    }
+
+    conn_append(conn, header, header_len);
+    conn->state = CONN_WRITING;
+}
+
+// Queue one piece of a chunked body; len 0 queues the terminating chunk
+static void queue_chunk(struct connection *conn, const char *data, size_t len) {
+    char size_line[24];
+    int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+    conn_append(conn, size_line, n);
+    conn_append(conn, data, len);
+    conn_append(conn, "\r\n", 2);
+}
+
+// Queue a full HTTP response; the body is copied and may contain any bytes
+static void queue_response(struct connection *conn, int status_code, const char *status_text,
+                           const char *content_type, const char *extra_headers,
+                           const char *body, size_t body_len) {
+    queue_headers(conn, status_code, status_text, content_type, extra_headers, body_len);
+    if (status_code != 304)
+        conn_append(conn, body, body_len);
+}
+
+// Send HTTP response to client
+void send_response(struct connection *conn, int status_code, const char *status_text, const char *content_type, const char *body) {
+    queue_response(conn, status_code, status_text, content_type, "", body, strlen(body));
+}
+
+// ---------- STATIC ASSET CACHE ----------
+// The frontend files are read once at startup into immutable blobs, along with
+// any precompressed siblings (style.css.gz, style.css.br) that are at least as new
+// as the original. Serving a page just queues a reference to the blob: no disk
+// I/O, malloc or copy on the request path.
+// An inotify watch on the directory reloads a file as soon as it is saved.
+
+enum asset_encoding { ENC_IDENTITY, ENC_GZIP, ENC_BROTLI, ENC_COUNT };
+
+static const char *encoding_names[ENC_COUNT] = { "identity", "gzip", "br" };
+static const char *encoding_suffixes[ENC_COUNT] = { "", ".gz", ".br" };
+
+// One ready-to-send representation of an asset
+struct asset_variant {
+    struct blob *blob;           // NULL if this encoding is not available
+    char etag[32];
+    char headers[160];           // ETag, caching and encoding header lines
+};
+
+struct asset {
+    const char *url;
+    const char *filename;
+    const char *content_type;
+    struct asset_variant variants[ENC_COUNT];
+};
+
+static struct asset assets[] = {
+    { .url = "/index.html", .filename = "index.html", .content_type = "text/html" },
+    { .url = "/style.css",  .filename = "style.css",  .content_type = "text/css" },
+    { .url = "/script.js",  .filename = "script.js",  .content_type = "application/javascript" },
+};
+#define ASSET_COUNT (sizeof(assets) / sizeof(assets[0]))
+
+static struct watch asset_watch = { WATCH_ASSETS, -1 };
+
+// FNV-1a, used as a content fingerprint for ETags
+static uint64_t fnv1a_update(uint64_t hash, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t fnv1a(const char *data, size_t len) {
+    return fnv1a_update(1469598103934665603ULL, data, len);
+}
+
+// Load a regular file as a blob: small files are read into memory, large
+// ones keep their fd open for sendfile(). Returns NULL if missing/unreadable.
+static struct blob *load_file_blob(const char *filename, struct stat *st) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+    if (fstat(fd, st) == -1 || !S_ISREG(st->st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    if (st->st_size > ASSET_INLINE_MAX)
+        return blob_new(NULL, fd, st->st_size);
+
+    char *data = malloc(st->st_size ? st->st_size : 1);
+    size_t done = 0;
+    while (done < (size_t)st->st_size) {
+        ssize_t n = read(fd, data + done, st->st_size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    close(fd);
+    return blob_new(data, -1, done);
+}
+
+// Content fingerprint of a blob, reading it through once if it lives on disk
+static uint64_t blob_hash(struct blob *blob) {
+    if (blob->fd < 0) return fnv1a(blob->data, blob->len);
+
+    uint64_t hash = 1469598103934665603ULL;
+    char chunk[BUFFER_SIZE];
+    ssize_t n;
+    for (off_t off = 0; (n = pread(blob->fd, chunk, sizeof(chunk), off)) > 0; off += n)
+        hash = fnv1a_update(hash, chunk, n);
+    return hash;
+}
+
+static void asset_load(struct asset *asset) {
+    struct asset_variant fresh[ENC_COUNT];
+    memset(fresh, 0, sizeof(fresh));
+
+    struct stat source;
+    fresh[ENC_IDENTITY].blob = load_file_blob(asset->filename, &source);
+    if (fresh[ENC_IDENTITY].blob) {
+        uint64_t hash = blob_hash(fresh[ENC_IDENTITY].blob);
+
+        for (int enc = 0; enc < ENC_COUNT; enc++) {
+            struct asset_variant *v = &fresh[enc];
+            if (enc != ENC_IDENTITY) {
+                char name[256];
+                struct stat st;
+                snprintf(name, sizeof(name), "%s%s", asset->filename, encoding_suffixes[enc]);
+                v->blob = load_file_blob(name, &st);
+                // A compressed copy older than the source is stale; ignore it
+                if (v->blob && (st.st_mtim.tv_sec < source.st_mtim.tv_sec ||
+                                (st.st_mtim.tv_sec == source.st_mtim.tv_sec &&
+                                 st.st_mtim.tv_nsec < source.st_mtim.tv_nsec))) {
+                    blob_unref(v->blob);
+                    v->blob = NULL;
+                }
+                if (!v->blob) continue;
+            }
+
+            // Each encoding is a different representation, so it gets its own tag
+            snprintf(v->etag, sizeof(v->etag), "\"%016llx%s\"", (unsigned long long)hash,
+                     enc == ENC_IDENTITY ? "" : enc == ENC_GZIP ? "-gz" : "-br");
+            int n = snprintf(v->headers, sizeof(v->headers),
+                "ETag: %s\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n", v->etag);
+            if (enc != ENC_IDENTITY)
+                snprintf(v->headers + n, sizeof(v->headers) - n,
+                         "Content-Encoding: %s\r\n", encoding_names[enc]);
+        }
+    }
+
+    // Responses still being sent keep their own reference to the old blobs
+    for (int enc = 0; enc < ENC_COUNT; enc++)
+        blob_unref(asset->variants[enc].blob);
+    memcpy(asset->variants, fresh, sizeof(fresh));
+}
+
+static void assets_init(void) {
+    for (size_t i = 0; i < ASSET_COUNT; i++) {
+        asset_load(&assets[i]);
+        if (!assets[i].variants[ENC_IDENTITY].blob)
+            fprintf(stderr, "warning: could not load %s\n", assets[i].filename);
+    }
+
+    asset_watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (asset_watch.fd != -1 &&
+        inotify_add_watch(asset_watch.fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) == -1) {
+        perror("inotify_add_watch");
+        close(asset_watch.fd);
+        asset_watch.fd = -1;
+    }
+}
+
+// Reload any cached asset (or compressed sibling) that changed on disk
+static void assets_changed(void) {
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(asset_watch.fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + n; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->len == 0) continue;
+
+            for (size_t i = 0; i < ASSET_COUNT; i++) {
+                size_t name_len = strlen(assets[i].filename);
+                if (strncmp(ev->name, assets[i].filename, name_len) == 0 &&
+                    (ev->name[name_len] == '\0' || ev->name[name_len] == '.'))
+                    asset_load(&assets[i]);
+            }
+        }
+    }
+}
+
+// Does the client accept this content-coding? Honours "q=0" exclusions.
+static int accepts_encoding(const char *accept, size_t accept_len, const char *name) {
+    size_t name_len = strlen(name);
+    const char *end = accept + accept_len;
+    while (accept < end) {
+        while (accept < end && (*accept == ' ' || *accept == ',')) accept++;
+        const char *token = accept;
+        while (accept < end && *accept != ',') accept++;
+
+        size_t token_len = accept - token;
+        size_t word_len = strcspn(token, ";, ");
+        if (word_len > token_len) word_len = token_len;
+        if (word_len == name_len && strncasecmp(token, name, name_len) == 0) {
+            const char *q = memmem(token, token_len, "q=", 2);
+            return !(q && strtod(q + 2, NULL) == 0.0);
+        }
+    }
+    return 0;
+}
+
+// Does an If-None-Match list contain this entity tag? (weak comparison)
+static int etag_matches(const char *list, size_t list_len, const char *etag) {
+    size_t etag_len = strlen(etag);
+    const char *end = list + list_len;
+    while (list < end) {
+        while (list < end && (*list == ' ' || *list == ',')) list++;
+        if (list < end && *list == '*') return 1;
+        if (end - list >= 2 && list[0] == 'W' && list[1] == '/') list += 2;
+        if ((size_t)(end - list) >= etag_len && strncmp(list, etag, etag_len) == 0)
+            return 1;
+        while (list < end && *list != ',') list++;
+    }
+    return 0;
+}
+
+static struct asset *asset_find(const char *path, size_t len) {
+    if (len == 1 && *path == '/') {
+        path = "/index.html";
+        len = strlen(path);
+    }
+    for (size_t i = 0; i < ASSET_COUNT; i++)
+        if (strlen(assets[i].url) == len && memcmp(path, assets[i].url, len) == 0)
+            return &assets[i];
+    return NULL;
+}
+
+// Serve a cached asset, picking the smallest encoding the client accepts
+static void send_asset(struct connection *conn, struct asset *asset, const struct http_request *req) {
+    if (!asset->variants[ENC_IDENTITY].blob) {
+        send_response(conn, 404, "Not Found", "text/plain", "File not found");
+        return;
+    }
+
+    size_t value_len;
+    struct asset_variant *v = &asset->variants[ENC_IDENTITY];
+    const char *accept = http_header(req, "Accept-Encoding", &value_len);
+    if (accept) {
+        if (asset->variants[ENC_BROTLI].blob && accepts_encoding(accept, value_len, "br"))
+            v = &asset->variants[ENC_BROTLI];
+        else if (asset->variants[ENC_GZIP].blob && accepts_encoding(accept, value_len, "gzip"))
+            v = &asset->variants[ENC_GZIP];
+    }
+
+    const char *if_none_match = http_header(req, "If-None-Match", &value_len);
+    if (if_none_match && etag_matches(if_none_match, value_len, v->etag)) {
+        queue_headers(conn, 304, "Not Modified", asset->content_type, v->headers, 0);
+    } else {
+        queue_headers(conn, 200, "OK", asset->content_type, v->headers, v->blob->len);
+        conn_append_blob(conn, v->blob);
+    }
+}
+
+// ---------- WORKER POOL ----------
+
+static void mpmc_init(struct mpmc_queue *q, size_t size) {
+    q->cells = calloc(size, sizeof(*q->cells));
+    q->mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+        atomic_store_explicit(&q->cells[i].seq, i, memory_order_relaxed);
+    atomic_store(&q->tail, 0);
+    atomic_store(&q->head, 0);
+}
+
+// Returns 0 on success, -1 if the ring is full
+static int mpmc_push(struct mpmc_queue *q, void *data) {
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    while (1) {
+        struct mpmc_cell *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                cell->data = data;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
         } else {
-            *dst++ = *src++;
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
         }
     }
-    *dst = '\0';
 }
 
-// Send HTTP response to client
-void send_response(int client_socket, int status_code, const char *status_text, const char *content_type, const char *body) {
-    char header[BUFFER_SIZE];
-    int header_len = snprintf(header, BUFFER_SIZE,
-        "HTTP/1.1 %d %s\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %ld\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "Connection: close\r\n\r\n",
-        status_code, status_text, content_type, strlen(body));
-    
-    write(client_socket, header, header_len);
-    write(client_socket, body, strlen(body));
+// Returns NULL if the ring is empty
+static void *mpmc_pop(struct mpmc_queue *q) {
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    while (1) {
+        struct mpmc_cell *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                void *data = cell->data;
+                atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+                return data;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+static size_t mpmc_depth(struct mpmc_queue *q) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+static void lookup_run(struct exec_job *job);
+
+// Worker thread: run queued commands and hand the results back to the event loop
+static void *worker_main(void *arg) {
+    (void)arg;
+    while (1) {
+        while (sem_wait(&jobs_pending) == -1 && errno == EINTR)
+            ;
+        struct exec_job *job;
+        while (!(job = mpmc_pop(&job_queue)))
+            sched_yield();   // a producer claimed the slot but has not published yet
+
+        // The job and its output live in the connection's arena, which
+        // belongs to this worker until the job is handed back
+        shell_use_session(job->session);
+        shell_set_timeout(job->timeout_ms);
+        if (job->mode == EXEC_TERMINAL) {
+            job->out_fd = shell_start_terminal(job->rows, job->cols, &job->proc);
+        } else if (job->mode == EXEC_STREAM) {
+            job->out_fd = start_shell_command(job->command, &job->out, &job->proc);
+        } else if (job->mode == EXEC_COMPLETE || job->mode == EXEC_HISTORY) {
+            lookup_run(job);
+        } else {
+            execute_shell_command(job->command, &job->out);
+            job->status_count = shell_pipestatus(job->status, MAX_STAGES);
+            job->cache = shell_cache_result();
+            job->stop_reason = shell_stop_reason();
+        }
+        job->job_id = shell_last_job();
+        job->session_ended = session_ended(job->session);
+        shell_set_timeout(0);
+        shell_use_session(NULL);
+        if (job->session) session_release(job->session);
+
+        // Cannot fail: done_queue holds as many slots as jobs may be in flight
+        mpmc_push(&done_queue, job);
+        uint64_t one = 1;
+        write(completions.fd, &one, sizeof(one));
+    }
+    return NULL;
+}
+
+static void start_workers(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = cores > 0 ? (int)cores : 1;
+
+    mpmc_init(&job_queue, JOB_QUEUE_SIZE);
+    mpmc_init(&done_queue, JOB_QUEUE_SIZE);
+    sem_init(&jobs_pending, 0, 0);
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, worker_main, NULL) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+        pthread_detach(worker);
+    }
 }
 
-// Send static file like index.html, style.css, or script.js
-void send_file(int client_socket, const char *filename, const char *content_type) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        send_response(client_socket, 404, "Not Found", "text/plain", "File not found");
+// A job for conn in its arena, holding the session reference; the caller
+// fills in what its mode needs and submits it
+static struct exec_job *job_new(struct connection *conn, enum exec_mode mode, struct session *session) {
+    struct exec_job *job = arena_alloc(&conn->arena, sizeof(*job));
+    job->conn = conn;
+    job->mode = mode;
+    job->out_fd = -1;
+    job->proc.channel = -1;
+    job->proc.pid_count = 0;
+    job->status_count = 0;
+    job->cache = SHELL_CACHE_BYPASS;
+    job->job_id = 0;
+    job->timeout_ms = 0;
+    job->stop_reason = NULL;
+    job->command = NULL;
+    job->batch_index = -1;
+    job->session = session;
+    job->session_ended = 0;
+    outbuf_init(&job->out, &conn->arena, output_limit);
+    return job;
+}
+
+// Hand a job to the workers; -1 if JOB_QUEUE_SIZE are already in flight
+static int job_push(struct exec_job *job) {
+    if (jobs_in_flight >= JOB_QUEUE_SIZE) return -1;
+    // Cannot fail: jobs_in_flight bounds the queue occupancy
+    mpmc_push(&job_queue, job);
+    sem_post(&jobs_pending);
+    jobs_in_flight++;
+    jobs_submitted++;
+    return 0;
+}
+
+static void submit_job(struct exec_job *job) {
+    struct connection *conn = job->conn;
+    if (job_push(job) == -1) {
+        if (job->session) session_release(job->session);
+        jobs_rejected++;
+        send_response(conn, 503, "Service Unavailable", "text/plain", "Server busy, try again");
         return;
     }
 
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    conn->state = CONN_EXECUTING;
+    conn_watch(conn);
+}
 
-    char *content = malloc(file_size + 1);
-    fread(content, 1, file_size, file);
-    content[file_size] = '\0';
-    fclose(file);
+// Queue, pool and allocation counters, for sizing JOB_QUEUE_SIZE and the worker
+// count and for checking that requests stay off malloc
+static void send_status(struct connection *conn) {
+    struct path_cache_stats paths;
+    path_cache_stats(&paths);
+    struct result_cache_stats results;
+    result_cache_stats(&results);
+    struct session_stats sessions;
+    session_stats(&sessions);
+    char body[1024];
+    snprintf(body, sizeof(body),
+        "{\"workers\": %d, \"queue_capacity\": %d, \"queue_depth\": %zu, "
+        "\"in_flight\": %zu, \"submitted\": %lu, \"completed\": %lu, \"rejected\": %lu, "
+        "\"path_cache\": {\"entries\": %d, \"hits\": %lu, \"misses\": %lu, \"saved_us\": %lld}, "
+        "\"result_cache\": {\"entries\": %d, \"bytes\": %zu, \"budget\": %zu, \"hits\": %lu, "
+        "\"misses\": %lu, \"stale\": %lu, \"evictions\": %lu}, "
+        "\"sessions\": {\"active\": %d, \"created\": %lu, \"expired\": %lu, \"evicted\": %lu}, "
+        "\"requests\": %lu, \"arena_mallocs\": %lu}",
+        worker_count, JOB_QUEUE_SIZE, mpmc_depth(&job_queue),
+        jobs_in_flight, jobs_submitted, jobs_completed, jobs_rejected,
+        paths.entries, paths.hits, paths.misses, paths.saved_ns / 1000,
+        results.entries, results.bytes, results.budget, results.hits,
+        results.misses, results.stale, results.evictions,
+        sessions.active, sessions.created, sessions.expired, sessions.evicted,
+        requests_handled, arena_malloc_count());
+    send_response(conn, 200, "OK", "application/json", body);
+}
 
-    send_response(client_socket, 200, "OK", content_type, content);
-    free(content);
+// Prometheus scrape: the metrics.h counters and histograms plus the event
+// loop's own gauges
+static void send_metrics(struct connection *conn) {
+    struct session_stats sessions;
+    session_stats(&sessions);
+    struct outbuf body;
+    outbuf_init(&body, &conn->arena, SIZE_MAX);
+    metrics_print(&body, "gauge", "webshell_connections_active", "Open client connections.", connections_active);
+    metrics_print(&body, "gauge", "webshell_queue_depth", "Commands waiting for a worker.", mpmc_depth(&job_queue));
+    metrics_print(&body, "gauge", "webshell_jobs_in_flight", "Commands queued or running.", jobs_in_flight);
+    metrics_print(&body, "gauge", "webshell_workers", "Worker threads.", worker_count);
+    metrics_print(&body, "gauge", "webshell_sessions_active", "Shell sessions.", sessions.active);
+    metrics_print(&body, "gauge", "webshell_terminals_active", "Open WebSocket terminals.", terminals_active);
+    metrics_print(&body, "counter", "webshell_requests_total", "Requests parsed.", requests_handled);
+    metrics_print(&body, "counter", "webshell_jobs_rejected_total", "Commands refused with 503 because the queue was full.",
+                  jobs_rejected);
+    metrics_write(&body);
+    queue_headers(conn, 200, "OK", "text/plain; version=0.0.4; charset=utf-8", "", body.len);
+    conn_append_arena(conn, body.data, body.len);
 }
 
-// Handle a single client request
-void handle_client(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    ssize_t bytes_read = read(client_socket, buffer, BUFFER_SIZE - 1);
+static void conn_flush(struct connection *conn);
+static void terminal_start(struct connection *conn, struct exec_job *job);
+static void batch_complete(struct connection *conn, struct exec_job *job);
+static void lookup_reply(struct connection *conn, struct exec_job *job);
 
-    if (bytes_read <= 0) return;
-    buffer[bytes_read] = '\0';
+// ---------- STREAMING OUTPUT ----------
+// With stream=1 the command's pipe is handed to the event loop and its output
+// is forwarded as HTTP chunks while the command runs. Reading pauses whenever
+// STREAM_HIGH_WATER bytes are waiting for a slow client (see conn_watch).
 
-    char method[16], path[256], protocol[16];
-    sscanf(buffer, "%s %s %s", method, path, protocol);
+// Begin a chunked response for a command the worker pool just started
+static void stream_start(struct connection *conn, struct exec_job *job) {
+    queue_headers(conn, 200, "OK", "text/plain; charset=utf-8",
+                  "Cache-Control: no-cache\r\nX-Content-Type-Options: nosniff\r\n", BODY_CHUNKED);
+    if (job->out.len > 0) queue_chunk(conn, job->out.data, job->out.len);
 
-    // Handle GET requests (serve frontend files)
-    if (strcmp(method, "GET") == 0) {
-        if (strcmp(path, "/") == 0 || strcmp(path, "/index.html") == 0)
-            send_file(client_socket, "index.html", "text/html");
-        else if (strcmp(path, "/style.css") == 0)
-            send_file(client_socket, "style.css", "text/css");
-        else if (strcmp(path, "/script.js") == 0)
-            send_file(client_socket, "script.js", "application/javascript");
-        else
-            send_response(client_socket, 404, "Not Found", "text/plain", "Not found");
+    if (job->out_fd < 0) {
+        // Built-in: the whole output is already here
+        queue_chunk(conn, NULL, 0);
+        conn_flush(conn);
+        return;
     }
-    // Handle POST /execute for command execution
-    else if (strcmp(method, "POST") == 0 && strcmp(path, "/execute") == 0) {
-        char *body = strstr(buffer, "\r\n\r\n");
-        if (body) {
-            body += 4;
-
-            char command[MAX_COMMAND_LENGTH];
-            char *cmd_start = strstr(body, "command=");
-            if (cmd_start) {
-                cmd_start += 8;
-                char *cmd_end = strchr(cmd_start, '&');
-                if (cmd_end) *cmd_end = '\0';
-                url_decode(command, cmd_start);
-
-                char output[MAX_OUTPUT];
-                execute_shell_command(command, output, sizeof(output));
-
-                char escaped_output[MAX_OUTPUT * 2];
-                json_escape(escaped_output, output, sizeof(escaped_output));
-
-                char response[MAX_OUTPUT * 2 + 100];
-                snprintf(response, sizeof(response),
-                    "{\"output\": \"%s\"}",
-                    strlen(escaped_output) > 0 ? escaped_output : "Command executed successfully");
-
-                send_response(client_socket, 200, "OK", "application/json", response);
+
+    fcntl(job->out_fd, F_SETFL, fcntl(job->out_fd, F_GETFL) | O_NONBLOCK);
+    conn->pipe.fd = job->out_fd;
+    conn->proc = job->proc;
+    conn->streamed = 0;
+    conn->state = CONN_STREAMING;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &conn->pipe };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->pipe.fd, &ev);
+    conn_flush(conn);
+}
+
+// Command output has ended (or hit the limit): finish the chunked body
+static void stream_finish(struct connection *conn) {
+    stream_detach(conn);
+    queue_chunk(conn, NULL, 0);
+    conn->state = CONN_WRITING;
+    conn_flush(conn);
+}
+
+static void stream_readable(struct connection *conn) {
+    char chunk[STREAM_CHUNK];
+    ssize_t n = read(conn->pipe.fd, chunk, sizeof(chunk));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n <= 0) {
+        stream_finish(conn);
+        return;
+    }
+    metrics_count(METRIC_PIPE_BYTES, n);
+
+    size_t room = output_limit - conn->streamed;
+    if ((size_t)n > room) {
+        metrics_count(METRIC_TRUNCATIONS, 1);
+        static const char notice[] = "\n[output truncated]\n";
+        // An empty chunk would end the body before the notice
+        if (room > 0) queue_chunk(conn, chunk, room);
+        queue_chunk(conn, notice, sizeof(notice) - 1);
+        conn->streamed = output_limit;
+        stream_finish(conn);
+        return;
+    }
+
+    queue_chunk(conn, chunk, n);
+    conn->streamed += n;
+    conn_flush(conn);
+}
+
+// The members of a finished command's JSON result: output, exit_code,
+// pipestatus and, when they apply, cache, job and killed. exit_code is the
+// last stage's status; pipestatus has every stage's.
+static void append_result(struct outbuf *body, struct exec_job *job) {
+    outbuf_append(body, "\"output\": \"", 11);
+    if (job->out.len > 0)
+        json_escape(body, job->out.data, job->out.len);
+    else
+        outbuf_append(body, "Command executed successfully", 29);
+    if (job->out.dropped > 0) {
+        metrics_count(METRIC_TRUNCATIONS, 1);
+        outbuf_printf(body, "\\n[output truncated: %zu more bytes]\\n", job->out.dropped);
+    }
+    outbuf_printf(body, "\", \"exit_code\": %d, \"pipestatus\": [",
+                  job->status_count ? job->status[job->status_count - 1] : 0);
+    for (int i = 0; i < job->status_count; i++)
+        outbuf_printf(body, "%s%d", i ? ", " : "", job->status[i]);
+    outbuf_append(body, "]", 1);
+    if (job->cache != SHELL_CACHE_BYPASS)
+        outbuf_printf(body, ", \"cache\": \"%s\"", job->cache == SHELL_CACHE_HIT ? "hit" : "miss");
+    if (job->job_id)
+        outbuf_printf(body, ", \"job\": %d", job->job_id);
+    if (job->stop_reason)
+        outbuf_printf(body, ", \"killed\": \"%s\"", job->stop_reason);
+}
+
+// Turn finished jobs back into HTTP responses
+static void drain_completions(void) {
+    uint64_t count;
+    read(completions.fd, &count, sizeof(count));
+
+    struct exec_job *job;
+    while ((job = mpmc_pop(&done_queue))) {
+        struct connection *conn = job->conn;
+        jobs_in_flight--;
+        jobs_completed++;
+        if (job->session_ended) conn->clear_cookie = 1;
+
+        if (job->batch_index >= 0) {
+            batch_complete(conn, job);
+        } else if (conn->closing) {
+            if (job->out_fd >= 0) {
+                close(job->out_fd);
+                release_process(&job->proc);
+            }
+            conn_free(conn);
+        } else if (job->mode == EXEC_STREAM) {
+            stream_start(conn, job);
+        } else if (job->mode == EXEC_TERMINAL) {
+            terminal_start(conn, job);
+        } else if (job->mode == EXEC_COMPLETE || job->mode == EXEC_HISTORY) {
+            lookup_reply(conn, job);
+            conn_flush(conn);
+        } else {
+            struct outbuf body;
+            outbuf_init(&body, &conn->arena, SIZE_MAX);
+            outbuf_append(&body, "{", 1);
+            append_result(&body, job);
+            outbuf_append(&body, "}", 1);
+
+            queue_headers(conn, 200, "OK", "application/json", "", body.len);
+            conn_append_arena(conn, body.data, body.len);
+            conn_flush(conn);
+        }
+    }
+}
+
+// ---------- TERMINAL ----------
+// GET /terminal upgrades the connection to a WebSocket relaying an
+// interactive shell on a pseudo-terminal (shell_start_terminal()), for
+// programs that need a tty. Binary messages from the client are keystrokes;
+// text messages are commands, so far only "resize <cols> <rows>". Output goes
+// back as binary messages. Nothing waits to be batched, but whatever is
+// already there travels together: one pass over the terminal becomes one
+// frame, and the input frames of one socket read become one write to the
+// terminal. Each side stops being read while the other lags, as with
+// streaming.
+
+// Queue one unmasked frame
+static void ws_queue(struct connection *conn, int opcode, const void *data, size_t len) {
+    unsigned char header[WS_MAX_HEADER];
+    conn_append(conn, (const char *)header, ws_frame_header(header, opcode, len));
+    conn_append(conn, data, len);
+}
+
+// Queue a close frame and hang up the terminal, whose shell gets SIGHUP; the
+// connection goes once the frame is sent
+static void terminal_close(struct connection *conn, int code) {
+    if (conn->ws_closing) return;
+    unsigned char status[2] = { code >> 8, code & 0xFF };
+    ws_queue(conn, WS_CLOSE, status, sizeof(status));
+    conn->ws_closing = 1;
+    conn->pty_pending = 0;
+    stream_detach(conn);
+}
+
+// A text message: "resize <cols> <rows>"
+static void terminal_command(struct connection *conn, const unsigned char *text, size_t len) {
+    char line[64];
+    int cols, rows;
+    if (len >= sizeof(line)) return;
+    memcpy(line, text, len);
+    line[len] = '\0';
+    if (sscanf(line, "resize %d %d", &cols, &rows) == 2 && cols > 0 && cols <= 1000 && rows > 0 && rows <= 1000)
+        shell_resize_terminal(conn->pipe.fd, rows, cols);
+}
+
+// Pass pending input to the terminal; whatever it does not take yet stays
+// at the front of conn->in until it is writable again
+static void terminal_write(struct connection *conn) {
+    size_t done = 0;
+    while (done < conn->pty_pending) {
+        ssize_t n = write(conn->pipe.fd, conn->in + done, conn->pty_pending - done);
+        if (n > 0) {
+            done += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        done = conn->pty_pending;    // the shell is gone; the read side reports it
+    }
+    memmove(conn->in, conn->in + done, conn->in_len - done);
+    conn->in_len -= done;
+    conn->pty_pending -= done;
+}
+
+// Handle every complete frame buffered behind the pending input, then write
+// the input out. Input payloads slide down over their framing so that
+// everything for the terminal stays contiguous and goes in one write.
+static void terminal_frames(struct connection *conn) {
+    while (!conn->ws_closing) {
+        unsigned char *start = (unsigned char *)conn->in + conn->pty_pending;
+        size_t avail = conn->in_len - conn->pty_pending;
+        struct ws_frame frame;
+        int error;
+        enum ws_result result = ws_parse_frame(start, avail, TERMINAL_FRAME_MAX, &frame, &error);
+        if (result == WS_INCOMPLETE) break;
+        if (result == WS_ERROR) {
+            terminal_close(conn, error);
+            break;
+        }
+        unsigned char *payload = start + frame.header_len;
+        ws_unmask(payload, frame.len, frame.mask);
+
+        // A fragmented message continues until its fin frame; control frames may come in between
+        int opcode = frame.opcode;
+        if (opcode < WS_CLOSE) {
+            if ((opcode == WS_CONTINUATION) != (conn->ws_message != 0)) {
+                terminal_close(conn, WS_CLOSE_PROTOCOL);
+                break;
+            }
+            if (opcode == WS_CONTINUATION) opcode = conn->ws_message;
+            conn->ws_message = frame.fin ? 0 : opcode;
+        }
+
+        size_t keep = 0;
+        switch (opcode) {
+            case WS_BINARY:
+                keep = frame.len;
+                break;
+            case WS_TEXT:
+                // Commands are short enough never to be fragmented
+                if (frame.opcode == WS_TEXT && frame.fin) terminal_command(conn, payload, frame.len);
+                break;
+            case WS_PING:
+                ws_queue(conn, WS_PONG, payload, frame.len);
+                break;
+            case WS_CLOSE:
+                terminal_close(conn, WS_CLOSE_NORMAL);
+                break;
+        }
+        size_t used = frame.header_len + frame.len;
+        memmove(start, payload, keep);
+        memmove(start + keep, start + used, avail - used);
+        conn->in_len -= used - keep;
+        conn->pty_pending += keep;
+    }
+    if (conn->pipe.fd >= 0) terminal_write(conn);
+}
+
+// Terminal output: everything it has, up to TERMINAL_READ bytes, as one frame
+static void terminal_output(struct connection *conn) {
+    char data[TERMINAL_READ];
+    size_t len = 0;
+    int eof = 0;
+    while (len < sizeof(data)) {
+        ssize_t n = read(conn->pipe.fd, data + len, sizeof(data) - len);
+        if (n > 0) {
+            len += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        // EIO once the shell and everything it started have let go of the terminal
+        eof = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+    if (len > 0) {
+        metrics_count(METRIC_PIPE_BYTES, len);
+        ws_queue(conn, WS_BINARY, data, len);
+    }
+    if (eof) terminal_close(conn, WS_CLOSE_NORMAL);
+    conn_flush(conn);
+}
+
+static void terminal_pty_ready(struct connection *conn, uint32_t events) {
+    // Writable again: the pending input, then the frames queued behind it
+    if (events & EPOLLOUT) terminal_frames(conn);
+    if (conn->pipe.fd >= 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) terminal_output(conn);
+    else conn_flush(conn);
+}
+
+static void terminal_client_ready(struct connection *conn, uint32_t events) {
+    if (events & EPOLLOUT) {
+        conn_flush(conn);
+        if (conn->dead) return;
+    }
+    if (!(events & (EPOLLIN | EPOLLRDHUP))) return;
+    while (conn->in_len < conn->in_cap) {
+        ssize_t n = read(conn->watch.fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+        if (n > 0) {
+            conn->in_len += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        conn_close(conn);        // the tab went away without a close frame
+        return;
+    }
+    terminal_frames(conn);
+    conn_flush(conn);
+}
+
+// Answer the handshake for a terminal the worker pool just started
+static void terminal_start(struct connection *conn, struct exec_job *job) {
+    if (job->out_fd < 0) {
+        send_response(conn, 500, "Internal Server Error", "text/plain", "Could not start a terminal");
+        conn_flush(conn);
+        return;
+    }
+
+    char headers[128];
+    snprintf(headers, sizeof(headers), "Upgrade: websocket\r\nSec-WebSocket-Accept: %s\r\n", job->accept);
+    queue_headers(conn, 101, "Switching Protocols", NULL, headers, 0);
+
+    // Keystrokes and their echo are tiny writes that must not wait for the
+    // previous one to be acknowledged
+    int one = 1;
+    setsockopt(conn->watch.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // Room for the largest frame, so a full buffer always holds a complete one
+    if (conn->in_cap < WS_MAX_HEADER + TERMINAL_FRAME_MAX) {
+        conn->in = realloc(conn->in, WS_MAX_HEADER + TERMINAL_FRAME_MAX);
+        conn->in_cap = WS_MAX_HEADER + TERMINAL_FRAME_MAX;
+    }
+
+    fcntl(job->out_fd, F_SETFL, fcntl(job->out_fd, F_GETFL) | O_NONBLOCK);
+    conn->pipe.fd = job->out_fd;
+    conn->proc = job->proc;
+    conn->pty_pending = 0;
+    conn->ws_message = 0;
+    conn->ws_closing = 0;
+    conn->state = CONN_TERMINAL;
+    terminals_active++;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &conn->pipe };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->pipe.fd, &ev);
+    terminal_frames(conn);       // frames the client sent without waiting for the 101
+    conn_flush(conn);
+}
+
+// ---------- BATCHES ----------
+// POST /execute_batch runs several commands for one request. Each becomes an
+// ordinary buffered job, and the event loop keeps up to the batch's limit of
+// them in the worker pool, starting the next as each one completes. Results
+// come back as one JSON array in the order the commands were given, or with
+// stream=true as NDJSON lines in the order they finish.
+
+// Record a finished (or skipped, job NULL) command's result and free its output
+static void batch_result(struct connection *conn, int index, struct exec_job *job) {
+    struct batch *batch = conn->batch;
+    struct batch_command *cmd = &batch->commands[index];
+    struct outbuf line;
+    outbuf_init(&line, &conn->arena, SIZE_MAX);
+    outbuf_printf(&line, "{\"index\": %d, \"command\": \"", index);
+    json_escape(&line, cmd->command, strlen(cmd->command));
+    outbuf_append(&line, "\", ", 3);
+    if (job) {
+        append_result(&line, job);
+        outbuf_printf(&line, ", \"duration\": %.6f}", (metrics_now() - cmd->start_ns) / 1e9);
+        cmd->failed = job->status_count > 0 && job->status[job->status_count - 1] != 0;
+    } else {
+        static const char skipped[] = "\"output\": \"\", \"exit_code\": null, \"skipped\": true, \"duration\": 0}";
+        outbuf_append(&line, skipped, sizeof(skipped) - 1);
+        cmd->failed = 1;
+    }
+    cmd->state = BATCH_DONE;
+    cmd->result = line.data;
+    cmd->result_len = line.len;
+    arena_free(&cmd->arena);
+    batch->done++;
+
+    if (batch->stream) {
+        char size_line[24];
+        int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", line.len + 1);
+        conn_append(conn, size_line, n);
+        conn_append_arena(conn, line.data, line.len);
+        conn_append(conn, "\n\r\n", 3);
+    }
+}
+
+// Start every command that may run now, up to the limit. A command marked
+// after waits for the one before it and is skipped if that one failed.
+static void batch_schedule(struct connection *conn) {
+    struct batch *batch = conn->batch;
+    for (int i = 0; i < batch->count && batch->running < batch->limit; i++) {
+        struct batch_command *cmd = &batch->commands[i];
+        if (cmd->state != BATCH_WAITING) continue;
+        if (cmd->after && i > 0) {
+            struct batch_command *prev = &batch->commands[i - 1];
+            if (prev->state != BATCH_DONE) continue;
+            if (prev->failed) {
+                batch_result(conn, i, NULL);
+                continue;
+            }
+        }
+
+        struct exec_job *job = job_new(conn, EXEC_BUFFERED, batch->session);
+        job->command = cmd->command;
+        job->timeout_ms = batch->timeout_ms;
+        job->batch_index = i;
+        cmd->arena = (struct arena)ARENA_INIT;
+        outbuf_init(&job->out, &cmd->arena, output_limit);
+        // With the queue full this waits for one of our own to complete;
+        // batch_start() refuses the batch if none is running
+        if (job_push(job) == -1) break;
+        session_retain(batch->session);
+        cmd->state = BATCH_RUNNING;
+        cmd->start_ns = metrics_now();
+        batch->running++;
+    }
+}
+
+// Every command is done: finish the response
+static void batch_finish(struct connection *conn) {
+    struct batch *batch = conn->batch;
+    conn->batch = NULL;
+    if (batch->session) session_release(batch->session);
+    if (batch->stream) {
+        stream_finish(conn);
+        return;
+    }
+
+    struct outbuf body;
+    outbuf_init(&body, &conn->arena, SIZE_MAX);
+    outbuf_append(&body, "[", 1);
+    for (int i = 0; i < batch->count; i++) {
+        if (i > 0) outbuf_append(&body, ",\n", 2);
+        outbuf_append(&body, batch->commands[i].result, batch->commands[i].result_len);
+    }
+    outbuf_append(&body, "]", 1);
+    queue_headers(conn, 200, "OK", "application/json", "", body.len);
+    conn_append_arena(conn, body.data, body.len);
+    conn_flush(conn);
+}
+
+static void batch_complete(struct connection *conn, struct exec_job *job) {
+    struct batch *batch = conn->batch;
+    batch->running--;
+    if (conn->closing) {
+        arena_free(&batch->commands[job->batch_index].arena);
+        if (batch->running > 0) return;
+        if (batch->session) session_release(batch->session);
+        conn_free(conn);
+        return;
+    }
+
+    batch_result(conn, job->batch_index, job);
+    batch_schedule(conn);
+    if (batch->done == batch->count) batch_finish(conn);
+    else if (batch->stream) conn_flush(conn);
+}
+
+static void batch_start(struct connection *conn, struct batch *batch) {
+    conn->batch = batch;
+    batch_schedule(conn);
+    if (batch->running == 0) {
+        conn->batch = NULL;
+        if (batch->session) session_release(batch->session);
+        jobs_rejected++;
+        send_response(conn, 503, "Service Unavailable", "text/plain", "Server busy, try again");
+        return;
+    }
+
+    if (batch->stream) {
+        queue_headers(conn, 200, "OK", "application/x-ndjson",
+                      "Cache-Control: no-cache\r\nX-Content-Type-Options: nosniff\r\n", BODY_CHUNKED);
+        conn->state = CONN_STREAMING;
+        conn_flush(conn);
+    } else {
+        conn->state = CONN_EXECUTING;
+        conn_watch(conn);
+    }
+}
+
+// ---------- REQUEST HANDLING ----------
+
+// URL-decoded value of one form field in a body_len-byte body, copied into
+// the connection's arena; NULL if absent
+static char *form_value(struct connection *conn, const char *body, size_t body_len, const char *name) {
+    size_t name_len = strlen(name);
+    const char *field = body, *end = body + body_len;
+    while (field < end) {
+        const char *field_end = memchr(field, '&', end - field);
+        if (!field_end) field_end = end;
+        if ((size_t)(field_end - field) > name_len && strncmp(field, name, name_len) == 0 &&
+            field[name_len] == '=') {
+            const char *value = field + name_len + 1;
+            // Decoding never makes the value longer
+            size_t size = field_end - value + 1;
+            char *dst = arena_alloc(&conn->arena, size);
+            url_decode(dst, size, value, field_end - value);
+            return dst;
+        }
+        field = field_end + 1;
+    }
+    return NULL;
+}
+
+// The session named by the request's cookie, with a reference taken, or NULL
+static struct session *cookie_session(const struct http_request *req) {
+    size_t len = 0;
+    const char *cookies = http_header(req, "Cookie", &len);
+    const char *end = cookies ? cookies + len : NULL;
+    while (cookies < end) {
+        const char *item_end = memchr(cookies, ';', end - cookies);
+        if (!item_end) item_end = end;
+        while (cookies < item_end && *cookies == ' ') cookies++;
+        size_t name_len = sizeof(SESSION_COOKIE) - 1;
+        if ((size_t)(item_end - cookies) > name_len && memcmp(cookies, SESSION_COOKIE "=", name_len + 1) == 0)
+            return session_find(cookies + name_len + 1, item_end - cookies - name_len - 1);
+        cookies = item_end + 1;
+    }
+    return NULL;
+}
+
+// The session named by the request's cookie, or a new one whose cookie goes
+// out with the response. NULL (the server's own state) if none can be made.
+static struct session *request_session(struct connection *conn, const struct http_request *req) {
+    struct session *session = cookie_session(req);
+    if (session) return session;
+    session = session_create();
+    if (session) snprintf(conn->set_cookie, sizeof(conn->set_cookie), "%s", session_id(session));
+    return session;
+}
+
+// GET /jobs/<id>[?since=N]: a background job's state and its output from
+// byte N on; "next" is the N to ask for to get only newer output
+static void send_job(struct connection *conn, const struct http_request *req) {
+    const char *digits = http_text(req, req->path) + 6;
+    size_t digits_len = req->path.len - 6;
+    int id = 0;
+    for (size_t i = 0; i < digits_len && id >= 0; i++)
+        id = digits[i] >= '0' && digits[i] <= '9' && id < 100000000 ? id * 10 + (digits[i] - '0') : -1;
+    char *since = form_value(conn, http_text(req, req->query), req->query.len, "since");
+
+    struct outbuf output;
+    outbuf_init(&output, &conn->arena, SIZE_MAX);
+    struct job_info info;
+    struct session *session = cookie_session(req);
+    int found = id > 0 && shell_job_info(session, id, since ? strtoull(since, NULL, 10) : 0, &info, &output) == 0;
+    if (session) session_release(session);
+    if (!found) {
+        send_response(conn, 404, "Not Found", "application/json", "{\"error\": \"no such job\"}");
+        return;
+    }
+
+    struct outbuf body;
+    outbuf_init(&body, &conn->arena, SIZE_MAX);
+    outbuf_printf(&body, "{\"id\": %d, \"state\": \"%s\", \"pid\": %d, \"command\": \"", info.id,
+                  info.running ? "running" : "done", (int)info.pid);
+    json_escape(&body, info.command, strlen(info.command));
+    if (info.running) {
+        outbuf_printf(&body, "\", \"exit_code\": null, \"pipestatus\": [");
+    } else {
+        outbuf_printf(&body, "\", \"exit_code\": %d, \"pipestatus\": [", info.status[info.status_count - 1]);
+        for (int i = 0; i < info.status_count; i++)
+            outbuf_printf(&body, "%s%d", i ? ", " : "", info.status[i]);
+    }
+    outbuf_append(&body, "]", 1);
+    if (info.stop_reason) outbuf_printf(&body, ", \"killed\": \"%s\"", info.stop_reason);
+    outbuf_printf(&body, ", \"elapsed_ms\": %.3f, \"rusage\": {\"user_ms\": %.3f, \"sys_ms\": %.3f, "
+                  "\"max_rss_kb\": %lld}, \"offset\": %llu, \"next\": %llu, \"output\": \"",
+                  info.elapsed_ns / 1e6, info.usage.user_us / 1e3, info.usage.sys_us / 1e3,
+                  (long long)info.usage.max_rss_kb, (unsigned long long)info.output_start,
+                  (unsigned long long)info.output_end);
+    json_escape(&body, output.data, output.len);
+    outbuf_append(&body, "\"}", 2);
+    queue_headers(conn, 200, "OK", "application/json", "Cache-Control: no-cache\r\n", body.len);
+    conn_append_arena(conn, body.data, body.len);
+}
+
+#define COMPLETE_MAX 200           // matches /complete lists at most
+#define COMPLETE_HISTORY 10        // logged commands it suggests alongside
+#define HISTORY_MAX 5000           // commands /history returns at most
+
+// Append a JSON array of count strings
+static void json_strings(struct outbuf *body, char **items, int count) {
+    outbuf_append(body, "[", 1);
+    for (int i = 0; i < count; i++) {
+        outbuf_append(body, i ? ", \"" : "\"", i ? 3 : 1);
+        json_escape(body, items[i], strlen(items[i]));
+        outbuf_append(body, "\"", 1);
+    }
+    outbuf_append(body, "]", 1);
+}
+
+static void completions_reply(struct connection *conn, const struct completion *c, char **history, int found) {
+    struct outbuf body;
+    outbuf_init(&body, &conn->arena, SIZE_MAX);
+    outbuf_printf(&body, "{\"start\": %zu, \"kind\": \"%s\", \"matches\": ", c->start, c->files ? "file" : "command");
+    json_strings(&body, c->matches, c->count);
+    outbuf_printf(&body, ", \"more\": %s, \"history\": ", c->more ? "true" : "false");
+    json_strings(&body, history, found < COMPLETE_HISTORY ? found : COMPLETE_HISTORY);
+    outbuf_append(&body, "}", 1);
+    queue_headers(conn, 200, "OK", "application/json", "Cache-Control: no-cache\r\n", body.len);
+    conn_append_arena(conn, body.data, body.len);
+}
+
+static void history_reply(struct connection *conn, char **lines, int count) {
+    struct outbuf body;
+    outbuf_init(&body, &conn->arena, SIZE_MAX);
+    outbuf_append(&body, "{\"history\": ", 12);
+    json_strings(&body, lines, count);
+    outbuf_append(&body, "}", 1);
+    queue_headers(conn, 200, "OK", "application/json", "Cache-Control: no-cache\r\n", body.len);
+    conn_append_arena(conn, body.data, body.len);
+}
+
+// A lookup the event loop handed over, on a worker: the same calls, allowed
+// to read directories and open the log
+static void lookup_run(struct exec_job *job) {
+    struct arena *arena = &job->conn->arena;
+    if (job->mode == EXEC_COMPLETE) {
+        shell_complete(job->session, job->command, job->limit, arena, &job->completion);
+        job->line_count = job->session ? session_history_complete(job->session, job->command, COMPLETE_HISTORY, arena,
+                                                                  &job->lines) : 0;
+    } else {
+        job->line_count = job->session ? session_history_last(job->session, job->limit, arena, &job->lines) : 0;
+    }
+}
+
+static void lookup_reply(struct connection *conn, struct exec_job *job) {
+    if (job->mode == EXEC_COMPLETE) completions_reply(conn, &job->completion, job->lines, job->line_count);
+    else history_reply(conn, job->lines, job->line_count);
+}
+
+// Hand a lookup the caches could not answer to a worker
+static void submit_lookup(struct connection *conn, enum exec_mode mode, struct session *session, char *line, int limit) {
+    struct exec_job *job = job_new(conn, mode, session);
+    job->command = line;
+    job->limit = limit;
+    submit_job(job);
+}
+
+// GET /complete?line=L[&max=N]: completions of the last word of L, plus the
+// logged commands starting with the whole of L. Answered on the event loop
+// so it never waits behind a running command, as long as both lookups are
+// binary searches over cached, sorted lists. A directory or $PATH that must
+// be listed first, a log not opened yet, or a lock held by such a lookup
+// sends it to a worker instead.
+static void send_completions(struct connection *conn, const struct http_request *req) {
+    const char *query = http_text(req, req->query);
+    char *line = form_value(conn, query, req->query.len, "line");
+    char *max_text = form_value(conn, query, req->query.len, "max");
+    int max = max_text ? atoi(max_text) : 50;
+    if (max < 1 || max > COMPLETE_MAX) max = COMPLETE_MAX;
+    if (!line) line = "";
+
+    struct session *session = cookie_session(req);
+    struct completion c;
+    char **history = NULL;
+    int found = 0;
+    if (shell_complete_cached(session, line, max, &conn->arena, &c) == -1 ||
+        (session && (found = session_history_complete_cached(session, line, COMPLETE_HISTORY, &conn->arena, &history)) == -1)) {
+        submit_lookup(conn, EXEC_COMPLETE, session, line, max);
+        return;
+    }
+    if (session) session_release(session);
+    completions_reply(conn, &c, history, found);
+}
+
+// GET /history[?limit=N]: the session's last N commands, oldest first,
+// including those logged before a restart. Opening the log is a worker's job.
+static void send_history(struct connection *conn, const struct http_request *req) {
+    char *limit_text = form_value(conn, http_text(req, req->query), req->query.len, "limit");
+    int limit = limit_text ? atoi(limit_text) : 500;
+    if (limit < 1 || limit > HISTORY_MAX) limit = HISTORY_MAX;
+
+    struct session *session = cookie_session(req);
+    char **lines = NULL;
+    int count = session ? session_history_last_cached(session, limit, &conn->arena, &lines) : 0;
+    if (count == -1) {
+        submit_lookup(conn, EXEC_HISTORY, session, NULL, limit);
+        return;
+    }
+    if (session) session_release(session);
+    history_reply(conn, lines, count);
+}
+
+// GET /terminal?cols=C&rows=R with the WebSocket handshake: start a terminal
+// in the client's session. The 101 goes out once it is running.
+static void open_terminal(struct connection *conn, const struct http_request *req) {
+    size_t key_len = 0, version_len = 0, origin_len = 0, host_len = 0;
+    const char *key = http_header(req, "Sec-WebSocket-Key", &key_len);
+    const char *version = http_header(req, "Sec-WebSocket-Version", &version_len);
+    if (!http_header_lists(req, "Upgrade", "websocket") || !http_header_lists(req, "Connection", "upgrade") ||
+        !key || key_len != 24) {
+        send_response(conn, 400, "Bad Request", "text/plain", "WebSocket handshake expected");
+        return;
+    }
+    if (!version || version_len != 2 || memcmp(version, "13", 2) != 0) {
+        queue_response(conn, 426, "Upgrade Required", "text/plain", "Sec-WebSocket-Version: 13\r\n",
+                       "Unsupported WebSocket version", 29);
+        return;
+    }
+
+    // Any page may open a WebSocket to any host, cookies included, so only
+    // pages served from here get a shell
+    const char *origin = http_header(req, "Origin", &origin_len);
+    const char *host = http_header(req, "Host", &host_len);
+    if (origin) {
+        size_t scheme = origin_len > 7 && strncmp(origin, "http://", 7) == 0 ? 7
+                      : origin_len > 8 && strncmp(origin, "https://", 8) == 0 ? 8 : 0;
+        if (!scheme || !host || origin_len - scheme != host_len || strncasecmp(origin + scheme, host, host_len) != 0) {
+            send_response(conn, 403, "Forbidden", "text/plain", "Cross-origin terminal refused");
+            return;
+        }
+    }
+
+    const char *query = http_text(req, req->query);
+    char *cols = form_value(conn, query, req->query.len, "cols");
+    char *rows = form_value(conn, query, req->query.len, "rows");
+    struct exec_job *job = job_new(conn, EXEC_TERMINAL, request_session(conn, req));
+    job->cols = cols ? atoi(cols) : 80;
+    job->rows = rows ? atoi(rows) : 24;
+    if (job->cols < 1 || job->cols > 1000) job->cols = 80;
+    if (job->rows < 1 || job->rows > 1000) job->rows = 24;
+    ws_accept_key(key, key_len, job->accept);
+    submit_job(job);
+}
+
+// One command of a batch body: "cmd" or {"command": "cmd", "after": true}
+static int parse_batch_command(struct connection *conn, struct json_reader *r, struct batch_command *cmd) {
+    if (json_peek(r) == JSON_STRING) {
+        cmd->command = json_string(r, &conn->arena);
+        return cmd->command != NULL;
+    }
+    if (!json_enter(r, '{')) return 0;
+    for (int i = 0; json_next(r, '}', i); i++) {
+        char *key = json_key(r, &conn->arena);
+        if (key && strcmp(key, "command") == 0) cmd->command = json_string(r, &conn->arena);
+        else if (key && strcmp(key, "after") == 0) cmd->after = json_bool(r) == 1;
+        else json_skip(r);
+    }
+    return cmd->command != NULL && !r->failed;
+}
+
+static int parse_batch_commands(struct connection *conn, struct json_reader *r, struct batch *batch) {
+    if (!json_enter(r, '[')) return 0;
+    for (int i = 0; json_next(r, ']', i); i++) {
+        if (i == BATCH_MAX) return 0;
+        if (!parse_batch_command(conn, r, &batch->commands[i])) return 0;
+        batch->count++;
+    }
+    return !r->failed;
+}
+
+// POST /execute_batch body: an array of commands, or
+// {"commands": [...], "sequential": bool, "concurrency": n, "stream": bool,
+// "timeout": seconds}. A command is a string or {"command": ..., "after":
+// bool}; sequential marks them all as after. Returns an error message, or
+// NULL with batch filled in.
+static const char *parse_batch(struct connection *conn, const char *body, size_t len, struct batch *batch) {
+    struct json_reader r;
+    json_reader_init(&r, body, len);
+    memset(batch, 0, sizeof(*batch));
+    batch->commands = arena_alloc(&conn->arena, BATCH_MAX * sizeof(*batch->commands));
+    memset(batch->commands, 0, BATCH_MAX * sizeof(*batch->commands));
+    batch->limit = worker_count;
+
+    int sequential = 0;
+    if (json_peek(&r) == JSON_ARRAY) {
+        if (!parse_batch_commands(conn, &r, batch)) return "Expected up to 64 commands";
+    } else if (json_enter(&r, '{')) {
+        for (int i = 0; json_next(&r, '}', i); i++) {
+            char *key = json_key(&r, &conn->arena);
+            if (!key) break;
+            if (strcmp(key, "commands") == 0) {
+                if (!parse_batch_commands(conn, &r, batch)) return "Expected up to 64 commands";
+            } else if (strcmp(key, "sequential") == 0) {
+                sequential = json_bool(&r) == 1;
+            } else if (strcmp(key, "stream") == 0) {
+                batch->stream = json_bool(&r) == 1;
+            } else if (strcmp(key, "concurrency") == 0) {
+                double limit = json_number(&r);
+                if (limit >= 1 && limit < batch->limit) batch->limit = (int)limit;
+            } else if (strcmp(key, "timeout") == 0) {
+                double seconds = json_number(&r);
+                batch->timeout_ms = seconds > 0 ? (int64_t)(seconds * 1000) : 0;
             } else {
-                send_response(client_socket, 400, "Bad Request", "text/plain", "Missing command");
+                json_skip(&r);
             }
         }
+    }
+    if (!json_ok(&r)) return "Invalid JSON";
+    if (batch->count == 0) return "No commands";
+    if (sequential)
+        for (int i = 1; i < batch->count; i++) batch->commands[i].after = 1;
+    return NULL;
+}
+
+// Parse the request at the front of conn->in and answer it if it is complete.
+// Returns the number of bytes consumed, or 0 if the request is not complete yet.
+static size_t handle_request(struct connection *conn) {
+    struct http_request *req = &conn->req;
+    enum http_result result = http_parse(req, conn->in, conn->in_len);
+    if (result == HTTP_INCOMPLETE) {
+        // curl and others hold back large bodies until told to go ahead. Nothing
+        // else is queued while reading, so this can go straight to the socket.
+        if (req->expect_continue && !conn->continue_sent && http_in_body(req)) {
+            static const char go_ahead[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            conn->continue_sent = write(conn->watch.fd, go_ahead, sizeof(go_ahead) - 1) > 0;
+        }
+        return 0;
+    }
+    conn->request_ns = metrics_now();
+    conn->route = METRIC_REQUEST_OTHER;
+    if (result == HTTP_ERROR) {
+        // Whatever follows cannot be framed any more, so it is dropped with the connection
+        conn->keep_alive = 0;
+        send_response(conn, req->error, http_reason(req->error), "text/plain", http_reason(req->error));
+        return conn->in_len;
+    }
+
+    requests_handled++;
+    conn->keep_alive = req->keep_alive;
+
+    // Handle GET requests (serve frontend files)
+    if (http_span_is(req, req->method, "GET")) {
+        struct asset *asset = asset_find(http_text(req, req->path), req->path.len);
+        if (asset) {
+            conn->route = METRIC_REQUEST_STATIC;
+            send_asset(conn, asset, req);
+        } else if (http_span_is(req, req->path, "/status")) {
+            conn->route = METRIC_REQUEST_STATUS;
+            send_status(conn);
+        } else if (http_span_is(req, req->path, "/metrics")) {
+            conn->route = METRIC_REQUEST_METRICS;
+            send_metrics(conn);
+        } else if (req->path.len > 6 && strncmp(http_text(req, req->path), "/jobs/", 6) == 0) {
+            conn->route = METRIC_REQUEST_JOBS;
+            send_job(conn, req);
+        } else if (http_span_is(req, req->path, "/terminal")) {
+            conn->route = METRIC_REQUEST_TERMINAL;
+            open_terminal(conn, req);
+        } else if (http_span_is(req, req->path, "/complete")) {
+            conn->route = METRIC_REQUEST_COMPLETE;
+            send_completions(conn, req);
+        } else if (http_span_is(req, req->path, "/history")) {
+            conn->route = METRIC_REQUEST_HISTORY;
+            send_history(conn, req);
+        } else {
+            send_response(conn, 404, "Not Found", "text/plain", "Not found");
+        }
+    }
+    // Handle POST /execute for command execution
+    else if (http_span_is(req, req->method, "POST") && http_span_is(req, req->path, "/execute")) {
+        const char *body = http_text(req, req->body);
+        char *command = form_value(conn, body, req->body.len, "command");
+        conn->route = METRIC_REQUEST_EXECUTE;
+        if (command) {
+            char *stream = form_value(conn, body, req->body.len, "stream");
+            // timeout= (seconds) can only shorten the configured deadline
+            char *timeout = form_value(conn, body, req->body.len, "timeout");
+            double seconds = timeout ? strtod(timeout, NULL) : 0;
+            struct exec_job *job = job_new(conn, stream && strcmp(stream, "1") == 0 ? EXEC_STREAM : EXEC_BUFFERED,
+                                           request_session(conn, req));
+            job->command = command;
+            job->timeout_ms = seconds > 0 ? (int64_t)(seconds * 1000) : 0;
+            submit_job(job);
+        } else {
+            send_response(conn, 400, "Bad Request", "text/plain", "Missing command");
+        }
+    } else if (http_span_is(req, req->method, "POST") && http_span_is(req, req->path, "/execute_batch")) {
+        conn->route = METRIC_REQUEST_BATCH;
+        struct batch *batch = arena_alloc(&conn->arena, sizeof(*batch));
+        const char *error = parse_batch(conn, http_text(req, req->body), req->body.len, batch);
+        if (error) {
+            send_response(conn, 400, "Bad Request", "text/plain", error);
+        } else {
+            batch->session = request_session(conn, req);
+            batch_start(conn, batch);
+        }
     } else {
-        send_response(client_socket, 405, "Method Not Allowed", "text/plain", "Invalid request");
+        send_response(conn, 405, "Method Not Allowed", "text/plain", "Invalid request");
+    }
+
+    return req->length;
+}
+
+// Serve every complete request already buffered, stopping while a command runs.
+// Responses copy what they need from the request, so its bytes can go at once.
+static void process_input(struct connection *conn) {
+    while (conn->state == CONN_READING && conn->in_len > 0) {
+        size_t used = handle_request(conn);
+        if (used == 0) break;
+        memmove(conn->in, conn->in + used, conn->in_len - used);
+        conn->in_len -= used;
+        http_request_init(&conn->req, BUFFER_SIZE, body_limit);
+        conn->continue_sent = 0;
+    }
+}
+
+// Make room for a request that does not fit: exactly enough for a body of
+// known length, otherwise double. Fails once the request would be larger
+// than the header and body limits allow.
+static int conn_grow_input(struct connection *conn) {
+    size_t max = BUFFER_SIZE + body_limit + BUFFER_SIZE;   // slack for chunk framing
+    size_t cap = conn->in_cap * 2;
+    if (http_in_body(&conn->req) && !conn->req.chunked)
+        cap = conn->req.body.off + conn->req.content_length;
+    if (cap > max) cap = max;
+    if (cap <= conn->in_cap) return 0;
+    char *in = realloc(conn->in, cap);
+    if (!in) return 0;
+    conn->in = in;
+    conn->in_cap = cap;
+    return 1;
+}
+
+// Give back a buffer that grew for a large request once it is mostly idle
+static void conn_shrink_input(struct connection *conn) {
+    if (conn->in_cap == BUFFER_SIZE || conn->in_len > BUFFER_SIZE) return;
+    char *in = realloc(conn->in, BUFFER_SIZE);
+    if (!in) return;
+    conn->in = in;
+    conn->in_cap = BUFFER_SIZE;
+}
+
+// Mark n bytes of queued output as sent, stepping over finished segments
+static void conn_advance(struct connection *conn, size_t n) {
+    while (n > 0) {
+        struct out_segment *seg = &conn->segs[conn->seg_index];
+        size_t left = seg->len - conn->seg_sent;
+        if (n < left) {
+            conn->seg_sent += n;
+            return;
+        }
+        n -= left;
+        conn->seg_index++;
+        conn->seg_sent = 0;
+    }
+}
+
+// Push one batch of queued output to the socket: a writev() gathering every
+// memory segment up to the next file, or a sendfile() for a file segment.
+static ssize_t conn_send(struct connection *conn) {
+    struct out_segment *seg = &conn->segs[conn->seg_index];
+    if (seg->blob && seg->blob->fd >= 0) {
+        off_t offset = seg->offset + conn->seg_sent;
+        ssize_t n = sendfile(conn->watch.fd, seg->blob->fd, &offset, seg->len - conn->seg_sent);
+        if (n == 0) {            // file shrank under us; the response cannot be completed
+            errno = EIO;
+            return -1;
+        }
+        return n;
+    }
+
+    struct iovec iov[MAX_SEGMENTS];
+    int count = 0;
+    for (int i = conn->seg_index; i < conn->seg_count; i++, seg++) {
+        if (seg->blob && seg->blob->fd >= 0) break;
+        const char *base = seg->blob ? seg->blob->data : seg->base ? seg->base : conn->out;
+        size_t skip = i == conn->seg_index ? conn->seg_sent : 0;
+        iov[count].iov_base = (char *)base + seg->offset + skip;
+        iov[count].iov_len = seg->len - skip;
+        count++;
+    }
+    return writev(conn->watch.fd, iov, count);
+}
+
+// Write as much pending output as the socket accepts, resuming partial writes
+static void conn_flush(struct connection *conn) {
+    while (conn->seg_index < conn->seg_count) {
+        ssize_t n = conn_send(conn);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn_watch(conn);
+                return;
+            }
+            conn_close(conn);
+            return;
+        }
+        conn_advance(conn, n);
+    }
+
+    conn_reset_output(conn);
+    if (conn->state == CONN_TERMINAL && conn->ws_closing) {
+        // Input the client already sent would make close() reset the
+        // connection, and the close frame could be lost with it
+        char discard[4096];
+        for (int i = 0; i < 16 && read(conn->watch.fd, discard, sizeof(discard)) > 0; i++)
+            ;
+        conn_close(conn);
+        return;
+    }
+    if (conn->state == CONN_STREAMING || conn->state == CONN_TERMINAL) {
+        conn_watch(conn);        // everything sent: resume reading the pipe or terminal
+        return;
+    }
+    if (!conn->keep_alive) {
+        conn_close(conn);
+        return;
+    }
+
+    // Nothing refers to this request's memory any more
+    arena_reset(&conn->arena);
+    conn_shrink_input(conn);
+
+    // Pipelined requests may already be waiting in the input buffer
+    conn->state = CONN_READING;
+    process_input(conn);
+    if (conn->state == CONN_WRITING) conn_flush(conn);
+    else if (conn->state == CONN_READING && conn->peer_eof) conn_close(conn);
+    else if (conn->state == CONN_READING) conn_watch(conn);
+}
+
+static void conn_readable(struct connection *conn) {
+    while (1) {
+        if (conn->in_len == conn->in_cap) {
+            // Serve what is buffered first; only an incomplete request may grow it
+            process_input(conn);
+            if (conn->state != CONN_READING) break;
+            if (conn->in_len == conn->in_cap && !conn_grow_input(conn)) {
+                conn->keep_alive = 0;
+                send_response(conn, 413, "Payload Too Large", "text/plain", "Request too large");
+                conn->in_len = 0;
+                break;
+            }
+        }
+        ssize_t n = read(conn->watch.fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+        if (n > 0) {
+            conn->in_len += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0) {
+            conn_close(conn);
+            return;
+        }
+        // Half-close: still answer whatever was already sent
+        conn->peer_eof = 1;
+        break;
+    }
+
+    process_input(conn);
+    if (conn->state == CONN_WRITING) conn_flush(conn);
+    else if (conn->state == CONN_READING && conn->peer_eof) conn_close(conn);
+}
+
+static void accept_clients(int server_socket) {
+    while (1) {
+        int client_socket = accept4(server_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("accept");
+            return;
+        }
+
+        struct connection *conn = calloc(1, sizeof(*conn));
+        conn->watch.kind = WATCH_CLIENT;
+        conn->watch.fd = client_socket;
+        conn->state = CONN_READING;
+        conn->pipe = (struct watch){ WATCH_PIPE, -1 };
+        conn->proc.channel = -1;
+        conn->proc.pid_count = 0;
+        conn->in = malloc(BUFFER_SIZE);
+        conn->in_cap = BUFFER_SIZE;
+        http_request_init(&conn->req, BUFFER_SIZE, body_limit);
+        connections_active++;
+        metrics_count(METRIC_CONNECTIONS, 1);
+
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = &conn->watch };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev);
     }
 }
 
 int main() {
     int server_socket;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
+    struct sockaddr_in server_addr;
+
+    // Fork the command executor while this process is still small and single-threaded
+    if (executor_start() == -1)
+        fprintf(stderr, "Executor unavailable, spawning commands in-process (only without resource limits)\n");
+
+    // Clients that disconnect mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
 
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    // Caps buffered and streamed output alike; the old name still works
+    const char *limit = getenv("WEBSHELL_OUTPUT_LIMIT");
+    if (!limit) limit = getenv("WEBSHELL_STREAM_LIMIT");
+    if (limit) output_limit = strtoull(limit, NULL, 10);
+    limit = getenv("WEBSHELL_BODY_LIMIT");
+    if (limit) body_limit = strtoull(limit, NULL, 10);
+
+    server_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server_socket == -1) {
         perror("socket");
         exit(1);
@@ -166,24 +2008,83 @@ int main() {
         exit(1);
     }
 
-    if (listen(server_socket, 10) == -1) {
+    if (listen(server_socket, SOMAXCONN) == -1) {
         perror("listen");
         exit(1);
     }
 
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    completions.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd == -1 || completions.fd == -1) {
+        perror("epoll");
+        exit(1);
+    }
+
+    assets_init();
+
+    struct watch listener = { WATCH_LISTENER, server_socket };
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listener };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &ev);
+    ev.data.ptr = &completions;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, completions.fd, &ev);
+    if (asset_watch.fd != -1) {
+        ev.data.ptr = &asset_watch;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, asset_watch.fd, &ev);
+    }
+
+    start_workers();
+
     printf("Web Shell Server running on port %d\n", PORT);
     printf("Open http://localhost:%d in your browser\n", PORT);
+    printf("%d worker threads, queue capacity %d\n", worker_count, JOB_QUEUE_SIZE);
 
-    // Main loop: handle one request at a time
+    // Main loop: multiplex every connection; commands run on the worker pool
+    struct epoll_event events[MAX_EVENTS];
     while (1) {
-        int client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_len);
-        if (client_socket == -1) {
-            perror("accept");
-            continue;
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
         }
 
-        handle_client(client_socket);
-        close(client_socket);
+        // Completions are handled after the batch so a connection they close
+        // is never touched again by a later event in the same batch
+        int completed = 0;
+        for (int i = 0; i < n; i++) {
+            struct watch *w = events[i].data.ptr;
+            if (w->kind == WATCH_LISTENER) {
+                accept_clients(w->fd);
+            } else if (w->kind == WATCH_COMPLETIONS) {
+                completed = 1;
+            } else if (w->kind == WATCH_ASSETS) {
+                assets_changed();
+            } else if (w->kind == WATCH_REAPER) {
+                reaper_ready((struct reaper *)w);
+            } else if (w->kind == WATCH_PIPE) {
+                struct connection *conn = (struct connection *)((char *)w - offsetof(struct connection, pipe));
+                if (!conn->dead && conn->state == CONN_STREAMING) stream_readable(conn);
+                else if (!conn->dead && conn->state == CONN_TERMINAL) terminal_pty_ready(conn, events[i].events);
+            } else {
+                struct connection *conn = (struct connection *)w;
+                if (conn->dead) {
+                    continue;
+                } else if (conn->state == CONN_EXECUTING) {
+                    // Only errors/hangups are reported while a command runs
+                    conn_close(conn);
+                } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    conn_close(conn);
+                } else if (conn->state == CONN_WRITING || conn->state == CONN_STREAMING) {
+                    conn_flush(conn);
+                } else if (conn->state == CONN_TERMINAL) {
+                    terminal_client_ready(conn, events[i].events);
+                } else {
+                    conn_readable(conn);
+                }
+            }
+        }
+        if (completed) drain_completions();
+        free_dead_connections();
     }
 
     close(server_socket);
@@ -0,0 +1,565 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/random.h>
+#include "session.h"
+#include "history.h"
+
+#define SESSION_BUCKETS 1024             // power of two
+#define SESSION_DEFAULT_IDLE 3600.0      // seconds
+
+struct name_value {
+    char *name;
+    char *value;                 // NULL: a variable removed with unset
+};
+
+struct var_list {
+    struct name_value *items;
+    int count, cap;
+};
+
+struct session {
+    struct session *hash_next;
+    struct session *lru_prev, *lru_next;   // most recently used first
+    uint64_t hash;
+    int refs;                    // under table_lock, like the links above
+    long long last_used_ns;
+    char id[SESSION_ID_LEN + 1];
+    atomic_int returned;         // its cookie came back, so the client keeps it
+
+    pthread_mutex_t lock;        // guards everything below
+    int cwd_fd;
+    char cwd_path[PATH_MAX];
+    struct var_list vars, aliases;
+    char *history[SESSION_HISTORY];      // ring; entry n is history[n % SESSION_HISTORY]
+    unsigned long history_count;         // commands ever added
+    struct history *log;                 // persistent history, opened on first use; NULL if off
+    int log_opened;
+    int ended;                           // session_end(): out of the table, freed by the last release
+};
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+static struct session *buckets[SESSION_BUCKETS];
+static struct session lru = { .lru_prev = &lru, .lru_next = &lru };
+static struct session_stats stats;
+static long long idle_ns;
+
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+static struct session default_session = { .lock = PTHREAD_MUTEX_INITIALIZER, .cwd_fd = -1 };
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void table_init(void) {
+    const char *idle = getenv("WEBSHELL_SESSION_IDLE");
+    double seconds = idle ? strtod(idle, NULL) : SESSION_DEFAULT_IDLE;
+    idle_ns = (long long)((seconds > 0 ? seconds : SESSION_DEFAULT_IDLE) * 1e9);
+}
+
+// Ids are random, so their leading digits hash well enough as they are
+static int id_hash(const char *id, size_t len, uint64_t *hash) {
+    if (len != SESSION_ID_LEN) return -1;
+    uint64_t h = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = id[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (digit < 0) return -1;
+        if (i < 16) h = h << 4 | digit;
+    }
+    *hash = h;
+    return 0;
+}
+
+static void lru_unlink(struct session *s) {
+    s->lru_prev->lru_next = s->lru_next;
+    s->lru_next->lru_prev = s->lru_prev;
+}
+
+static void lru_push(struct session *s) {
+    s->lru_next = lru.lru_next;
+    s->lru_prev = &lru;
+    lru.lru_next->lru_prev = s;
+    lru.lru_next = s;
+}
+
+static void vars_clear(struct var_list *list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i].name);
+        free(list->items[i].value);
+    }
+    free(list->items);
+}
+
+static void session_free(struct session *s) {
+    if (s->cwd_fd >= 0) close(s->cwd_fd);
+    vars_clear(&s->vars);
+    vars_clear(&s->aliases);
+    for (int i = 0; i < SESSION_HISTORY; i++) free(s->history[i]);
+    history_close(s->log);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+// Take s out of the table (table_lock held)
+static void session_unlink(struct session *s) {
+    struct session **slot = &buckets[s->hash & (SESSION_BUCKETS - 1)];
+    while (*slot != s) slot = &(*slot)->hash_next;
+    *slot = s->hash_next;
+    lru_unlink(s);
+    stats.active--;
+}
+
+// Unlink s from the table and free it (table_lock held, no references left)
+static void session_remove(struct session *s) {
+    session_unlink(s);
+    session_free(s);
+}
+
+static struct session *session_new(const char *id);
+
+struct session *session_find(const char *id, size_t len) {
+    uint64_t hash;
+    pthread_once(&table_once, table_init);
+    if (id_hash(id, len, &hash) < 0) return NULL;
+
+    long long now = now_ns();
+    pthread_mutex_lock(&table_lock);
+    struct session *s = buckets[hash & (SESSION_BUCKETS - 1)];
+    while (s && (s->hash != hash || memcmp(s->id, id, len) != 0)) s = s->hash_next;
+    if (s && s->refs == 0 && now - s->last_used_ns > idle_ns) {
+        session_remove(s);
+        stats.expired++;
+        s = NULL;
+    }
+    if (s) {
+        s->refs++;
+        s->last_used_ns = now;
+        atomic_store_explicit(&s->returned, 1, memory_order_relaxed);
+        lru_unlink(s);
+        lru_push(s);
+    }
+    pthread_mutex_unlock(&table_lock);
+
+    // A session that expired or predates a restart comes back (in a fresh
+    // directory and environment) if it left a history log
+    char key[SESSION_ID_LEN + 1];
+    memcpy(key, id, SESSION_ID_LEN);
+    key[SESSION_ID_LEN] = '\0';
+    if (!s && history_exists(key)) s = session_new(key);
+    return s;
+}
+
+static void default_init(void) {
+    default_session.cwd_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!getcwd(default_session.cwd_path, sizeof(default_session.cwd_path)))
+        snprintf(default_session.cwd_path, sizeof(default_session.cwd_path), ".");
+}
+
+struct session *session_default(void) {
+    pthread_once(&default_once, default_init);
+    return &default_session;
+}
+
+// A session with the given id, or a random one if id is NULL
+static struct session *session_new(const char *id) {
+    pthread_once(&table_once, table_init);
+    struct session *s = calloc(1, sizeof(*s));
+    unsigned char bytes[SESSION_ID_LEN / 2];
+    if (!s || (!id && getrandom(bytes, sizeof(bytes), 0) != sizeof(bytes))) {
+        free(s);
+        return NULL;
+    }
+    if (id) {
+        memcpy(s->id, id, SESSION_ID_LEN);
+        s->returned = 1;
+    } else {
+        for (size_t i = 0; i < sizeof(bytes); i++)
+            sprintf(s->id + 2 * i, "%02x", bytes[i]);
+    }
+    id_hash(s->id, SESSION_ID_LEN, &s->hash);
+    pthread_mutex_init(&s->lock, NULL);
+    session_cwd_path(session_default(), s->cwd_path, sizeof(s->cwd_path));
+    s->cwd_fd = session_cwd(session_default());
+    s->refs = 1;
+
+    long long now = now_ns();
+    s->last_used_ns = now;
+    pthread_mutex_lock(&table_lock);
+    // Sweep expired sessions from the cold end, then make room if still full
+    for (struct session *old = lru.lru_prev, *prev; old != &lru; old = prev) {
+        prev = old->lru_prev;
+        if (old->refs == 0 && now - old->last_used_ns > idle_ns) {
+            session_remove(old);
+            stats.expired++;
+        } else if (now - old->last_used_ns <= idle_ns) {
+            break;
+        }
+    }
+    for (struct session *old = lru.lru_prev; stats.active >= SESSION_MAX && old != &lru; old = old->lru_prev) {
+        if (old->refs == 0) {
+            session_remove(old);
+            stats.evicted++;
+            break;
+        }
+    }
+    struct session **slot = &buckets[s->hash & (SESSION_BUCKETS - 1)];
+    if (id) {
+        // Another thread may have brought the same session back meanwhile
+        struct session *other = *slot;
+        while (other && memcmp(other->id, s->id, SESSION_ID_LEN) != 0) other = other->hash_next;
+        if (other) {
+            other->refs++;
+            pthread_mutex_unlock(&table_lock);
+            session_free(s);
+            return other;
+        }
+    }
+    s->hash_next = *slot;
+    *slot = s;
+    lru_push(s);
+    stats.active++;
+    stats.created++;
+    pthread_mutex_unlock(&table_lock);
+    return s;
+}
+
+struct session *session_create(void) {
+    return session_new(NULL);
+}
+
+void session_retain(struct session *s) {
+    if (!s || s == &default_session) return;
+    pthread_mutex_lock(&table_lock);
+    s->refs++;
+    pthread_mutex_unlock(&table_lock);
+}
+
+void session_release(struct session *s) {
+    if (!s || s == &default_session) return;
+    pthread_mutex_lock(&table_lock);
+    int gone = --s->refs == 0 && s->ended;
+    pthread_mutex_unlock(&table_lock);
+    if (gone) session_free(s);
+}
+
+void session_end(struct session *s) {
+    if (!s || s == &default_session) return;
+    pthread_mutex_lock(&table_lock);
+    if (!s->ended) session_unlink(s);
+    s->ended = 1;
+    pthread_mutex_unlock(&table_lock);
+
+    // Closed first, so a later command of this session cannot log to it
+    pthread_mutex_lock(&s->lock);
+    history_close(s->log);
+    s->log = NULL;
+    s->log_opened = 1;
+    pthread_mutex_unlock(&s->lock);
+    history_remove(s->id);
+}
+
+int session_ended(struct session *s) {
+    if (!s || s == &default_session) return 0;
+    pthread_mutex_lock(&table_lock);
+    int ended = s->ended;
+    pthread_mutex_unlock(&table_lock);
+    return ended;
+}
+
+const char *session_id(const struct session *s) {
+    return s->id;
+}
+
+// ---------- DIRECTORY ----------
+
+int session_cwd(struct session *s) {
+    pthread_mutex_lock(&s->lock);
+    int fd = fcntl(s->cwd_fd, F_DUPFD_CLOEXEC, 0);
+    pthread_mutex_unlock(&s->lock);
+    return fd;
+}
+
+int session_chdir(struct session *s, const char *path) {
+    pthread_mutex_lock(&s->lock);
+    int fd = openat(s->cwd_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1) {
+        char link[64];
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+        ssize_t n = readlink(link, s->cwd_path, sizeof(s->cwd_path) - 1);
+        if (n > 0) s->cwd_path[n] = '\0';
+        close(s->cwd_fd);
+        s->cwd_fd = fd;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return fd == -1 ? -1 : 0;
+}
+
+void session_cwd_path(struct session *s, char *buf, size_t size) {
+    pthread_mutex_lock(&s->lock);
+    snprintf(buf, size, "%s", s->cwd_path);
+    pthread_mutex_unlock(&s->lock);
+}
+
+// ---------- VARIABLES & ALIASES ----------
+
+static struct name_value *vars_find(struct var_list *list, const char *name) {
+    for (int i = 0; i < list->count; i++)
+        if (strcmp(list->items[i].name, name) == 0) return &list->items[i];
+    return NULL;
+}
+
+// Set name to a copy of value (NULL allowed), adding it if new
+static void vars_set(struct var_list *list, const char *name, const char *value) {
+    struct name_value *item = vars_find(list, name);
+    if (!item) {
+        if (list->count == list->cap) {
+            list->cap = list->cap ? list->cap * 2 : 8;
+            list->items = realloc(list->items, list->cap * sizeof(*list->items));
+        }
+        item = &list->items[list->count++];
+        item->name = strdup(name);
+    } else {
+        free(item->value);
+    }
+    item->value = value ? strdup(value) : NULL;
+}
+
+void session_setenv(struct session *s, const char *name, const char *value) {
+    pthread_mutex_lock(&s->lock);
+    vars_set(&s->vars, name, value);
+    pthread_mutex_unlock(&s->lock);
+}
+
+int session_has_env(struct session *s, const char *name) {
+    pthread_mutex_lock(&s->lock);
+    int found = vars_find(&s->vars, name) != NULL;
+    pthread_mutex_unlock(&s->lock);
+    return found;
+}
+
+int session_env(struct session *s, struct arena *arena, char ***vars) {
+    pthread_mutex_lock(&s->lock);
+    int count = s->vars.count;
+    *vars = arena_alloc(arena, (count + 1) * sizeof(char *));
+    for (int i = 0; i < count; i++) {
+        struct name_value *item = &s->vars.items[i];
+        size_t len = strlen(item->name) + (item->value ? strlen(item->value) + 1 : 0) + 1;
+        (*vars)[i] = arena_alloc(arena, len);
+        if (item->value) snprintf((*vars)[i], len, "%s=%s", item->name, item->value);
+        else memcpy((*vars)[i], item->name, len);
+    }
+    (*vars)[count] = NULL;
+    pthread_mutex_unlock(&s->lock);
+    return count;
+}
+
+void session_alias(struct session *s, const char *name, const char *value) {
+    pthread_mutex_lock(&s->lock);
+    vars_set(&s->aliases, name, value);
+    pthread_mutex_unlock(&s->lock);
+}
+
+int session_unalias(struct session *s, const char *name) {
+    pthread_mutex_lock(&s->lock);
+    struct name_value *item = vars_find(&s->aliases, name);
+    if (item) {
+        free(item->name);
+        free(item->value);
+        *item = s->aliases.items[--s->aliases.count];
+    }
+    pthread_mutex_unlock(&s->lock);
+    return item ? 0 : -1;
+}
+
+int session_print_aliases(struct session *s, const char *name, struct outbuf *out) {
+    int printed = 0;
+    pthread_mutex_lock(&s->lock);
+    for (int i = 0; i < s->aliases.count; i++) {
+        struct name_value *item = &s->aliases.items[i];
+        if (name && strcmp(item->name, name) != 0) continue;
+        outbuf_printf(out, "alias %s='%s'\n", item->name, item->value);
+        printed++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return printed;
+}
+
+char *session_expand_alias(struct session *s, char *line, struct arena *arena) {
+    char *word = line + strspn(line, " \t");
+    size_t len = strcspn(word, " \t;|&<>()");
+    if (len == 0) return line;
+
+    pthread_mutex_lock(&s->lock);
+    struct name_value *match = NULL;
+    for (int i = 0; i < s->aliases.count && !match; i++)
+        if (strlen(s->aliases.items[i].name) == len && memcmp(s->aliases.items[i].name, word, len) == 0)
+            match = &s->aliases.items[i];
+    if (match) {
+        size_t value_len = strlen(match->value), rest_len = strlen(word + len);
+        char *expanded = arena_alloc(arena, value_len + rest_len + 1);
+        memcpy(expanded, match->value, value_len);
+        memcpy(expanded + value_len, word + len, rest_len + 1);
+        line = expanded;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return line;
+}
+
+// ---------- HISTORY ----------
+// The ring serves the history built-in; the log (history.h) keeps every
+// command across restarts and answers completions. The default session has
+// no id and so no log: its completions come from the ring, as do those of a
+// session that has no log yet.
+
+// The session's log, opened on first use once the session's cookie has come
+// back (s->lock held). Clients that drop the cookie, like scripts calling
+// curl, get a session per request; they leave no files behind. A new log
+// starts with the commands the ring got before that.
+static struct history *session_log(struct session *s) {
+    if (s->log_opened || !s->id[0] || !atomic_load_explicit(&s->returned, memory_order_relaxed))
+        return s->log;
+    int fresh = !history_exists(s->id);
+    s->log = history_open(s->id);
+    s->log_opened = 1;
+    if (s->log && fresh) {
+        unsigned long end = s->history_count, start = end > SESSION_HISTORY ? end - SESSION_HISTORY : 0;
+        for (unsigned long i = start; i < end; i++)
+            history_add(s->log, s->history[i % SESSION_HISTORY]);
+    }
+    return s->log;
+}
+
+void session_history_add(struct session *s, const char *line) {
+    if (line[strspn(line, " \t\r\n")] == '\0') return;
+    char *copy = strdup(line);
+    pthread_mutex_lock(&s->lock);
+    struct history *log = session_log(s);
+    if (log) history_add(log, line);
+    char **slot = &s->history[s->history_count++ % SESSION_HISTORY];
+    free(*slot);
+    *slot = copy;
+    pthread_mutex_unlock(&s->lock);
+}
+
+struct collected {
+    struct arena *arena;
+    char **lines;
+    int count;
+};
+
+static void collect_line(const char *text, size_t len, void *arg) {
+    struct collected *c = arg;
+    char *line = arena_alloc(c->arena, len + 1);
+    memcpy(line, text, len);
+    line[len] = '\0';
+    c->lines[c->count++] = line;
+}
+
+static int compare_lines(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Take s->lock and return the session's log in *log. With cached_only, -1
+// instead of waiting for the lock or opening the log.
+static int history_lock(struct session *s, int cached_only, struct history **log) {
+    if (!cached_only) {
+        pthread_mutex_lock(&s->lock);
+    } else if (pthread_mutex_trylock(&s->lock) != 0) {
+        return -1;
+    } else if (!s->log_opened && s->id[0] && atomic_load_explicit(&s->returned, memory_order_relaxed)) {
+        pthread_mutex_unlock(&s->lock);
+        return -1;
+    }
+    *log = session_log(s);
+    return 0;
+}
+
+static int history_complete_in(struct session *s, const char *prefix, int max, struct arena *arena, char ***matches,
+                               int cached_only) {
+    struct history *log;
+    if (history_lock(s, cached_only, &log) == -1) return -1;
+    struct collected c = { arena, arena_alloc(arena, (max > 0 ? max : 1) * sizeof(char *)), 0 };
+    size_t len = strlen(prefix);
+    int found;
+    if (log) {
+        found = history_complete(log, prefix, len, max, collect_line, &c);
+    } else {
+        // Only the ring: sort its matches and drop repeats
+        unsigned long end = s->history_count, start = end > SESSION_HISTORY ? end - SESSION_HISTORY : 0;
+        char **all = arena_alloc(arena, (end - start + 1) * sizeof(char *));
+        int n = 0;
+        for (unsigned long i = start; i < end; i++)
+            if (strncmp(s->history[i % SESSION_HISTORY], prefix, len) == 0) all[n++] = s->history[i % SESSION_HISTORY];
+        qsort(all, n, sizeof(*all), compare_lines);
+        found = 0;
+        for (int i = 0; i < n && found <= max; i++) {
+            if (i > 0 && strcmp(all[i], all[i - 1]) == 0) continue;
+            if (found++ < max) collect_line(all[i], strlen(all[i]), &c);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    *matches = c.lines;
+    return found;
+}
+
+int session_history_complete(struct session *s, const char *prefix, int max, struct arena *arena, char ***matches) {
+    return history_complete_in(s, prefix, max, arena, matches, 0);
+}
+
+int session_history_complete_cached(struct session *s, const char *prefix, int max, struct arena *arena,
+                                    char ***matches) {
+    return history_complete_in(s, prefix, max, arena, matches, 1);
+}
+
+static int history_last_in(struct session *s, int count, struct arena *arena, char ***lines, int cached_only) {
+    struct history *log;
+    if (history_lock(s, cached_only, &log) == -1) return -1;
+    struct collected c = { arena, arena_alloc(arena, (count > 0 ? count : 1) * sizeof(char *)), 0 };
+    if (log) {
+        history_last(log, count, collect_line, &c);
+    } else {
+        unsigned long end = s->history_count, kept = end < SESSION_HISTORY ? end : SESSION_HISTORY;
+        unsigned long n = count > 0 && (unsigned long)count < kept ? (unsigned long)count : kept;
+        for (unsigned long i = end - n; i < end; i++)
+            collect_line(s->history[i % SESSION_HISTORY], strlen(s->history[i % SESSION_HISTORY]), &c);
+    }
+    pthread_mutex_unlock(&s->lock);
+    *lines = c.lines;
+    return c.count;
+}
+
+int session_history_last(struct session *s, int count, struct arena *arena, char ***lines) {
+    return history_last_in(s, count, arena, lines, 0);
+}
+
+int session_history_last_cached(struct session *s, int count, struct arena *arena, char ***lines) {
+    return history_last_in(s, count, arena, lines, 1);
+}
+
+void session_print_history(struct session *s, int count, struct outbuf *out) {
+    pthread_mutex_lock(&s->lock);
+    unsigned long end = s->history_count;
+    unsigned long kept = end < SESSION_HISTORY ? end : SESSION_HISTORY;
+    unsigned long start = end - (count > 0 && (unsigned long)count < kept ? (unsigned long)count : kept);
+    for (unsigned long n = start; n < end; n++)
+        outbuf_printf(out, "%5lu  %s\n", n + 1, s->history[n % SESSION_HISTORY]);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void session_stats(struct session_stats *out) {
+    pthread_mutex_lock(&table_lock);
+    *out = stats;
+    pthread_mutex_unlock(&table_lock);
+}
@@ -0,0 +1,105 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Per-client shell state: a working directory held as a directory fd, the
+// variables exported in the session, aliases and command history. The
+// server keys sessions by a random cookie. Commands run against the session
+// bound to their thread (shell_use_session() in shell.h), so clients never
+// see each other's cd or export and can run on separate cores at once.
+// Sessions idle for WEBSHELL_SESSION_IDLE seconds (default 3600) expire;
+// past SESSION_MAX the least recently used idle one is dropped. Once a client
+// sends its cookie back, commands are also logged to disk (history.h), and a
+// cookie whose session expired or predates a restart gets a new session that
+// keeps that log. Thread-safe.
+
+#define SESSION_ID_LEN 32        // hex digits in a session id
+#define SESSION_MAX 1024
+#define SESSION_HISTORY 1000     // commands remembered per session
+
+struct session;
+
+// The session with this id, with a reference taken, or NULL if there is
+// none (unknown or expired)
+struct session *session_find(const char *id, size_t len);
+
+// A new session in the server's directory and environment, with a reference
+// taken
+struct session *session_create(void);
+
+// Session used when none is bound: the server's own directory and
+// environment. Never expires and needs no reference.
+struct session *session_default(void);
+
+// Another reference to a session already held, e.g. for each command of a
+// batch
+void session_retain(struct session *s);
+void session_release(struct session *s);
+
+// End a session for good (the shell's exit): its id finds nothing from now
+// on and its history log is deleted, so the cookie cannot bring it back.
+// Commands still holding a reference keep it until they release it.
+void session_end(struct session *s);
+int session_ended(struct session *s);
+
+// NUL-terminated id, for the cookie
+const char *session_id(const struct session *s);
+
+// Private copy of the session's directory fd; the caller closes it
+int session_cwd(struct session *s);
+
+// Move the session to path (relative to its current directory)
+int session_chdir(struct session *s, const char *path);
+
+// Absolute path of the session's directory
+void session_cwd_path(struct session *s, char *buf, size_t size);
+
+// Variables set with export, layered over the server's environment. An
+// override with a NULL value hides the server's variable.
+void session_setenv(struct session *s, const char *name, const char *value);
+int session_has_env(struct session *s, const char *name);
+
+// The overrides as "NAME=value" strings, or "NAME" for removed ones, copied
+// into arena. Returns the count.
+int session_env(struct session *s, struct arena *arena, char ***vars);
+
+// Aliases expand the first word of a command line
+void session_alias(struct session *s, const char *name, const char *value);
+int session_unalias(struct session *s, const char *name);
+// Append alias definitions: every one, or only name's. Returns how many.
+int session_print_aliases(struct session *s, const char *name, struct outbuf *out);
+
+// line with its first word replaced if that is an alias (copied into
+// arena), or line itself
+char *session_expand_alias(struct session *s, char *line, struct arena *arena);
+
+void session_history_add(struct session *s, const char *line);
+
+// Append the last count commands (all if count <= 0), numbered from 1
+void session_print_history(struct session *s, int count, struct outbuf *out);
+
+// Distinct commands from the session's persistent history (history.h) that
+// start with prefix, in byte order: up to max of them, copied into arena.
+// Returns how many match, counting no further than max + 1.
+int session_history_complete(struct session *s, const char *prefix, int max, struct arena *arena, char ***matches);
+
+// The session's last count commands, oldest first, copied into arena.
+// Returns how many there are.
+int session_history_last(struct session *s, int count, struct arena *arena, char ***lines);
+
+// The two above without blocking: -1 if the log is not open yet or another
+// thread holds the session
+int session_history_complete_cached(struct session *s, const char *prefix, int max, struct arena *arena,
+                                    char ***matches);
+int session_history_last_cached(struct session *s, int count, struct arena *arena, char ***lines);
+
+struct session_stats {
+    int active;
+    unsigned long created, expired, evicted;
+};
+
+void session_stats(struct session_stats *stats);
+
+#endif
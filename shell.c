@@ -1,103 +1,484 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <time.h>
+#include <stdint.h>
+#include <errno.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include "shell.h"
+#include "builtins.h"
+#include "lexer.h"
+#include "builtin_hash.h"
+#include "textscan.h"
+#include "result_cache.h"
+#include "session.h"
+#include "metrics.h"
 
 #define BUFFER_SIZE 4096
-#define MAX_ARGS 100
+
+// ---------- SHELL STATE ----------
+// Commands run concurrently on the server's worker threads, so nothing here may
+// depend on the process-wide cwd or on shared libc state such as rand().
+
+// Session of the calling thread's command (session.h). Without one, commands
+// share the server's own directory and environment.
+static __thread struct session *current_session;
+
+void shell_use_session(struct session *session) {
+    current_session = session;
+}
+
+static struct session *shell_session(void) {
+    return current_session ? current_session : session_default();
+}
+
+// Private copy of the session's cwd fd; the caller closes it when done
+static int cwd_acquire(void) {
+    return session_cwd(shell_session());
+}
+
+// PIPESTATUS of the calling thread's last command
+static __thread int last_status[MAX_STAGES];
+static __thread int last_status_count;
+
+// Per-thread PRNG so concurrent roll/joke calls never share state
+static unsigned int thread_random(void) {
+    static __thread unsigned int seed;
+    if (seed == 0)
+        seed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)pthread_self();
+    return (unsigned int)rand_r(&seed);
+}
+
+// ---------- PATH CACHE ----------
+// Like bash's hash table: remembers where each external command was found on
+// $PATH so repeat requests skip the directory walk and spawn the absolute
+// path directly. The table is flushed when $PATH changes or when one of its
+// directories is modified; directory mtimes are rechecked at most once per
+// PATH_CACHE_RECHECK_NS so hits stay free of system calls.
+
+#define PATH_CACHE_SIZE 256          // slots, power of two
+#define PATH_CACHE_MAX_DIRS 64
+#define PATH_CACHE_RECHECK_NS 1000000000LL
+
+struct path_entry {
+    char name[64];
+    char path[256];
+    unsigned long hits;
+    long long lookup_ns;             // cost of the PATH walk that found it
+};
+
+static pthread_mutex_t path_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct path_entry path_table[PATH_CACHE_SIZE];
+static int path_entries;
+static char path_value[4096];        // $PATH the table was built for
+static struct timespec path_dir_mtimes[PATH_CACHE_MAX_DIRS];
+static long long path_checked_ns;
+static struct path_cache_stats path_stats;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint32_t path_name_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h;
+}
+
+// Call fn(dir, len, index) for each directory of $PATH
+static void path_each_dir(const char *path, void (*fn)(const char *, size_t, int, void *), void *arg) {
+    int index = 0;
+    while (index < PATH_CACHE_MAX_DIRS) {
+        size_t len = strcspn(path, ":");
+        fn(path, len, index++, arg);
+        if (path[len] == '\0') break;
+        path += len + 1;
+    }
+}
+
+static void dir_mtime(const char *dir, size_t len, int index, void *arg) {
+    struct timespec *mtimes = arg;
+    char name[PATH_MAX];
+    struct stat st;
+    snprintf(name, sizeof(name), "%.*s", (int)len, dir);
+    if (len == 0 || stat(name, &st) == -1)
+        mtimes[index] = (struct timespec){ 0 };
+    else
+        mtimes[index] = st.st_mtim;
+}
+
+// Every executable name on $PATH, sorted, for completing command names.
+// Listed on first use and dropped along with the table.
+static char **path_names;
+static int path_name_count;
+
+static void path_cache_clear(void) {
+    memset(path_table, 0, sizeof(path_table));
+    path_entries = 0;
+    for (int i = 0; i < path_name_count; i++) free(path_names[i]);
+    free(path_names);
+    path_names = NULL;
+    path_name_count = 0;
+}
+
+// Flush the table if $PATH or one of its directories changed (path_lock held)
+static void path_cache_validate(void) {
+    const char *path = getenv("PATH");
+    if (!path) path = "/usr/local/bin:/usr/bin:/bin";
+
+    if (strcmp(path, path_value) != 0) {
+        snprintf(path_value, sizeof(path_value), "%s", path);
+        memset(path_dir_mtimes, 0, sizeof(path_dir_mtimes));
+        path_each_dir(path_value, dir_mtime, path_dir_mtimes);
+        path_checked_ns = monotonic_ns();
+        path_cache_clear();
+        return;
+    }
+
+    long long now = monotonic_ns();
+    if (now - path_checked_ns < PATH_CACHE_RECHECK_NS) return;
+    path_checked_ns = now;
+
+    struct timespec mtimes[PATH_CACHE_MAX_DIRS] = { 0 };
+    path_each_dir(path_value, dir_mtime, mtimes);
+    if (memcmp(mtimes, path_dir_mtimes, sizeof(mtimes)) != 0) {
+        memcpy(path_dir_mtimes, mtimes, sizeof(mtimes));
+        path_cache_clear();
+    }
+}
+
+struct path_search {
+    const char *name;
+    char *result;
+    size_t size;
+    int found;
+    int relative;                    // found through a cwd-relative entry
+};
+
+static void search_dir(const char *dir, size_t len, int index, void *arg) {
+    (void)index;
+    struct path_search *search = arg;
+    if (search->found) return;
+
+    char candidate[PATH_MAX];
+    snprintf(candidate, sizeof(candidate), "%.*s%s%s", (int)len, dir, len ? "/" : "", search->name);
+    struct stat st;
+    if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0) {
+        search->found = 1;
+        search->relative = len == 0 || dir[0] != '/';
+        snprintf(search->result, search->size, "%s", candidate);
+    }
+}
+
+// Slot holding name, or the empty slot where it would go
+static struct path_entry *path_slot(const char *name) {
+    uint32_t i = path_name_hash(name) & (PATH_CACHE_SIZE - 1);
+    while (path_table[i].name[0] && strcmp(path_table[i].name, name) != 0)
+        i = (i + 1) & (PATH_CACHE_SIZE - 1);
+    return &path_table[i];
+}
+
+// Resolve a command name to an absolute path. Returns 0 and fills out on
+// success, -1 if name is not on $PATH or cannot be cached (it contains a
+// slash, is too long, or was found through a relative $PATH entry); the
+// caller then leaves the lookup to posix_spawnp().
+int path_cache_lookup(const char *name, char *out, size_t size) {
+    if (strchr(name, '/') || strlen(name) >= sizeof(path_table[0].name)) return -1;
+
+    pthread_mutex_lock(&path_lock);
+    path_cache_validate();
+    struct path_entry *entry = path_slot(name);
+    if (entry->name[0]) {
+        entry->hits++;
+        path_stats.hits++;
+        path_stats.saved_ns += entry->lookup_ns;
+        snprintf(out, size, "%s", entry->path);
+        pthread_mutex_unlock(&path_lock);
+        return 0;
+    }
+
+    // Walk $PATH without the lock; a racing insert of the same name is harmless
+    char dirs[sizeof(path_value)];
+    memcpy(dirs, path_value, sizeof(dirs));
+    pthread_mutex_unlock(&path_lock);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char found[PATH_MAX];
+    struct path_search search = { name, found, sizeof(found), 0, 0 };
+    path_each_dir(dirs, search_dir, &search);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pthread_mutex_lock(&path_lock);
+    path_stats.misses++;
+    int cacheable = search.found && !search.relative && strlen(found) < sizeof(entry->path);
+    entry = path_slot(name);
+    if (cacheable && !entry->name[0] && path_entries < PATH_CACHE_SIZE * 3 / 4) {
+        snprintf(entry->name, sizeof(entry->name), "%s", name);
+        memcpy(entry->path, found, strlen(found) + 1);   // length checked above
+        entry->lookup_ns = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+        path_entries++;
+    }
+    pthread_mutex_unlock(&path_lock);
+
+    if (!cacheable) return -1;
+    snprintf(out, size, "%s", found);
+    return 0;
+}
+
+void path_cache_stats(struct path_cache_stats *stats) {
+    pthread_mutex_lock(&path_lock);
+    *stats = path_stats;
+    stats->entries = path_entries;
+    pthread_mutex_unlock(&path_lock);
+}
+
+struct name_list {
+    char **names;
+    int count, cap;
+};
+
+static void list_executables(const char *dir, size_t len, int index, void *arg) {
+    (void)index;
+    struct name_list *list = arg;
+    // Relative entries would depend on the session's directory
+    if (len == 0 || dir[0] != '/') return;
+    char name[PATH_MAX];
+    snprintf(name, sizeof(name), "%.*s", (int)len, dir);
+    DIR *d = opendir(name);
+    if (!d) return;
+    struct dirent *entry;
+    while ((entry = readdir(d))) {
+        struct stat st;
+        if (entry->d_name[0] == '.' || fstatat(dirfd(d), entry->d_name, &st, 0) == -1 ||
+            !S_ISREG(st.st_mode) || !(st.st_mode & 0111))
+            continue;
+        if (list->count == list->cap) {
+            list->cap = list->cap ? list->cap * 2 : 1024;
+            list->names = realloc(list->names, list->cap * sizeof(char *));
+        }
+        list->names[list->count++] = strdup(entry->d_name);
+    }
+    closedir(d);
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// List $PATH's executables if the table was flushed since (path_lock held)
+static void path_names_load(void) {
+    path_cache_validate();
+    if (path_names) return;
+    struct name_list list = { 0 };
+    path_each_dir(path_value, list_executables, &list);
+    qsort(list.names, list.count, sizeof(char *), compare_names);
+    int unique = 0;
+    for (int i = 0; i < list.count; i++) {
+        if (unique > 0 && strcmp(list.names[unique - 1], list.names[i]) == 0) free(list.names[i]);
+        else list.names[unique++] = list.names[i];
+    }
+    path_names = list.names ? list.names : calloc(1, sizeof(char *));
+    path_name_count = unique;
+}
 
 // ---------- BUILT-IN COMMANDS ----------
+static void record_status(int code);
+static void execute_system_command(char **args, struct outbuf *out, struct arena *arena);
+static void jobs_hangup(const char *owner);
+
+// Handlers follow builtin_fn in builtins.h; the registry is in builtins.def.
 
 // date
-void date_cmd(char *output, size_t size) {
+void date_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv, (void)args;
     time_t t = time(NULL);
-    snprintf(output, size, "Current Date & Time: %s", ctime(&t));
+    char when[32];
+    outbuf_printf(out, "Current Date & Time: %s", ctime_r(&t, when));
 }
 
 // echo
-void echo_cmd(char *input, char *output, size_t size) {
-    char *text = input + 5; // skip "echo "
-    snprintf(output, size, "%s\n", text);
+void echo_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv;
+    outbuf_printf(out, "%s\n", args);
 }
 
 // pwd
-void pwd_cmd(char *output, size_t size) {
-    char cwd[BUFFER_SIZE];
-    if (getcwd(cwd, sizeof(cwd)) != NULL)
-        snprintf(output, size, "%s\n", cwd);
+void pwd_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv, (void)args;
+    char path[PATH_MAX];
+    session_cwd_path(shell_session(), path, sizeof(path));
+    outbuf_printf(out, "%s\n", path);
+}
+
+// cd
+void cd_cmd(int argc, char **argv, char *path, struct outbuf *out) {
+    (void)argc, (void)argv;
+    if (session_chdir(shell_session(), path) == 0)
+        outbuf_printf(out, "Directory changed to: %s\n", path);
     else
-        snprintf(output, size, "Error: could not get current directory\n");
+        outbuf_printf(out, "Error: No such directory: %s\n", path);
 }
 
 // mkdir
-void mkdir_cmd(char *input, char *output, size_t size) {
-    char *dirname = input + 6;
-    if (strlen(dirname) == 0)
-        snprintf(output, size, "Usage: mkdir <directory_name>\n");
-    else if (mkdir(dirname, 0755) == 0)
-        snprintf(output, size, "Directory '%s' created successfully.\n", dirname);
+void mkdir_cmd(int argc, char **argv, char *dirname, struct outbuf *out) {
+    (void)argc, (void)argv;
+    int dir = cwd_acquire();
+    if (mkdirat(dir, dirname, 0755) == 0)
+        outbuf_printf(out, "Directory '%s' created successfully.\n", dirname);
     else
-        snprintf(output, size, "Error: could not create directory '%s'.\n", dirname);
+        outbuf_printf(out, "Error: could not create directory '%s'.\n", dirname);
+    close(dir);
 }
 
 // touch
-void touch_cmd(char *input, char *output, size_t size) {
-    char *filename = input + 6;
-    if (strlen(filename) == 0) {
-        snprintf(output, size, "Usage: touch <file_name>\n");
-        return;
-    }
-
-    int fd = open(filename, O_CREAT | O_WRONLY, 0644);
+void touch_cmd(int argc, char **argv, char *filename, struct outbuf *out) {
+    (void)argc, (void)argv;
+    int dir = cwd_acquire();
+    int fd = openat(dir, filename, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+    close(dir);
     if (fd == -1)
-        snprintf(output, size, "Error: could not create file '%s'.\n", filename);
+        outbuf_printf(out, "Error: could not create file '%s'.\n", filename);
     else {
         close(fd);
-        snprintf(output, size, "File '%s' created successfully.\n", filename);
+        outbuf_printf(out, "File '%s' created successfully.\n", filename);
     }
 }
 
-// cat
-void cat_cmd(char *input, char *output, size_t size) {
-    char *filename = input + 4;
-    FILE *file = fopen(filename, "r");
+// Whether name can be a variable or alias name
+static int valid_name(const char *name, size_t len) {
+    if (len == 0 || (name[0] >= '0' && name[0] <= '9')) return 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+            return 0;
+    }
+    return 1;
+}
 
-    if (!file) {
-        snprintf(output, size, "Error: could not open file '%s'.\n", filename);
+// export NAME=value ...: set variables for the session's later commands
+void export_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    struct session *session = shell_session();
+    if (argc == 1) {
+        struct arena scratch = ARENA_INIT;
+        char **vars;
+        int count = session_env(session, &scratch, &vars);
+        for (int i = 0; i < count; i++) {
+            char *eq = strchr(vars[i], '=');
+            if (eq) outbuf_printf(out, "export %.*s='%s'\n", (int)(eq - vars[i]), vars[i], eq + 1);
+        }
+        arena_free(&scratch);
         return;
     }
+    for (int i = 1; i < argc; i++) {
+        char *eq = strchr(argv[i], '=');
+        size_t len = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+        if (!valid_name(argv[i], len)) {
+            outbuf_printf(out, "export: `%s': not a valid identifier\n", argv[i]);
+            record_status(1);
+        } else if (eq) {
+            *eq = '\0';
+            session_setenv(session, argv[i], eq + 1);
+            *eq = '=';
+        }
+    }
+}
 
-    output[0] = '\0';
-    char line[256];
-    while (fgets(line, sizeof(line), file)) {
-        if (strlen(output) + strlen(line) < size)
-            strcat(output, line);
-        else
-            break;
+// unset NAME ...
+void unset_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    for (int i = 1; i < argc; i++) {
+        if (valid_name(argv[i], strlen(argv[i]))) {
+            session_setenv(shell_session(), argv[i], NULL);
+        } else {
+            outbuf_printf(out, "unset: `%s': not a valid identifier\n", argv[i]);
+            record_status(1);
+        }
+    }
+}
+
+// alias [name[=value] ...]
+void alias_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    struct session *session = shell_session();
+    if (argc == 1) session_print_aliases(session, NULL, out);
+    for (int i = 1; i < argc; i++) {
+        char *eq = strchr(argv[i], '=');
+        if (!eq) {
+            if (session_print_aliases(session, argv[i], out) == 0) {
+                outbuf_printf(out, "alias: %s: not found\n", argv[i]);
+                record_status(1);
+            }
+        } else if (!valid_name(argv[i], eq - argv[i])) {
+            outbuf_printf(out, "alias: `%s': invalid alias name\n", argv[i]);
+            record_status(1);
+        } else {
+            *eq = '\0';
+            session_alias(session, argv[i], eq + 1);
+            *eq = '=';
+        }
+    }
+}
+
+// unalias name ...
+void unalias_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    for (int i = 1; i < argc; i++) {
+        if (session_unalias(shell_session(), argv[i]) == -1) {
+            outbuf_printf(out, "unalias: %s: not found\n", argv[i]);
+            record_status(1);
+        }
     }
-    fclose(file);
+}
+
+// history [N]
+void history_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    session_print_history(shell_session(), argc > 1 ? atoi(argv[1]) : 0, out);
 }
 
 // greet
-void greet_cmd(char *input, char *output, size_t size) {
-    char *name = strchr(input, ' ');
-    if (name) name++;
-    snprintf(output, size, "Hello, %s! Welcome to Mini Linux Shell!\n", name ? name : "User");
+void greet_cmd(int argc, char **argv, char *name, struct outbuf *out) {
+    (void)argv;
+    outbuf_printf(out, "Hello, %s! Welcome to Mini Linux Shell!\n", argc > 1 ? name : "User");
 }
 
 // roll
-void roll_cmd(char *output, size_t size) {
-    int roll = (rand() % 6) + 1;
-    snprintf(output, size, "🎲 You rolled a %d!\n", roll);
+void roll_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv, (void)args;
+    int roll = (thread_random() % 6) + 1;
+    outbuf_printf(out, "🎲 You rolled a %d!\n", roll);
 }
 
 // joke
-void joke_cmd(char *output, size_t size) {
+void joke_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv, (void)args;
     const char *jokes[] = {
         "💻 Why did the computer get cold? Because it left its Windows open!",
         "😂 Debugging: Being the detective in a crime movie where you are also the murderer.",
@@ -105,109 +486,52 @@ void joke_cmd(char *output, size_t size) {
         "😅 I would tell you a UDP joke... but you might not get it.",
         "😜 I told my computer I needed a break, and it said: 'You seem stressed, shall I crash?'"
     };
-    int n = rand() % 5;
-    snprintf(output, size, "%s\n", jokes[n]);
+    int n = thread_random() % 5;
+    outbuf_printf(out, "%s\n", jokes[n]);
 }
 
-// ---------- CORE SHELL LOGIC ----------
-
-// Split input into arguments
-void parse_input(char *input, char **args) {
-    for (int i = 0; i < MAX_ARGS; i++) args[i] = NULL;
-    char *token = strtok(input, " \t\n");
-    int i = 0;
-    while (token && i < MAX_ARGS - 1)
-        args[i++] = token, token = strtok(NULL, " \t\n");
-    args[i] = NULL;
-}
-
-// Execute external Linux command and capture output
-void execute_system_command(char **args, char *output, size_t size, int background) {
-    int fd[2];
-    pipe(fd);
-    pid_t pid = fork();
-
-    if (pid < 0) {
-        perror("fork failed");
+// hash [-r] [name...]
+void hash_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+        pthread_mutex_lock(&path_lock);
+        path_cache_clear();
+        pthread_mutex_unlock(&path_lock);
+        outbuf_printf(out, "Command hash table cleared.\n");
         return;
-    } 
-    else if (pid == 0) {
-        // Child process
-        close(fd[0]);
-        dup2(fd[1], STDOUT_FILENO);
-        dup2(fd[1], STDERR_FILENO);
-        close(fd[1]);
-        execvp(args[0], args);
-        perror("exec failed");
-        exit(1);
-    } 
-    else {
-        // Parent process
-        close(fd[1]);
-        int n = read(fd[0], output, size - 1);
-        if (n > 0) output[n] = '\0';
-        else snprintf(output, size, "Command executed successfully (no output).\n");
-        close(fd[0]);
-        if (!background)
-            waitpid(pid, NULL, 0);
-    }
-}
-
-// Handle piping or redirection
-void handle_redirection_and_piping(char *input, char *output, size_t size) {
-    int fd[2];
-    pipe(fd);
-    pid_t pid = fork();
-
-    if (pid == 0) {
-        close(fd[0]);
-        dup2(fd[1], STDOUT_FILENO);
-        dup2(fd[1], STDERR_FILENO);
-        close(fd[1]);
-        execl("/bin/sh", "sh", "-c", input, NULL);
-        perror("exec failed");
-        exit(1);
-    } else {
-        close(fd[1]);
-        int n = read(fd[0], output, size - 1);
-        if (n > 0)
-            output[n] = '\0';
-        else
-            snprintf(output, size, "");
-        close(fd[0]);
-        waitpid(pid, NULL, 0);
     }
-}
-
-// ---------- MAIN EXECUTION FUNCTION ----------
-
-int execute_shell_command(char *input, char *output, size_t output_size) {
-    memset(output, 0, output_size);
-    srand(time(NULL));
 
-    if (strlen(input) == 0) {
-        snprintf(output, output_size, "No command entered.\n");
-        return 0;
+    // hash name...: look the names up now, as bash does
+    if (argc > 1) {
+        char path[PATH_MAX];
+        for (int i = 1; i < argc; i++) {
+            if (path_cache_lookup(argv[i], path, sizeof(path)) == -1) {
+                outbuf_printf(out, "hash: %s: not found\n", argv[i]);
+                record_status(1);
+            }
+        }
+        return;
     }
 
-    // Handle piping and redirection
-    if (strchr(input, '|') || strchr(input, '>') || strchr(input, '<')) {
-        handle_redirection_and_piping(input, output, output_size);
-        return 0;
-    }
+    pthread_mutex_lock(&path_lock);
+    if (path_entries == 0)
+        outbuf_printf(out, "hash: hash table empty\n");
+    else
+        outbuf_printf(out, "hits\tcommand\n");
+    for (int i = 0; i < PATH_CACHE_SIZE; i++)
+        if (path_table[i].name[0])
+            outbuf_printf(out, "%4lu\t%s\n", path_table[i].hits, path_table[i].path);
+    unsigned long lookups = path_stats.hits + path_stats.misses;
+    outbuf_printf(out, "%lu hits, %lu misses (%.1f%% hit rate), %.3f ms of PATH search saved\n",
+                path_stats.hits, path_stats.misses,
+                lookups ? 100.0 * path_stats.hits / lookups : 0.0, path_stats.saved_ns / 1e6);
+    pthread_mutex_unlock(&path_lock);
+}
 
-    // BUILT-IN COMMANDS
-    if (strcmp(input, "date") == 0) date_cmd(output, output_size);
-    else if (strncmp(input, "echo ", 5) == 0) echo_cmd(input, output, output_size);
-    else if (strcmp(input, "pwd") == 0) pwd_cmd(output, output_size);
-    else if (strncmp(input, "mkdir ", 6) == 0) mkdir_cmd(input, output, output_size);
-    else if (strncmp(input, "touch ", 6) == 0) touch_cmd(input, output, output_size);
-    else if (strncmp(input, "cat ", 4) == 0) cat_cmd(input, output, output_size);
-    else if (strncmp(input, "greet", 5) == 0) greet_cmd(input, output, output_size);
-    else if (strcmp(input, "roll") == 0) roll_cmd(output, output_size);
-    else if (strcmp(input, "joke") == 0) joke_cmd(output, output_size);
-   else if (strcmp(input, "about") == 0) {
-    snprintf(output, output_size,
+// about
+void about_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv, (void)args;
+    outbuf_printf(out,
         "=== 🐧 Mini Linux Shell ===\n"
         "---------------------------------------------\n"
         "👨‍💻 Developed By : Bhaumik Negi, Divyanshi Kaushik,\n"
@@ -216,8 +540,11 @@ int execute_shell_command(char *input, char *output, size_t output_size) {
         "📘 Course         : B.Tech - Operating Systems PBL Project\n"
         "---------------------------------------------\n"
         "⚙️  Features:\n"
-        "   • Built-in commands (cd, mkdir, touch, cat, etc.)\n"
-        "   • Process creation & execution using fork/exec\n"
+        "   • %d built-in commands (", builtin_count);
+    for (int i = 0; i < builtin_count; i++)
+        outbuf_printf(out, "%s%s", i ? ", " : "", builtins[i].name);
+    outbuf_printf(out, ")\n"
+        "   • Process creation & execution using posix_spawn\n"
         "   • Input/Output redirection (<, >)\n"
         "   • Command piping (|)\n"
         "   • Background execution (&)\n"
@@ -226,24 +553,16 @@ int execute_shell_command(char *input, char *output, size_t output_size) {
         "---------------------------------------------\n");
 }
 
-else if (strcmp(input, "help") == 0) {
-    snprintf(output, output_size,
+// help
+void help_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv, (void)args;
+    outbuf_printf(out,
         "📘 HELP MENU — Mini Linux Shell Commands\n"
         "=================================================\n"
-        "============== BUILT-IN COMMANDS ==============\n"
-        " date               → Show current date and time.\n"
-        " pwd                → Print current working directory.\n"
-        " cd <dir>           → Change working directory.\n"
-        " mkdir <dir>        → Create a new directory.\n"
-        " touch <file>       → Create an empty file.\n"
-        " cat <file>         → Display contents of a file.\n"
-        " echo <msg>         → Print text to the screen.\n"
-        " greet [name]       → Display a greeting message.\n"
-        " roll               → Roll a dice (1–6).\n"
-        " joke               → Tell a random programming joke.\n"
-        " about              → Show project and developer info.\n"
-        " help               → Display this help menu.\n"
-        " exit               → Exit from the shell.\n"
+        "============== BUILT-IN COMMANDS ==============\n");
+    for (int i = 0; i < builtin_count; i++)
+        outbuf_printf(out, " %-18s → %s\n", builtins[i].usage, builtins[i].description);
+    outbuf_printf(out,
         "-------------------------------------------------\n"
         "============ ⚙️ SYSTEM COMMANDS ============\n"
         " ls, whoami, ps, uname, df, cal, grep, wc, etc.\n"
@@ -254,31 +573,2745 @@ else if (strcmp(input, "help") == 0) {
         " <  → Input Redirection   (e.g., cat < in.txt)\n"
         " |  → Piping              (e.g., ls | grep .c)\n"
         " &  → Background Execution (e.g., sleep 5 &)\n"
+        " terminal → Interactive shell for vim, top, less\n"
+        " Tab → Complete commands, file names and past commands\n"
         "-------------------------------------------------\n"
         "💡 Tip: Combine commands like 'cat file.txt | wc -l'\n"
         "    for chaining and advanced command execution.\n"
         "=================================================\n");
 }
-    else if (strcmp(input, "exit") == 0) {
-        snprintf(output, output_size, "Session closed.\n");
-        exit(0);
+
+// exit: end the caller's session, hanging up its background jobs as a
+// shell would. The server and every other session carry on.
+void exit_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv, (void)args;
+    struct session *session = shell_session();
+    if (session == session_default()) {
+        outbuf_printf(out, "exit: no session to close\n");
+        record_status(1);
+        return;
+    }
+    jobs_hangup(session_id(session));
+    session_end(session);
+    outbuf_printf(out, "Session closed.\n");
+}
+
+// ---------- cat ----------
+// Files are mapped rather than read, so paging through a multi-GB log with a
+// line or byte range only touches the pages that range covers (plus, for
+// lines, the newlines before it). Files that cannot be mapped (pipes, /proc)
+// are read in large blocks instead.
+
+#define CAT_READ_SIZE (64 * 1024)
+
+struct cat_state {
+    struct outbuf *out;
+    int number;                  // -n
+    unsigned long first_line, last_line;   // 1-based, inclusive; 0 = no limit
+    unsigned long line;          // number of the line being emitted
+    int at_line_start;
+};
+
+// Emit len bytes of file contents; returns 0 once nothing more is wanted
+static int cat_feed(struct cat_state *cs, const char *data, size_t len) {
+    // Whole file, no numbering: one copy
+    if (!cs->number && cs->first_line <= 1 && cs->last_line == 0) {
+        outbuf_append(cs->out, data, len);
+        return cs->out->len < cs->out->limit;
     }
-    else if (strncmp(input, "cd ", 3) == 0) {
-        char *path = input + 3;
-        while (*path == ' ') path++;
-        if (chdir(path) == 0)
-            snprintf(output, output_size, "Directory changed to: %s\n", path);
-        else
-            snprintf(output, output_size, "Error: No such directory: %s\n", path);
+
+    while (len > 0) {
+        if (cs->last_line && cs->line > cs->last_line) return 0;
+        const char *nl = memchr(data, '\n', len);
+        size_t seg = nl ? (size_t)(nl - data) + 1 : len;
+        if (cs->line >= cs->first_line) {
+            if (cs->at_line_start && cs->number)
+                outbuf_printf(cs->out, "%6lu\t", cs->line);
+            outbuf_append(cs->out, data, seg);
+            if (cs->out->len >= cs->out->limit) return 0;
+        }
+        cs->at_line_start = nl != NULL;
+        if (nl) cs->line++;
+        data += seg;
+        len -= seg;
     }
-    else {
-        // External command (system)
-        char *args[MAX_ARGS];
-        char temp[BUFFER_SIZE];
-        strcpy(temp, input);
-        parse_input(temp, args);
-        execute_system_command(args, output, output_size, 0);
+    return 1;
+}
+
+// Split "name:N-M" (lines) or "name@N-M" (bytes) off an operand. Returns 0
+// when there is no range; *kind is ':' or '@'. A missing bound is 0.
+static int cat_range(char *operand, char *kind, unsigned long *from, unsigned long *to) {
+    char *mark = strrchr(operand, ':');
+    char *at = strrchr(operand, '@');
+    if (!mark || (at && at > mark)) mark = at;
+    if (!mark || mark == operand || !mark[1]) return 0;
+
+    char *end;
+    *from = *to = 0;
+    const char *p = mark + 1;
+    if (*p != '-') {
+        *from = strtoul(p, &end, 10);
+        if (end == p) return 0;
+        p = end;
+    }
+    if (*p == '-') {
+        p++;
+        if (*p) {
+            *to = strtoul(p, &end, 10);
+            if (end == p) return 0;
+            p = end;
+        }
+    } else if (*mark == ':') {
+        *to = *from;             // "file:N" is the single line N
+    }
+    if (*p) return 0;
+    *kind = *mark;
+    *mark = '\0';
+    return 1;
+}
+
+static int cat_file(int dir, char *operand, int number, struct outbuf *out) {
+    struct cat_state cs = { out, number, 1, 0, 1, 1 };
+    off_t byte_from = 0, byte_to = -1;
+
+    // A name that exists as written wins over range syntax
+    char kind = 0;
+    unsigned long from, to;
+    if (faccessat(dir, operand, F_OK, 0) == -1 && cat_range(operand, &kind, &from, &to)) {
+        if (kind == ':') {
+            cs.first_line = from ? from : 1;
+            cs.last_line = to;
+        } else {
+            byte_from = from;
+            byte_to = to ? (off_t)to : -1;
+        }
     }
 
+    int fd = openat(dir, operand, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        outbuf_printf(out, "cat: %s: %s\n", operand, strerror(errno));
+        if (fd != -1) close(fd);
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        outbuf_printf(out, "cat: %s: Is a directory\n", operand);
+        close(fd);
+        return -1;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        off_t end = byte_to >= 0 && byte_to < st.st_size ? byte_to : st.st_size;
+        if (byte_from < end) {
+            // Map from the page holding byte_from so a late range costs nothing up front
+            off_t base = byte_from & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+            char *map = mmap(NULL, end - base, PROT_READ, MAP_PRIVATE, fd, base);
+            if (map != MAP_FAILED) {
+                madvise(map, end - base, MADV_SEQUENTIAL);
+                if (!cat_feed(&cs, map + (byte_from - base), end - byte_from) && out->len >= out->limit)
+                    out->dropped += end - byte_from;   // rough: rest of the range was not sent
+                munmap(map, end - base);
+                close(fd);
+                return 0;
+            }
+        }
+    }
+
+    // Not mappable: read in large blocks, honouring the byte range by seeking
+    char *buf = malloc(CAT_READ_SIZE);
+    off_t pos = byte_from;
+    if (byte_from > 0 && lseek(fd, byte_from, SEEK_SET) == -1) {
+        // Pipes and the like cannot seek; skip forward instead
+        for (pos = 0; pos < byte_from; ) {
+            ssize_t n = read(fd, buf, byte_from - pos < CAT_READ_SIZE ? byte_from - pos : CAT_READ_SIZE);
+            if (n <= 0) break;
+            pos += n;
+        }
+    }
+    while (byte_to < 0 || pos < byte_to) {
+        size_t want = byte_to < 0 || byte_to - pos > CAT_READ_SIZE ? CAT_READ_SIZE : (size_t)(byte_to - pos);
+        ssize_t n = read(fd, buf, want);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        pos += n;
+        if (!cat_feed(&cs, buf, n)) break;
+    }
+    free(buf);
+    close(fd);
+    return 0;
+}
+
+// cat [-n] file[:N-M | @N-M]...
+void cat_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    int number = 0, first = 1;
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) number = 1, first = 2;
+    if (first >= argc) {
+        outbuf_printf(out, "Usage: cat [-n] <file>[:N-M|@N-M]...\n");
+        record_status(2);
+        return;
+    }
+
+    int dir = cwd_acquire();
+    for (int i = first; i < argc && out->len < out->limit; i++)
+        if (cat_file(dir, argv[i], number, out) == -1)
+            record_status(1);
+    close(dir);
+}
+
+// ---------- wc, grep, head, tail ----------
+// These run in-process: alone on files, or as the last stages of a pipeline
+// reading the earlier stages' output straight from the pipe (run_filters()).
+// Scanning goes through textscan.c. Options they do not implement (grep -i
+// or a regex, tail -f, wc -m, ...) leave the command to the system binary.
+
+#define FILTER_CHUNK (64 * 1024)
+
+enum filter_kind { FILTER_WC, FILTER_GREP, FILTER_HEAD, FILTER_TAIL };
+
+struct filter {
+    enum filter_kind kind;
+    struct filter *next;         // stage reading this one's output, or NULL
+    struct outbuf *out;          // where the last stage writes
+    int done;                    // wants no more input
+    int status;
+
+    // Options
+    int count_lines, count_words, count_bytes;   // wc -l -w -c
+    const char *pattern;                         // grep (fixed string)
+    size_t pattern_len;
+    int invert, only_count, number, quiet;       // grep -v -c -n -q
+    unsigned long limit;                         // head/tail -n/-c N
+    int by_bytes, from_start;                    // -c, tail -n +N
+    char **files;
+    int file_count;
+    int width;                                   // wc column width
+
+    // State of the current input
+    const char *name;            // wc's file name, grep's "file:" prefix, or NULL
+    unsigned long line, seen, matches;
+    unsigned long lines, words, bytes;
+    int in_word;
+    char *hold;                  // grep's partial line, tail's retained bytes
+    size_t hold_len, hold_cap, hold_trim;
+    unsigned long total_lines, total_words, total_bytes;
+};
+
+static void filter_feed(struct filter *f, const char *data, size_t len);
+
+static void filter_emit(struct filter *f, const char *data, size_t len) {
+    if (len == 0) return;
+    if (!f->next) {
+        outbuf_append(f->out, data, len);
+    } else {
+        filter_feed(f->next, data, len);
+        if (f->next->done) f->done = 1;
+    }
+}
+
+static void filter_printf(struct filter *f, const char *fmt, ...) {
+    char line[PATH_MAX + 128];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n > 0) filter_emit(f, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+}
+
+static void hold_append(struct filter *f, const char *data, size_t len) {
+    if (f->hold_len + len > f->hold_cap) {
+        f->hold_cap = f->hold_cap ? f->hold_cap : FILTER_CHUNK;
+        while (f->hold_len + len > f->hold_cap) f->hold_cap *= 2;
+        f->hold = realloc(f->hold, f->hold_cap);
+        if (!f->hold) abort();
+    }
+    memcpy(f->hold + f->hold_len, data, len);
+    f->hold_len += len;
+}
+
+// Parse a head/tail count: N, or +N for tail's "from line N"
+static int filter_count(struct filter *f, const char *arg) {
+    char *end;
+    if (*arg == '+' && f->kind == FILTER_TAIL) f->from_start = 1, arg++;
+    if (*arg < '0' || *arg > '9') return -1;
+    f->limit = strtoul(arg, &end, 10);
+    return *end ? -1 : 0;
+}
+
+// Fill f from a command's words; -1 if it needs the real binary
+static int filter_parse(struct filter *f, int argc, char **argv) {
+    memset(f, 0, sizeof(*f));
+    if (strcmp(argv[0], "wc") == 0) f->kind = FILTER_WC;
+    else if (strcmp(argv[0], "grep") == 0) f->kind = FILTER_GREP;
+    else if (strcmp(argv[0], "head") == 0) f->kind = FILTER_HEAD;
+    else if (strcmp(argv[0], "tail") == 0) f->kind = FILTER_TAIL;
+    else return -1;
+    if (f->kind == FILTER_HEAD || f->kind == FILTER_TAIL) f->limit = 10;
+    f->status = f->kind == FILTER_GREP;          // 1 until a line is selected
+
+    int i = 1, fixed = 0;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        const char *opt = argv[i] + 1;
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        if (f->kind == FILTER_HEAD || f->kind == FILTER_TAIL) {
+            if (*opt >= '0' && *opt <= '9') {            // head -5
+                if (filter_count(f, opt) < 0) return -1;
+            } else if ((*opt == 'n' || *opt == 'c') && (opt[1] || i + 1 < argc)) {
+                f->by_bytes = *opt == 'c';
+                if (filter_count(f, opt[1] ? opt + 1 : argv[++i]) < 0) return -1;
+            } else {
+                return -1;
+            }
+            continue;
+        }
+        if (f->kind == FILTER_GREP && *opt == 'e' && !f->pattern) {
+            if (!opt[1] && i + 1 >= argc) return -1;
+            f->pattern = opt[1] ? opt + 1 : argv[++i];
+            continue;
+        }
+        for (; *opt; opt++) {
+            if (f->kind == FILTER_WC && *opt == 'l') f->count_lines = 1;
+            else if (f->kind == FILTER_WC && *opt == 'w') f->count_words = 1;
+            else if (f->kind == FILTER_WC && *opt == 'c') f->count_bytes = 1;
+            else if (f->kind == FILTER_GREP && *opt == 'F') fixed = 1;
+            else if (f->kind == FILTER_GREP && *opt == 'v') f->invert = 1;
+            else if (f->kind == FILTER_GREP && *opt == 'c') f->only_count = 1;
+            else if (f->kind == FILTER_GREP && *opt == 'n') f->number = 1;
+            else if (f->kind == FILTER_GREP && *opt == 'q') f->quiet = 1;
+            else return -1;
+        }
+    }
+
+    if (f->kind == FILTER_WC && !f->count_lines && !f->count_words && !f->count_bytes)
+        f->count_lines = f->count_words = f->count_bytes = 1;
+    if (f->kind == FILTER_GREP) {
+        if (!f->pattern) {
+            if (i >= argc) return -1;
+            f->pattern = argv[i++];
+        }
+        // Only fixed strings: a basic regex without metacharacters is one
+        if (!fixed && strpbrk(f->pattern, "\\.[]*^$")) return -1;
+        if (strchr(f->pattern, '\n')) return -1;
+        f->pattern_len = strlen(f->pattern);
+    }
+    f->files = argv + i;
+    f->file_count = argc - i;
     return 0;
 }
+
+// Start of the last count lines of data (a final line without '\n' counts)
+static const char *last_lines(const char *data, size_t len, unsigned long count) {
+    if (count == 0) return data + len;
+    size_t scan = len && data[len - 1] == '\n' ? len - 1 : len;
+    while (1) {
+        const char *nl = memrchr(data, '\n', scan);
+        if (!nl) return data;
+        if (--count == 0) return nl + 1;
+        scan = nl - data;
+    }
+}
+
+// Emit grep's selected lines from [start, end), all complete lines except
+// possibly the last. *counted is how far f->line has been advanced.
+static void grep_select(struct filter *f, const char *start, const char *end, const char **counted) {
+    if (start == end) return;
+    unsigned long lines = scan_count(start, end - start, '\n') + (end[-1] != '\n');
+    f->matches += lines;
+    if (f->quiet) {
+        f->done = 1;
+        return;
+    }
+    if (f->only_count) return;
+
+    if (!f->number && !f->name) {
+        filter_emit(f, start, end - start);
+    } else {
+        if (f->number) {
+            f->line += scan_count(*counted, start - *counted, '\n');
+            *counted = end;
+        }
+        for (const char *p = start; p < end && !f->done; ) {
+            const char *nl = memchr(p, '\n', end - p);
+            const char *stop = nl ? nl + 1 : end;
+            if (f->name) filter_printf(f, "%s:", f->name);
+            if (f->number) filter_printf(f, "%lu:", ++f->line);
+            filter_emit(f, p, stop - p);
+            p = stop;
+        }
+    }
+    if (end[-1] != '\n') filter_emit(f, "\n", 1);
+}
+
+// Run grep over lines [data, data + len)
+static void grep_lines(struct filter *f, const char *data, size_t len) {
+    const char *end = data + len, *pos = data, *counted = data;
+    while (pos < end && !f->done) {
+        const char *match = scan_find(pos, end - pos, f->pattern, f->pattern_len);
+        const char *line_start = end, *line_end = end;
+        if (match) {
+            line_start = memrchr(pos, '\n', match - pos);
+            line_start = line_start ? line_start + 1 : pos;
+            line_end = memchr(match, '\n', end - match);
+            line_end = line_end ? line_end + 1 : end;
+        }
+        if (f->invert)
+            grep_select(f, pos, line_start, &counted);
+        else if (match)
+            grep_select(f, line_start, line_end, &counted);
+        pos = line_end;
+    }
+    if (f->number) f->line += scan_count(counted, end - counted, '\n');
+}
+
+// Begin a new input; name is the file being read, NULL for a pipe
+static void filter_begin(struct filter *f, const char *name, int index) {
+    f->line = f->seen = f->matches = 0;
+    f->lines = f->words = f->bytes = 0;
+    f->in_word = 0;
+    f->hold_len = f->hold_trim = 0;
+    f->name = f->kind == FILTER_WC || f->file_count > 1 ? name : NULL;
+    if ((f->kind == FILTER_HEAD || f->kind == FILTER_TAIL) && f->file_count > 1)
+        filter_printf(f, "%s==> %s <==\n", index > 0 ? "\n" : "", name);
+    // grep -q is finished for good after its first match
+    f->done = (f->kind == FILTER_HEAD && f->limit == 0) || (f->quiet && f->status == 0);
+}
+
+static void filter_feed(struct filter *f, const char *data, size_t len) {
+    if (f->done) return;
+    switch (f->kind) {
+    case FILTER_WC:
+        if (f->count_lines) f->lines += scan_count(data, len, '\n');
+        if (f->count_words) f->words += scan_words(data, len, &f->in_word);
+        f->bytes += len;
+        break;
+
+    case FILTER_GREP: {
+        // Complete lines are searched in place; a partial one waits in hold
+        if (f->hold_len) {
+            const char *nl = memchr(data, '\n', len);
+            size_t take = nl ? (size_t)(nl - data) + 1 : len;
+            hold_append(f, data, take);
+            data += take, len -= take;
+            if (!nl) break;
+            grep_lines(f, f->hold, f->hold_len);
+            f->hold_len = 0;
+        }
+        const char *last = memrchr(data, '\n', len);
+        size_t whole = last ? (size_t)(last - data) + 1 : 0;
+        grep_lines(f, data, whole);
+        if (!f->done) hold_append(f, data + whole, len - whole);
+        break;
+    }
+
+    case FILTER_HEAD:
+        if (f->by_bytes) {
+            size_t take = f->limit - f->seen < len ? f->limit - f->seen : len;
+            f->seen += take;
+            filter_emit(f, data, take);
+        } else {
+            const char *p = data, *end = data + len;
+            while (f->seen < f->limit && p < end) {
+                const char *nl = memchr(p, '\n', end - p);
+                if (!nl) { p = end; break; }
+                p = nl + 1;
+                f->seen++;
+            }
+            filter_emit(f, data, p - data);
+        }
+        if (f->seen >= f->limit) f->done = 1;
+        break;
+
+    case FILTER_TAIL:
+        if (f->from_start) {
+            // Skip to byte or line N, then pass everything through
+            unsigned long skip = f->limit > 0 ? f->limit - 1 : 0;
+            const char *p = data, *end = data + len;
+            while (f->seen < skip && p < end) {
+                if (f->by_bytes) {
+                    size_t take = skip - f->seen < (size_t)(end - p) ? skip - f->seen : (size_t)(end - p);
+                    p += take, f->seen += take;
+                } else {
+                    const char *nl = memchr(p, '\n', end - p);
+                    p = nl ? nl + 1 : end;
+                    f->seen += nl != NULL;
+                }
+            }
+            filter_emit(f, p, end - p);
+            break;
+        }
+        // Keep the input, cutting it back to the last N lines or bytes
+        // whenever it has doubled since the previous cut
+        hold_append(f, data, len);
+        if (f->hold_len > 2 * f->hold_trim + FILTER_CHUNK) {
+            const char *keep = f->by_bytes ? f->hold + (f->hold_len > f->limit ? f->hold_len - f->limit : 0)
+                                           : last_lines(f->hold, f->hold_len, f->limit);
+            f->hold_len -= keep - f->hold;
+            memmove(f->hold, keep, f->hold_len);
+            f->hold_trim = f->hold_len;
+        }
+        break;
+    }
+}
+
+// A whole input that is already in memory (a mapped file). tail only looks
+// at its end instead of copying it.
+static void filter_whole(struct filter *f, const char *data, size_t len) {
+    if (f->kind == FILTER_TAIL && !f->from_start) {
+        const char *keep = f->by_bytes ? data + (len > f->limit ? len - f->limit : 0)
+                                       : last_lines(data, len, f->limit);
+        filter_emit(f, keep, data + len - keep);
+        return;
+    }
+    filter_feed(f, data, len);
+}
+
+// Finish the current input
+static void filter_end(struct filter *f) {
+    switch (f->kind) {
+    case FILTER_WC: {
+        char line[128];
+        int n = 0;
+        if (f->count_lines) n += snprintf(line + n, sizeof(line) - n, "%s%*lu", n ? " " : "", f->width, f->lines);
+        if (f->count_words) n += snprintf(line + n, sizeof(line) - n, "%s%*lu", n ? " " : "", f->width, f->words);
+        if (f->count_bytes) n += snprintf(line + n, sizeof(line) - n, "%s%*lu", n ? " " : "", f->width, f->bytes);
+        if (f->name) filter_printf(f, "%s %s\n", line, f->name);
+        else filter_printf(f, "%s\n", line);
+        f->total_lines += f->lines, f->total_words += f->words, f->total_bytes += f->bytes;
+        break;
+    }
+    case FILTER_GREP:
+        if (f->hold_len && !f->done) grep_lines(f, f->hold, f->hold_len);
+        f->hold_len = 0;
+        if (f->only_count && !f->quiet) {
+            if (f->name) filter_printf(f, "%s:%lu\n", f->name, f->matches);
+            else filter_printf(f, "%lu\n", f->matches);
+        }
+        if (f->matches && f->status == 1) f->status = 0;
+        break;
+    case FILTER_TAIL:
+        if (!f->from_start) {
+            const char *keep = f->by_bytes ? f->hold + (f->hold_len > f->limit ? f->hold_len - f->limit : 0)
+                                           : last_lines(f->hold, f->hold_len, f->limit);
+            filter_emit(f, keep, f->hold + f->hold_len - keep);
+        }
+        f->hold_len = 0;
+        break;
+    case FILTER_HEAD:
+        break;
+    }
+}
+
+// After the last input: totals and cleanup
+static void filter_finish(struct filter *f) {
+    if (f->kind == FILTER_WC && f->file_count > 1) {
+        f->lines = f->total_lines, f->words = f->total_words, f->bytes = f->total_bytes;
+        f->name = "total";
+        filter_end(f);
+    }
+    free(f->hold);
+    f->hold = NULL;
+    f->hold_cap = 0;
+}
+
+// Column width of wc's counts: none for a single count of a single input,
+// else wide enough for the total size of the files, or 7 for pipes
+static int wc_width(struct filter *f, int dir, const char *in_file) {
+    if (f->count_lines + f->count_words + f->count_bytes == 1 && f->file_count <= 1) return 1;
+    if (!f->file_count && !in_file) return 7;
+    off_t total = 0;
+    for (int i = 0; i < (f->file_count ? f->file_count : 1); i++) {
+        struct stat st;
+        // Missing operands are reported by filter_input() and count for nothing
+        if (fstatat(dir, f->file_count ? f->files[i] : in_file, &st, 0) == -1) continue;
+        if (!S_ISREG(st.st_mode)) return 7;
+        total += st.st_size;
+    }
+    int width = 1;
+    for (; total >= 10; total /= 10) width++;
+    return width;
+}
+
+// Run f over one input: a file operand, or in_file standing in for stdin
+// (name NULL). Regular files are mapped; anything else is read in chunks.
+static void filter_input(struct filter *f, int dir, const char *path, const char *name, int index) {
+    int fd = openat(dir, path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || S_ISDIR(st.st_mode)) {
+        const char *error = fd == -1 || !S_ISDIR(st.st_mode) ? strerror(errno) : "Is a directory";
+        filter_printf(f, "%s: %s: %s\n", f->kind == FILTER_WC ? "wc" : f->kind == FILTER_GREP ? "grep" :
+                      f->kind == FILTER_HEAD ? "head" : "tail", path, error);
+        f->status = f->kind == FILTER_GREP ? 2 : 1;
+        if (fd != -1) close(fd);
+        if (fd != -1 && f->kind == FILTER_WC) {     // wc still lists it, with zeros
+            filter_begin(f, name, index);
+            filter_end(f);
+        }
+        return;
+    }
+
+    filter_begin(f, name, index);
+    // wc and grep read every page, so fault them all in at once
+    int populate = f->kind == FILTER_WC || (f->kind == FILTER_GREP && !f->quiet) ? MAP_POPULATE : 0;
+    char *map = S_ISREG(st.st_mode) && st.st_size > 0
+                    ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | populate, fd, 0) : MAP_FAILED;
+    if (map != MAP_FAILED) {
+        if (f->kind != FILTER_TAIL) madvise(map, st.st_size, MADV_SEQUENTIAL);
+        filter_whole(f, map, st.st_size);
+        munmap(map, st.st_size);
+    } else {
+        char *buf = malloc(FILTER_CHUNK);
+        while (!f->done) {
+            ssize_t n = read(fd, buf, FILTER_CHUNK);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            filter_feed(f, buf, n);
+        }
+        free(buf);
+    }
+    close(fd);
+    filter_end(f);
+}
+
+// Run f over its file operands, or over in_file (or nothing) when it has none
+static void filter_run_files(struct filter *f, int dir, const char *in_file) {
+    if (f->kind == FILTER_WC) f->width = wc_width(f, dir, in_file);
+    if (!f->file_count && in_file) {
+        filter_input(f, dir, in_file, NULL, 0);
+    } else if (!f->file_count) {
+        filter_begin(f, NULL, 0);
+        filter_end(f);
+    }
+    for (int i = 0; i < f->file_count && !(f->quiet && f->status == 0); i++)
+        filter_input(f, dir, f->files[i], f->files[i], i);
+    filter_finish(f);
+}
+
+// wc, grep, head, tail
+void filter_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    struct filter f;
+    if (filter_parse(&f, argc, argv) < 0) {
+        struct arena scratch = ARENA_INIT;
+        execute_system_command(argv, out, out->arena ? out->arena : &scratch);
+        arena_free(&scratch);
+        return;
+    }
+    f.out = out;
+    int dir = cwd_acquire();
+    filter_run_files(&f, dir, NULL);
+    close(dir);
+    record_status(f.status);
+}
+
+// ---------- BUILT-IN REGISTRY ----------
+// builtins.def lists every built-in once; builtin_hash.h (generated from it)
+// maps each name to its own slot, so dispatch costs one hash and one strcmp
+// however many built-ins there are.
+
+// Job control, defined with the job table below
+builtin_fn jobs_cmd, wait_cmd, fg_cmd, kill_cmd;
+
+#define BUILTIN(name, handler, min_args, max_args, usage, description) \
+    { #name, handler, min_args, max_args, usage, description },
+const struct builtin builtins[] = {
+#include "builtins.def"
+};
+#undef BUILTIN
+
+const int builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+
+_Static_assert(sizeof(builtins) / sizeof(builtins[0]) == BUILTIN_HASH_COUNT,
+               "builtin_hash.h is stale: rerun tools/gen_builtin_hash.c");
+
+const struct builtin *builtin_find(const char *name) {
+    int index = builtin_slots[builtin_hash(name, BUILTIN_HASH_SEED) & (BUILTIN_HASH_SIZE - 1)];
+    if (index < 0 || strcmp(builtins[index].name, name) != 0) return NULL;
+    return &builtins[index];
+}
+
+// ---------- PROCESS LAUNCH ----------
+// Children are started with posix_spawn() rather than fork(): glibc launches
+// them with clone(CLONE_VM | CLONE_VFORK), so the cost does not grow with the
+// server's page tables. Everything the child needs (cwd, dup2s, redirection
+// files, SIGPIPE reset) is expressed as spawn file actions and attributes.
+
+// The server ignores SIGPIPE; commands get the default back. Each pipeline
+// is a process group of its own (pgid 0 starts one), so it can be signalled
+// as a whole.
+static void spawn_attr_init(posix_spawnattr_t *attr, pid_t pgid) {
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_init(attr);
+    posix_spawnattr_setsigdefault(attr, &defaults);
+    posix_spawnattr_setpgroup(attr, pgid);
+    posix_spawnattr_setflags(attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+}
+
+
+// Turn a waitpid() status into a shell-style exit code
+static int exit_code(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+// Add one reaped stage's resource usage to a command's
+static void add_usage(struct shell_usage *total, const struct rusage *ru) {
+    total->user_us += ru->ru_utime.tv_sec * 1000000LL + ru->ru_utime.tv_usec;
+    total->sys_us += ru->ru_stime.tv_sec * 1000000LL + ru->ru_stime.tv_usec;
+    if (ru->ru_maxrss > total->max_rss_kb) total->max_rss_kb = ru->ru_maxrss;
+}
+
+// Wait for one stage and add its usage to *usage; returns its exit code
+// (127 if it never started)
+static int reap_stage(pid_t pid, struct shell_usage *usage) {
+    int status = 0;
+    struct rusage ru;
+    if (pid <= 0 || wait4(pid, &status, 0, &ru) <= 0) return 127;
+    add_usage(usage, &ru);
+    return exit_code(status);
+}
+
+static void record_status(int code) {
+    last_status[0] = code;
+    last_status_count = 1;
+}
+
+int shell_pipestatus(int *codes, int max) {
+    int n = last_status_count < max ? last_status_count : max;
+    memcpy(codes, last_status, n * sizeof(int));
+    return n;
+}
+
+// ---------- DEADLINES & LIMITS ----------
+// Every pipeline runs in a process group led by its first stage and is
+// watched by a supervisor: the executor's supervisor process, or a thread
+// standing in for it when commands are spawned in-process. The supervisor
+// polls the stages' pidfds and a timerfd; at the deadline the group gets
+// SIGTERM, then SIGKILL KILL_GRACE_MS later. Once every stage has exited,
+// anything left in the group (background children that would keep the
+// output pipe open) is killed as well. A terminal's shell leads a session
+// and gives every job a group of its own, so there the whole session is
+// signalled. The leader is reaped last, so its pid cannot turn into someone
+// else's group or session id while it is still signalled.
+
+#define KILL_GRACE_MS 2000
+
+// Limits of one command; 0 means none
+struct limits {
+    int64_t timeout_ms;          // wall clock, for the whole pipeline
+    int64_t cpu_s;               // RLIMIT_CPU, per process
+    int64_t memory_mb;           // RLIMIT_DATA, per process
+    int64_t nproc;               // RLIMIT_NPROC, counted over the user
+    int64_t file_mb;             // RLIMIT_FSIZE, per file written
+};
+
+// Configuration, read once from the environment
+static struct limits configured;
+static int64_t job_timeout_ms;
+static pthread_once_t limits_once = PTHREAD_ONCE_INIT;
+
+static __thread int64_t thread_timeout_ms;
+static __thread const char *last_stop;
+
+static double env_number(const char *name, double fallback) {
+    const char *value = getenv(name);
+    return value && *value ? strtod(value, NULL) : fallback;
+}
+
+static void limits_init(void) {
+    configured.timeout_ms = (int64_t)(env_number("WEBSHELL_TIMEOUT", 60) * 1000);
+    job_timeout_ms = (int64_t)(env_number("WEBSHELL_JOB_TIMEOUT", 0) * 1000);
+    configured.cpu_s = (int64_t)env_number("WEBSHELL_CPU_LIMIT", 600);
+    configured.memory_mb = (int64_t)env_number("WEBSHELL_MEMORY_LIMIT", 4096);
+    configured.nproc = (int64_t)env_number("WEBSHELL_NPROC_LIMIT", 4096);
+    configured.file_mb = (int64_t)env_number("WEBSHELL_FILE_LIMIT", 1024);
+}
+
+void shell_set_timeout(int64_t ms) {
+    thread_timeout_ms = ms;
+}
+
+const char *shell_stop_reason(void) {
+    return last_stop;
+}
+
+// Whether l asks for any rlimit (the deadline is enforced separately)
+static int has_rlimits(const struct limits *l) {
+    return l->cpu_s > 0 || l->memory_mb > 0 || l->nproc > 0 || l->file_mb > 0;
+}
+
+// Set the calling process's rlimits, never raising a hard limit, so that
+// every stage it spawns inherits them from exec on. The CPU hard limit is
+// a second past the soft one, so a process gets SIGXCPU first and the stop
+// can be told apart from other kills.
+static void apply_limits(const struct limits *l) {
+    static const int resources[] = { RLIMIT_CPU, RLIMIT_DATA, RLIMIT_NPROC, RLIMIT_FSIZE };
+    int64_t values[] = { l->cpu_s, l->memory_mb << 20, l->nproc, l->file_mb << 20 };
+    for (int i = 0; i < 4; i++) {
+        struct rlimit rl;
+        rlim_t hard = values[i] + (resources[i] == RLIMIT_CPU);
+        if (values[i] <= 0 || getrlimit(resources[i], &rl) == -1 || hard > rl.rlim_max) continue;
+        rl.rlim_cur = values[i];
+        rl.rlim_max = hard;
+        setrlimit(resources[i], &rl);
+    }
+}
+
+// Signal a process group, and with session set every process in the session
+// its leader leads
+static void signal_group(pid_t group, int session, int sig) {
+    killpg(group, sig);
+    if (!session) return;
+    DIR *proc = opendir("/proc");
+    struct dirent *entry;
+    while (proc && (entry = readdir(proc))) {
+        pid_t pid = atoi(entry->d_name);
+        if (pid > 0 && pid != group && getsid(pid) == group) kill(pid, sig);
+    }
+    if (proc) closedir(proc);
+}
+
+static void arm_timer(int fd, int64_t ms) {
+    struct itimerspec when = { .it_value = { ms / 1000, ms % 1000 * 1000000 } };
+    timerfd_settime(fd, 0, &when, NULL);
+}
+
+// Wait for a pipeline's stages, enforcing timeout_ms (0: none), and store
+// their exit codes and usage. pids[i] is -1 for stages that never started;
+// the first that did leads the group. Returns 1 if the deadline was hit.
+static int supervise(const pid_t *pids, int count, int64_t timeout_ms, int *codes, struct shell_usage *usage) {
+    struct pollfd fds[MAX_STAGES + 1];
+    pid_t group = 0;
+    int leader = -1, waiting = 0, timed_out = 0;
+    for (int i = 0; i < count; i++) {
+        codes[i] = 127;
+        fds[i].fd = pids[i] > 0 ? syscall(SYS_pidfd_open, pids[i], 0) : -1;
+        fds[i].events = POLLIN;
+        if (pids[i] > 0 && leader < 0) {
+            leader = i;
+            if (fds[i].fd >= 0) group = pids[i];
+        }
+        if (fds[i].fd >= 0) waiting++;
+        else if (pids[i] > 0) codes[i] = reap_stage(pids[i], usage);   // unsupervised
+    }
+
+    int session = group > 0 && getsid(group) == group;
+
+    int timer = -1;
+    if (timeout_ms > 0 && group > 0 && (timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) >= 0)
+        arm_timer(timer, timeout_ms);
+    fds[count].fd = timer;
+    fds[count].events = POLLIN;
+
+    while (waiting > 0) {
+        if (poll(fds, count + 1, -1) == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[count].revents & POLLIN) {
+            uint64_t expirations;
+            read(timer, &expirations, sizeof(expirations));
+            // SIGTERM lets commands clean up; SIGKILL if they do not stop
+            signal_group(group, session, timed_out ? SIGKILL : SIGTERM);
+            if (timed_out) fds[count].fd = -1;
+            else arm_timer(timer, KILL_GRACE_MS);
+            timed_out = 1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & POLLIN)) continue;
+            // The leader stays a zombie for now, holding on to the group id
+            if (i != leader) codes[i] = reap_stage(pids[i], usage);
+            close(fds[i].fd);
+            fds[i].fd = -1;
+            waiting--;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (fds[i].fd < 0) continue;
+        close(fds[i].fd);
+        if (i != leader) codes[i] = reap_stage(pids[i], usage);
+    }
+
+    if (group > 0) {
+        signal_group(group, session, SIGKILL);
+        codes[leader] = reap_stage(group, usage);
+    }
+    if (timer >= 0) close(timer);
+    return timed_out;
+}
+
+// Why a command was stopped early, counted in the metrics; NULL if it was not
+static const char *stop_reason(int timed_out, const int *codes, int count) {
+    enum metric_counter counter;
+    const char *reason = NULL;
+    if (timed_out) counter = METRIC_STOPS_TIMEOUT, reason = "timeout";
+    for (int i = 0; i < count && !reason; i++) {
+        if (codes[i] == 128 + SIGXCPU) counter = METRIC_STOPS_CPU, reason = "cpu_limit";
+        else if (codes[i] == 128 + SIGXFSZ) counter = METRIC_STOPS_FILE_SIZE, reason = "file_size_limit";
+    }
+    if (reason) metrics_count(counter, 1);
+    return reason;
+}
+
+// Read a child's output until EOF. Anything past the buffer is drained and
+// dropped so the child never blocks on a full pipe. Returns the bytes kept.
+static size_t collect_output(int fd, struct outbuf *out) {
+    size_t start = out->len;
+    char discard[BUFFER_SIZE];
+    while (1) {
+        // Read straight into the buffer; past its limit, drain and count
+        size_t room;
+        char *dst = outbuf_reserve(out, BUFFER_SIZE, &room);
+        if (room == 0) dst = discard, room = sizeof(discard);
+        ssize_t n = read(fd, dst, room);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        metrics_count(METRIC_PIPE_BYTES, n);
+        if (dst == discard) out->dropped += n;
+        else outbuf_commit(out, n);
+    }
+    return out->len - start;
+}
+
+// ---------- PIPELINES & REDIRECTION ----------
+// Simple pipelines (a | b | c) with < in, > out, >> out and 2>&1 are parsed
+// here and every stage is spawned directly with its pipes wired up, so
+// there is no /bin/sh in between and each stage's exit status is known.
+// Quotes and backslashes are handled by the lexer (lexer.c); anything needing
+// other shell features ($, globs, ;, &&, ...) still goes through
+// handle_redirection_and_piping(). Single commands and sh -c fallbacks are
+// launched as one-stage pipelines.
+
+// Where a stage's stderr goes
+enum stderr_target { ERR_CAPTURE, ERR_STDOUT_PIPE, ERR_STDOUT_FILE };
+
+struct stage {
+    char **argv;                 // NULL-terminated, in the pipeline's arena
+    int argc;
+    char *path;                  // argv[0] resolved through the PATH cache, or NULL
+    char *in_file;               // < file
+    char *out_file;              // > file or >> file
+    int append;
+    enum stderr_target err;      // 2>&1 follows stdout as it was at that point
+};
+
+struct pipeline {
+    struct stage stages[MAX_STAGES];
+    int count;
+    struct arena *arena;         // words and argv vectors of this request
+    char paths[MAX_STAGES][256]; // storage for stages[i].path
+    char **env;                  // session variables over environ (session_env())
+    int env_count;
+    int background;              // offset of a trailing lone & in the input, or -1
+    int terminal;                // one interactive stage on a new pseudo-terminal
+    struct winsize winsize;      // its size
+};
+
+enum parse_result { PARSE_OK, PARSE_EMPTY, PARSE_NEEDS_SH, PARSE_SYNTAX_ERROR, PARSE_BAD_QUOTE };
+
+// Parse input into pl, allocating from arena. The whole line is always
+// parsed, so even with PARSE_NEEDS_SH the stages hold its words (built-ins
+// such as "echo $HOME" still run natively); operators that only sh
+// understands start a new stage so such lines never look like one command.
+static enum parse_result parse_pipeline(const char *input, struct pipeline *pl, struct arena *arena) {
+    memset(pl->stages, 0, sizeof(pl->stages));
+    pl->count = 1;
+    pl->arena = arena;
+    pl->env = NULL;
+    pl->env_count = 0;
+    pl->background = -1;
+    pl->terminal = 0;
+    struct word_list args[MAX_STAGES] = { 0 };
+    struct stage *st = &pl->stages[0];
+    char **pending = NULL;       // redirection waiting for its file name
+    int needs_sh = 0, syntax_error = 0;
+
+    struct lexer lx;
+    struct token tok;
+    lexer_init(&lx, input, arena);
+    while (lexer_next(&lx, &tok) != TOK_END) {
+        switch (tok.kind) {
+        case TOK_ERROR:
+            return PARSE_BAD_QUOTE;
+        case TOK_WORD:
+            needs_sh |= tok.needs_sh;
+            if (pending) {
+                *pending = tok.word;
+                pending = NULL;
+            } else {
+                word_list_push(&args[st - pl->stages], arena, tok.word);
+            }
+            break;
+        case TOK_ERR_TO_OUT:
+            if (pending) syntax_error = 1;
+            st->err = st->out_file ? ERR_STDOUT_FILE : ERR_STDOUT_PIPE;
+            break;
+        case TOK_IN:
+        case TOK_OUT:
+        case TOK_APPEND:
+            if (pending) syntax_error = 1;
+            pending = tok.kind == TOK_IN ? &st->in_file : &st->out_file;
+            if (tok.kind != TOK_IN) st->append = tok.kind == TOK_APPEND;
+            break;
+        case TOK_BACKGROUND:
+            // Only a trailing & starts a job; anywhere else it is sh's business
+            if (lx.pos[strspn(lx.pos, " \t\n")] == '\0') {
+                pl->background = lx.pos - 1 - input;
+                break;
+            }
+            // fall through
+        case TOK_PIPE:
+        case TOK_SH_OP:
+            if (tok.kind != TOK_PIPE) needs_sh = 1;
+            else if (pending || args[st - pl->stages].count == 0) syntax_error = 1;
+            // Past MAX_STAGES the remaining words pile into the last stage; sh runs it
+            if (pl->count == MAX_STAGES) needs_sh = 1;
+            else st = &pl->stages[pl->count++];
+            break;
+        default:
+            break;
+        }
+    }
+
+    for (int i = 0; i < pl->count; i++) {
+        pl->stages[i].argv = args[i].words;
+        pl->stages[i].argc = args[i].count;
+    }
+    if (pl->count == 1 && st->argc == 0 && !pending && !st->in_file && !st->out_file) return PARSE_EMPTY;
+    if (needs_sh) return PARSE_NEEDS_SH;
+    if (syntax_error || pending || st->argc == 0) return PARSE_SYNTAX_ERROR;
+    return PARSE_OK;
+}
+
+// environ with pl's session variables applied, allocated from pl's arena
+static char **pipeline_environ(struct pipeline *pl) {
+    if (pl->env_count == 0) return environ;
+    size_t count = 0;
+    while (environ[count]) count++;
+    char **envp = arena_alloc(pl->arena, (count + pl->env_count + 1) * sizeof(char *));
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t name_len = strcspn(environ[i], "=");
+        int overridden = 0;
+        for (int j = 0; j < pl->env_count && !overridden; j++)
+            overridden = strncmp(pl->env[j], environ[i], name_len) == 0 &&
+                         (pl->env[j][name_len] == '=' || pl->env[j][name_len] == '\0');
+        if (!overridden) envp[n++] = environ[i];
+    }
+    for (int j = 0; j < pl->env_count; j++)
+        if (strchr(pl->env[j], '=')) envp[n++] = pl->env[j];
+    envp[n] = NULL;
+    return envp;
+}
+
+// Spawn one stage: stdin from in_fd (-1 means /dev/null), stdout to out_fd,
+// stderr to err_fd, then its own redirections on top. File actions run in
+// order in the child, so relative redirection paths resolve in the shell cwd.
+static pid_t spawn_stage(struct stage *st, int dir, char **envp, pid_t pgid, int in_fd, int out_fd, int err_fd) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addfchdir_np(&actions, dir);
+
+    if (st->in_file)
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, st->in_file, O_RDONLY, 0);
+    else if (in_fd == -1)
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    else
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+
+    if (st->out_file)
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, st->out_file,
+                                         O_WRONLY | O_CREAT | (st->append ? O_APPEND : O_TRUNC), 0644);
+    else
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+
+    if (st->err == ERR_STDOUT_PIPE)
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDERR_FILENO);
+    else if (st->err == ERR_STDOUT_FILE)
+        posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    else
+        posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+
+    posix_spawnattr_t attr;
+    spawn_attr_init(&attr, pgid);
+    pid_t pid;
+    // A cached path skips the $PATH walk; if the binary has gone since, fall
+    // back to a normal search
+    int err = ENOENT;
+    if (st->path)
+        err = posix_spawn(&pid, st->path, &actions, &attr, st->argv, envp);
+    if (err == ENOENT)
+        err = posix_spawnp(&pid, st->argv[0], &actions, &attr, st->argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    // Report the failure where the stage's own error output would have gone.
+    // posix_spawn() does not say which step failed, so check the input file.
+    if (err != 0) {
+        const char *what = st->argv[0];
+        if (st->in_file && faccessat(dir, st->in_file, R_OK, 0) == -1) {
+            what = st->in_file;
+            err = errno;
+        }
+        dprintf(err_fd, "%s: %s\n", what, strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+// Spawn every stage with pipes between neighbours, in directory dir. The last
+// stage's stdout and every stage's stderr go to one capture pipe whose read
+// end is returned in *out_fd. Returns the number of stages; pids[i] is -1 for
+// stages that failed to start.
+static int spawn_pipeline(struct pipeline *pl, int dir, pid_t *pids, int *out_fd) {
+    int capture[2];
+    // CLOEXEC so children of concurrent commands never hold our pipe open
+    if (pipe2(capture, O_CLOEXEC) == -1) {
+        perror("pipe failed");
+        return 0;
+    }
+    int prev_read = -1;
+    pid_t group = 0;
+    char **envp = pipeline_environ(pl);
+
+    for (int i = 0; i < pl->count; i++) {
+        int next[2] = { -1, -1 };
+        if (i < pl->count - 1 && pipe2(next, O_CLOEXEC) == -1)
+            perror("pipe failed");
+        int stage_out = i < pl->count - 1 ? next[1] : capture[1];
+
+        pids[i] = stage_out == -1 ? -1 : spawn_stage(&pl->stages[i], dir, envp, group, prev_read, stage_out, capture[1]);
+        if (pids[i] > 0 && !group) group = pids[i];
+
+        if (prev_read != -1) close(prev_read);
+        if (next[1] != -1) close(next[1]);
+        prev_read = next[0];
+    }
+
+    if (prev_read != -1) close(prev_read);
+    close(capture[1]);
+    *out_fd = capture[0];
+    return pl->count;
+}
+
+// Spawn the single stage of a terminal pipeline the way forkpty() would: as
+// the leader of a new session whose controlling terminal is a fresh
+// pseudo-terminal. The master side is returned in *out_fd. Returns 1, or 0
+// if it could not be started.
+static int spawn_terminal(struct pipeline *pl, int dir, pid_t *pids, int *out_fd) {
+    char slave[64];
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1 ||
+        ptsname_r(master, slave, sizeof(slave)) != 0 || ioctl(master, TIOCSWINSZ, &pl->winsize) == -1) {
+        perror("pty");
+        if (master != -1) close(master);
+        return 0;
+    }
+
+    // Opening the slave after setsid() makes it the controlling terminal
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addfchdir_np(&actions, dir);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, slave, O_RDWR, 0);
+    posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDERR_FILENO);
+
+    // A session leader is already its own process group
+    posix_spawnattr_t attr;
+    spawn_attr_init(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSID);
+    struct stage *st = &pl->stages[0];
+    int err = posix_spawnp(&pids[0], st->argv[0], &actions, &attr, st->argv, pipeline_environ(pl));
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", st->argv[0], strerror(err));
+        close(master);
+        return 0;
+    }
+    *out_fd = master;
+    return 1;
+}
+
+// launch_pipeline() failures other than -1 (nothing could be started)
+#define LAUNCH_TOO_LONG -2       // arguments and environment are more than exec takes
+#define LAUNCH_LOST -3           // the executor took the request but never answered
+
+// ---------- EXECUTOR DAEMON ----------
+// The server forks a small executor process at startup, before it has any
+// threads, caches or connections, and from then on asks it to launch commands
+// over an AF_UNIX seqpacket socket. For every request the executor forks a
+// supervisor from its own tiny address space; the supervisor spawns the
+// pipeline, passes the output pipe back with SCM_RIGHTS, waits for the
+// stages and reports their exit statuses. The server therefore never forks,
+// whatever its size. Several servers can share one executor by pointing
+// WEBSHELL_EXECUTOR_SOCKET at the same path. Limits travel with each request,
+// so a shared executor applies the requesting server's; the supervisor sets
+// them on itself before spawning, so they hold from each stage's exec on.
+// An executor that dies is started again by the next launch. If none can be
+// started, commands are spawned in-process, but only when no rlimits are
+// configured: posix_spawn() cannot set them, and set on
+// the child afterwards they would miss whatever it did first. The deadline
+// is enforced either way.
+
+// A pipeline flattened for the socket. Each stage's argv strings follow each
+// other in 'strings'; file names are byte offsets into it (-1 if unset), and
+// so is the first of the session variables, which also follow each other.
+// The strings are as long as the pipeline needs, up to what exec accepts,
+// which is more than one socket message holds: the header goes first, with
+// the directory fd, and the strings follow in WIRE_CHUNK pieces.
+
+#define WIRE_CHUNK (32 * 1024)
+
+struct wire_stage {
+    int32_t argc;
+    int32_t argv;                // offset of argv[0]; the rest follow it
+    int32_t in_file;
+    int32_t out_file;
+    int32_t path;
+    int32_t append;
+    int32_t err;
+};
+
+struct wire_request {
+    uint32_t count;
+    uint32_t strings_len;
+    int32_t env_count;
+    int32_t env;
+    int32_t terminal;
+    struct winsize winsize;
+    struct limits limits;
+    struct wire_stage stages[MAX_STAGES];
+    char strings[];
+};
+
+// Sent with the output pipe attached and the stages' pids, then again
+// (without fd) with their statuses and resource usage
+struct wire_reply {
+    int32_t count;
+    int32_t pids[MAX_STAGES];
+    int32_t codes[MAX_STAGES];
+    int32_t timed_out;
+    struct shell_usage usage;
+};
+
+static struct sockaddr_un executor_addr;
+static socklen_t executor_addr_len;
+static int executor_available;
+static pid_t executor_pid;       // the daemon this server forked, if any
+static pthread_mutex_t executor_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Send a message, optionally carrying one file descriptor
+static int send_with_fd(int sock, const void *data, size_t len, int fd) {
+    struct iovec iov = { (void *)data, len };
+    union { struct cmsghdr align; char buf[CMSG_SPACE(sizeof(int))]; } control;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (fd >= 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+// Receive one message and the descriptor attached to it (-1 if none)
+static ssize_t recv_with_fd(int sock, void *data, size_t len, int *fd) {
+    struct iovec iov = { data, len };
+    union { struct cmsghdr align; char buf[CMSG_SPACE(sizeof(int))]; } control;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                          .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+    ssize_t n;
+    while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+        ;
+    *fd = -1;
+    struct cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    return n;
+}
+
+// Most string bytes a request may carry: what exec would take
+static size_t wire_strings_max(void) {
+    long max = sysconf(_SC_ARG_MAX);
+    return max > 0 ? (size_t)max : 128 * 1024;
+}
+
+// Bytes of strings pl needs on the wire
+static size_t wire_strings_size(const struct pipeline *pl) {
+    size_t size = 0;
+    for (int i = 0; i < pl->count; i++) {
+        const struct stage *st = &pl->stages[i];
+        for (int a = 0; a < st->argc; a++) size += strlen(st->argv[a]) + 1;
+        if (st->in_file) size += strlen(st->in_file) + 1;
+        if (st->out_file) size += strlen(st->out_file) + 1;
+        if (st->path) size += strlen(st->path) + 1;
+    }
+    for (int i = 0; i < pl->env_count; i++) size += strlen(pl->env[i]) + 1;
+    return size;
+}
+
+// Append str (room was reserved) and return its offset
+static int wire_add_string(struct wire_request *req, const char *str) {
+    size_t len = strlen(str) + 1;
+    memcpy(req->strings + req->strings_len, str, len);
+    req->strings_len += len;
+    return (int)(req->strings_len - len);
+}
+
+// Fill req, which has room for wire_strings_size(pl) bytes of strings
+static void wire_encode(struct pipeline *pl, struct wire_request *req) {
+    req->count = pl->count;
+    req->terminal = pl->terminal;
+    req->winsize = pl->winsize;
+    req->strings_len = 0;
+    for (int i = 0; i < pl->count; i++) {
+        struct stage *st = &pl->stages[i];
+        struct wire_stage *ws = &req->stages[i];
+        ws->argc = st->argc;
+        ws->argv = req->strings_len;
+        for (int a = 0; a < st->argc; a++) wire_add_string(req, st->argv[a]);
+        ws->in_file = st->in_file ? wire_add_string(req, st->in_file) : -1;
+        ws->out_file = st->out_file ? wire_add_string(req, st->out_file) : -1;
+        ws->path = st->path ? wire_add_string(req, st->path) : -1;
+        ws->append = st->append;
+        ws->err = st->err;
+    }
+    req->env_count = pl->env_count;
+    req->env = req->strings_len;
+    for (int i = 0; i < pl->env_count; i++) wire_add_string(req, pl->env[i]);
+}
+
+// Send req: the header with dir attached, then the strings
+static int wire_send(int sock, const struct wire_request *req, int dir) {
+    if (send_with_fd(sock, req, sizeof(*req), dir) == -1) return -1;
+    for (size_t sent = 0; sent < req->strings_len; sent += WIRE_CHUNK) {
+        size_t len = req->strings_len - sent < WIRE_CHUNK ? req->strings_len - sent : WIRE_CHUNK;
+        if (send_with_fd(sock, req->strings + sent, len, -1) == -1) return -1;
+    }
+    return 0;
+}
+
+// Receive what wire_send() sent, into malloc'd memory; NULL on failure
+static struct wire_request *wire_receive(int sock, int *dir) {
+    struct wire_request header;
+    if (recv_with_fd(sock, &header, sizeof(header), dir) != sizeof(header) || *dir < 0 ||
+        header.strings_len == 0 || header.strings_len > wire_strings_max())
+        return NULL;
+    struct wire_request *req = malloc(sizeof(*req) + header.strings_len);
+    if (!req) return NULL;
+    *req = header;
+    for (size_t got = 0; got < header.strings_len;) {
+        int fd;
+        ssize_t n = recv_with_fd(sock, req->strings + got, header.strings_len - got, &fd);
+        if (fd >= 0) close(fd);
+        if (n <= 0) return NULL;
+        got += n;
+    }
+    return req;
+}
+
+// Rebuild a pipeline from a received request; pointers refer into req->strings
+static int wire_decode(struct wire_request *req, struct pipeline *pl) {
+    if (req->count < 1 || req->count > MAX_STAGES || req->strings_len == 0 ||
+        req->strings[req->strings_len - 1] != '\0')
+        return -1;
+
+    if (req->terminal && req->count != 1) return -1;
+
+    memset(pl->stages, 0, sizeof(pl->stages));
+    pl->count = req->count;
+    pl->terminal = req->terminal;
+    pl->winsize = req->winsize;
+    for (int i = 0; i < pl->count; i++) {
+        struct wire_stage *ws = &req->stages[i];
+        struct stage *st = &pl->stages[i];
+        if (ws->argc < 1 || ws->argc > (int32_t)req->strings_len || ws->argv < 0) return -1;
+        st->argv = arena_alloc(pl->arena, (ws->argc + 1) * sizeof(char *));
+        st->argv[ws->argc] = NULL;
+        size_t pos = ws->argv;
+        for (int a = 0; a < ws->argc; a++) {
+            if (pos >= req->strings_len) return -1;
+            st->argv[a] = req->strings + pos;
+            pos += strlen(st->argv[a]) + 1;
+        }
+        st->argc = ws->argc;
+        if (ws->in_file >= (int32_t)req->strings_len || ws->out_file >= (int32_t)req->strings_len ||
+            ws->path >= (int32_t)req->strings_len)
+            return -1;
+        st->in_file = ws->in_file >= 0 ? req->strings + ws->in_file : NULL;
+        st->out_file = ws->out_file >= 0 ? req->strings + ws->out_file : NULL;
+        st->path = ws->path >= 0 ? req->strings + ws->path : NULL;
+        st->append = ws->append;
+        st->err = ws->err == ERR_STDOUT_PIPE || ws->err == ERR_STDOUT_FILE ? ws->err : ERR_CAPTURE;
+    }
+
+    if (req->env_count < 0 || req->env_count > (int32_t)req->strings_len || req->env < 0) return -1;
+    pl->env_count = req->env_count;
+    pl->env = arena_alloc(pl->arena, (pl->env_count + 1) * sizeof(char *));
+    size_t pos = req->env;
+    for (int i = 0; i < pl->env_count; i++) {
+        if (pos >= req->strings_len) return -1;
+        pl->env[i] = req->strings + pos;
+        pos += strlen(pl->env[i]) + 1;
+    }
+    return 0;
+}
+
+// Supervisor: serve one launch request on sock, then exit
+static void executor_supervise(int sock) {
+    struct pipeline *pl = malloc(sizeof(*pl));
+    struct arena arena = ARENA_INIT;
+    pl->arena = &arena;
+    int dir;
+    struct wire_request *req = wire_receive(sock, &dir);
+    if (!req || wire_decode(req, pl) < 0)
+        _exit(1);
+
+    // Take on the session's variables, so posix_spawnp() also searches a
+    // PATH the session set; this process is single-threaded and short-lived
+    for (int i = 0; i < pl->env_count; i++) {
+        char *eq = strchr(pl->env[i], '=');
+        if (eq) {
+            *eq = '\0';
+            setenv(pl->env[i], eq + 1, 1);
+        } else {
+            unsetenv(pl->env[i]);
+        }
+    }
+    pl->env_count = 0;
+    // Set here, the limits are inherited by every stage from the start
+    apply_limits(&req->limits);
+
+    struct wire_reply reply = { 0 };
+    pid_t pids[MAX_STAGES];
+    int out_fd;
+    reply.count = pl->terminal ? spawn_terminal(pl, dir, pids, &out_fd)
+                               : spawn_pipeline(pl, dir, pids, &out_fd);
+    close(dir);
+    if (reply.count == 0)
+        _exit(1);
+    for (int i = 0; i < reply.count; i++) reply.pids[i] = pids[i];
+    send_with_fd(sock, &reply, sizeof(reply), out_fd);
+    close(out_fd);
+
+    reply.timed_out = supervise(pids, reply.count, req->limits.timeout_ms, reply.codes, &reply.usage);
+    send_with_fd(sock, &reply, sizeof(reply), -1);
+    _exit(0);
+}
+
+static void executor_main(int listen_fd, pid_t parent) {
+    // Go away with the server that started us
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != parent) _exit(0);
+    // Supervisors are reaped automatically; they reset this for their own children
+    signal(SIGCHLD, SIG_IGN);
+
+    while (1) {
+        int sock = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (sock == -1) continue;
+        pid_t pid = fork();
+        if (pid == 0) {
+            signal(SIGCHLD, SIG_DFL);
+            close(listen_fd);
+            executor_supervise(sock);
+        }
+        close(sock);
+    }
+}
+
+// Whether something accepts connections at the executor's address
+static int executor_alive(void) {
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    int alive = sock != -1 && connect(sock, (struct sockaddr *)&executor_addr, executor_addr_len) == 0;
+    if (sock != -1) close(sock);
+    return alive;
+}
+
+// Bind the executor's socket and fork the daemon that serves it
+static int executor_spawn(void) {
+    // A socket file left by a daemon that has gone would refuse the bind
+    if (executor_addr.sun_path[0]) unlink(executor_addr.sun_path);
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1 ||
+        bind(listen_fd, (struct sockaddr *)&executor_addr, executor_addr_len) == -1 ||
+        listen(listen_fd, SOMAXCONN) == -1) {
+        perror("executor socket");
+        if (listen_fd != -1) close(listen_fd);
+        return -1;
+    }
+
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        close(listen_fd);
+        return -1;
+    }
+    if (pid == 0)
+        executor_main(listen_fd, parent);
+
+    close(listen_fd);
+    // Reap the daemon this one replaces
+    if (executor_pid > 0) waitpid(executor_pid, NULL, WNOHANG);
+    executor_pid = pid;
+    return 0;
+}
+
+int executor_start(void) {
+    const char *path = getenv("WEBSHELL_EXECUTOR_SOCKET");
+    memset(&executor_addr, 0, sizeof(executor_addr));
+    executor_addr.sun_family = AF_UNIX;
+    if (path && *path) {
+        snprintf(executor_addr.sun_path, sizeof(executor_addr.sun_path), "%s", path);
+        executor_addr_len = sizeof(executor_addr);
+    } else {
+        // Abstract socket name private to this server
+        int n = snprintf(executor_addr.sun_path + 1, sizeof(executor_addr.sun_path) - 1,
+                         "webshell-executor-%d", (int)getpid());
+        executor_addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + n;
+    }
+
+    // Share an executor that another server already runs at this path
+    if (path && *path && executor_alive()) {
+        executor_available = 1;
+        return 0;
+    }
+    if (executor_spawn() == -1) return -1;
+    executor_available = 1;
+    return 0;
+}
+
+// Connect to the executor, starting a new one if it has died. That forks
+// the running server, threads and all, but the daemon only accepts
+// connections and forks supervisors, which touch nothing of the server's
+// state. Returns the socket, or -1 if there is no executor and none can be
+// started.
+static int executor_connect(void) {
+    for (int attempt = 0; attempt < 3; attempt++) {
+        int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (sock == -1) return -1;
+        if (connect(sock, (struct sockaddr *)&executor_addr, executor_addr_len) == 0) return sock;
+        int err = errno;
+        close(sock);
+        if (err == EINTR || err == EAGAIN) continue;
+        if (err != ECONNREFUSED && err != ENOENT) return -1;
+
+        // Another thread may have started one meanwhile
+        pthread_mutex_lock(&executor_lock);
+        int ok = executor_alive();
+        if (!ok && (ok = executor_spawn() == 0)) fprintf(stderr, "Executor restarted\n");
+        pthread_mutex_unlock(&executor_lock);
+        if (!ok) return -1;
+    }
+    return -1;
+}
+
+// Ask the executor to start a pipeline. Returns -1 if there is no executor,
+// LAUNCH_TOO_LONG if the pipeline's strings are more than exec would take,
+// LAUNCH_LOST if the request went unanswered.
+static int executor_launch(struct pipeline *pl, int dir, const struct limits *limits, struct shell_process *proc) {
+    if (!executor_available) return -1;
+
+    size_t size = wire_strings_size(pl);
+    if (size > wire_strings_max()) return LAUNCH_TOO_LONG;
+    struct wire_request *req = arena_alloc(pl->arena, sizeof(*req) + size);
+    wire_encode(pl, req);
+    req->limits = *limits;
+
+    int sock = executor_connect();
+    if (sock == -1) return -1;
+    struct wire_reply reply;
+    int out_fd = -1;
+    if (wire_send(sock, req, dir) == -1 ||
+        recv_with_fd(sock, &reply, sizeof(reply), &out_fd) != sizeof(reply) || out_fd < 0) {
+        if (out_fd >= 0) close(out_fd);
+        close(sock);
+        return LAUNCH_LOST;
+    }
+
+    proc->out_fd = out_fd;
+    proc->channel = sock;
+    proc->pid_count = 0;
+    proc->stage_count = reply.count;
+    for (int i = 0; i < reply.count && i < MAX_STAGES; i++) proc->pids[i] = reply.pids[i];
+    return 0;
+}
+
+// ---------- LAUNCHING & WAITING ----------
+
+// Supervises in-process stages on a thread and reports on a socket pair just
+// as a supervisor process would, so callers treat both the same way
+struct supervisor_thread {
+    int sock;
+    int count;
+    pid_t pids[MAX_STAGES];
+    int64_t timeout_ms;
+};
+
+static void *supervisor_main(void *arg) {
+    struct supervisor_thread *sup = arg;
+    struct wire_reply reply = { .count = sup->count };
+    for (int i = 0; i < sup->count; i++) reply.pids[i] = sup->pids[i];
+    reply.timed_out = supervise(sup->pids, sup->count, sup->timeout_ms, reply.codes, &reply.usage);
+    send_with_fd(sup->sock, &reply, sizeof(reply), -1);
+    close(sup->sock);
+    free(sup);
+    return NULL;
+}
+
+// Hand in-process stages to a supervisor thread; if none can be started they
+// are left for the caller to reap, without a deadline
+static void supervise_in_process(struct shell_process *proc, int64_t timeout_ms) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) return;
+    struct supervisor_thread *sup = malloc(sizeof(*sup));
+    sup->sock = sv[1];
+    sup->count = proc->stage_count;
+    memcpy(sup->pids, proc->pids, sizeof(sup->pids));
+    sup->timeout_ms = timeout_ms;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, supervisor_main, sup);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        close(sv[0]);
+        close(sv[1]);
+        free(sup);
+        return;
+    }
+    proc->channel = sv[0];
+    proc->pid_count = 0;
+}
+
+// Limits for a pipeline about to start: the job deadline for jobs and
+// terminals, otherwise the foreground one, shortened by shell_set_timeout()
+static void pipeline_limits(struct pipeline *pl, struct limits *l) {
+    pthread_once(&limits_once, limits_init);
+    *l = configured;
+    if (pl->background >= 0 || pl->terminal) l->timeout_ms = job_timeout_ms;
+    if (thread_timeout_ms > 0 && (l->timeout_ms <= 0 || thread_timeout_ms < l->timeout_ms))
+        l->timeout_ms = thread_timeout_ms;
+}
+
+// Start a pipeline through the executor, or in-process if it is unavailable
+// and no rlimits are asked for. Returns 0, or -1 or LAUNCH_TOO_LONG (see
+// launch_error()).
+static int launch_pipeline(struct pipeline *pl, struct shell_process *proc) {
+    struct session *session = shell_session();
+    pl->env_count = session_env(session, pl->arena, &pl->env);
+    // The cache follows the server's PATH; a session's own PATH is searched
+    // by the executor (in-process spawns keep using the server's)
+    int own_path = pl->env_count > 0 && session_has_env(session, "PATH");
+    for (int i = 0; i < pl->count; i++) {
+        struct stage *st = &pl->stages[i];
+        st->path = !own_path && path_cache_lookup(st->argv[0], pl->paths[i], sizeof(pl->paths[i])) == 0
+                       ? pl->paths[i] : NULL;
+    }
+    // Full-screen programs need to know what they are drawing on
+    if (pl->terminal && !session_has_env(session, "TERM")) {
+        char **env = arena_alloc(pl->arena, (pl->env_count + 1) * sizeof(char *));
+        for (int i = 0; i < pl->env_count; i++) env[i] = pl->env[i];
+        env[pl->env_count++] = "TERM=xterm-256color";
+        pl->env = env;
+    }
+
+    struct limits limits;
+    pipeline_limits(pl, &limits);
+    int dir = cwd_acquire();
+    proc->started_ns = metrics_now();
+    int ok = executor_launch(pl, dir, &limits, proc);
+    if (ok == LAUNCH_TOO_LONG) {
+        // Spawned in-process it would fail with E2BIG just the same
+    } else if (ok == LAUNCH_LOST) {
+        // Some stages may have started, so it is not tried again
+        ok = -1;
+    } else if (ok < 0 && has_rlimits(&limits)) {
+        static _Atomic int warned;
+        if (warned++ == 0)
+            fprintf(stderr, "Executor unavailable: refusing commands, since resource limits cannot be "
+                            "enforced in-process (set the WEBSHELL_*_LIMIT variables to 0 to allow them)\n");
+    } else if (ok < 0) {
+        proc->channel = -1;
+        proc->pid_count = proc->stage_count = pl->terminal
+            ? spawn_terminal(pl, dir, proc->pids, &proc->out_fd)
+            : spawn_pipeline(pl, dir, proc->pids, &proc->out_fd);
+        ok = proc->stage_count > 0 ? 0 : -1;
+        if (ok == 0) supervise_in_process(proc, limits.timeout_ms);
+    }
+    close(dir);
+    if (ok < 0) metrics_count(METRIC_SPAWN_FAILURES, 1);
+    else metrics_observe(METRIC_SPAWN, metrics_now() - proc->started_ns);
+    return ok;
+}
+
+// Report a launch_pipeline() failure the way a shell would
+static void launch_error(int result, struct outbuf *out) {
+    if (result == LAUNCH_TOO_LONG) {
+        outbuf_printf(out, "Error: %s.\n", strerror(E2BIG));
+        record_status(126);
+    } else {
+        outbuf_printf(out, "Error: could not start command.\n");
+        record_status(127);
+    }
+}
+
+// Wait for a launched pipeline (its output already read), record PIPESTATUS
+// and time the command
+static void wait_pipeline(struct shell_process *proc) {
+    struct shell_usage usage = { 0 };
+    if (proc->channel >= 0) {
+        struct wire_reply reply;
+        int fd;
+        if (recv_with_fd(proc->channel, &reply, sizeof(reply), &fd) == sizeof(reply) &&
+            reply.count == proc->stage_count) {
+            memcpy(last_status, reply.codes, reply.count * sizeof(int));
+            usage = reply.usage;
+            last_stop = stop_reason(reply.timed_out, reply.codes, reply.count);
+        } else {
+            for (int i = 0; i < proc->stage_count; i++) last_status[i] = 127;
+        }
+        close(proc->channel);
+        proc->channel = -1;
+    } else {
+        for (int i = 0; i < proc->pid_count; i++)
+            last_status[i] = reap_stage(proc->pids[i], &usage);
+    }
+    last_status_count = proc->stage_count;
+    metrics_observe(METRIC_COMMAND_WALL, metrics_now() - proc->started_ns);
+    metrics_observe(METRIC_COMMAND_CPU, (usage.user_us + usage.sys_us) * 1000);
+}
+
+// Run a parsed pipeline to completion, capturing output and every exit status
+static size_t execute_pipeline(struct pipeline *pl, struct outbuf *out) {
+    struct shell_process proc;
+    int launched = launch_pipeline(pl, &proc);
+    if (launched < 0) {
+        launch_error(launched, out);
+        return out->len;
+    }
+
+    size_t len = collect_output(proc.out_fd, out);
+    close(proc.out_fd);
+    wait_pipeline(&proc);
+    return len;
+}
+
+// Run the trailing wc/grep/head/tail stages of a pipeline in-process, fed
+// straight from the output pipe of the stages before them (or from files when
+// every stage is one of them). Returns 0 if the pipeline does not end in one.
+static int run_filters(struct pipeline *pl, struct outbuf *out) {
+    struct filter *chain = NULL;
+    int first = pl->count;
+    while (first > 0) {
+        struct stage *st = &pl->stages[first - 1];
+        struct filter *f = arena_alloc(pl->arena, sizeof(*f));
+        if (st->argc == 0 || st->out_file || st->err != ERR_CAPTURE || filter_parse(f, st->argc, st->argv) < 0)
+            break;
+        // Only the first stage may read files; later ones read the pipe
+        if ((first > 1 && (st->in_file || f->file_count)) || (st->in_file && f->file_count))
+            break;
+        f->next = chain;
+        f->out = out;
+        chain = f;
+        first--;
+    }
+    if (!chain) return 0;
+
+    for (struct filter *f = chain->next; f; f = f->next) {
+        if (f->kind == FILTER_WC) f->width = wc_width(f, -1, NULL);
+        filter_begin(f, NULL, 0);
+    }
+
+    if (first == 0) {
+        int dir = cwd_acquire();
+        filter_run_files(chain, dir, pl->stages[0].in_file);
+        close(dir);
+        last_status_count = 0;
+    } else {
+        pl->count = first;       // launch only the stages before the filters
+        struct shell_process proc;
+        int launched = launch_pipeline(pl, &proc);
+        if (launched < 0) {
+            launch_error(launched, out);
+            return 1;
+        }
+        if (chain->kind == FILTER_WC) chain->width = wc_width(chain, -1, NULL);
+        filter_begin(chain, NULL, 0);
+        char *buf = malloc(FILTER_CHUNK);
+        while (!chain->done) {
+            ssize_t n = read(proc.out_fd, buf, FILTER_CHUNK);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            metrics_count(METRIC_PIPE_BYTES, n);
+            filter_feed(chain, buf, n);
+        }
+        free(buf);
+        // Once head has what it needs, closing the pipe stops the writers
+        close(proc.out_fd);
+        wait_pipeline(&proc);
+        filter_end(chain);
+        filter_finish(chain);
+    }
+
+    for (struct filter *f = chain->next; f; f = f->next) {
+        filter_end(f);
+        filter_finish(f);
+    }
+    for (struct filter *f = chain; f && last_status_count < MAX_STAGES; f = f->next)
+        last_status[last_status_count++] = f->status;
+    return 1;
+}
+
+// A one-stage pipeline running argv with no redirections
+static void simple_pipeline(struct pipeline *pl, char **argv, struct arena *arena) {
+    memset(pl->stages, 0, sizeof(pl->stages));
+    pl->count = 1;
+    pl->arena = arena;
+    pl->env = NULL;
+    pl->env_count = 0;
+    pl->background = -1;
+    pl->terminal = 0;
+    pl->stages[0].argv = argv;
+    while (argv[pl->stages[0].argc]) pl->stages[0].argc++;
+}
+
+// Execute external Linux command and capture output
+static void execute_system_command(char **args, struct outbuf *out, struct arena *arena) {
+    struct pipeline *pl = arena_alloc(arena, sizeof(*pl));
+    simple_pipeline(pl, args, arena);
+    if (execute_pipeline(pl, out) == 0)
+        outbuf_printf(out, "Command executed successfully (no output).\n");
+}
+
+// One-stage pipeline running input through /bin/sh -c
+static void sh_pipeline(struct pipeline *pl, char *input, struct arena *arena) {
+    char **argv = arena_alloc(arena, 4 * sizeof(char *));
+    argv[0] = "/bin/sh", argv[1] = "-c", argv[2] = input, argv[3] = NULL;
+    simple_pipeline(pl, argv, arena);
+}
+
+// Handle piping or redirection
+void handle_redirection_and_piping(char *input, struct outbuf *out) {
+    struct arena scratch = ARENA_INIT;
+    struct arena *arena = out->arena ? out->arena : &scratch;
+    struct pipeline *pl = arena_alloc(arena, sizeof(*pl));
+    sh_pipeline(pl, input, arena);
+    execute_pipeline(pl, out);
+    arena_free(&scratch);
+}
+
+// ---------- BACKGROUND JOBS ----------
+// A command line ending in a lone & is launched like any other pipeline, but
+// instead of the worker reading its output, a monitor thread does: it keeps
+// the last JOB_OUTPUT bytes in a ring per job and notes the exit statuses
+// (from the executor's final reply, or by reaping in-process children when
+// their pidfds turn readable). The request returns as soon as the job has
+// started. Jobs belong to the session that started them; the table keeps
+// JOB_MAX of them, dropping the oldest finished job to make room.
+
+#define JOB_MAX 64
+
+enum job_watch_kind { JOB_WATCH_OUTPUT, JOB_WATCH_CHANNEL, JOB_WATCH_PIDFD };
+
+// What a monitor epoll registration points at
+struct job_watch {
+    struct job *job;
+    enum job_watch_kind kind;
+    int stage;                   // JOB_WATCH_PIDFD
+};
+
+struct job {
+    int id;                      // 0: free slot, -1: being launched
+    char owner[SESSION_ID_LEN + 1];
+    char command[256];
+    struct shell_process proc;
+    int pidfds[MAX_STAGES];      // for kill; -1 if the stage never started or was gone
+    struct job_watch watches[MAX_STAGES + 2];
+    int pending;                 // output, statuses or stages still to hear from
+    int running;
+    int status[MAX_STAGES];
+    struct shell_usage usage;
+    const char *stop;            // shell_stop_reason() once done
+    int64_t started_ns, ended_ns;
+    char *ring;                  // output byte n is at ring[n % JOB_OUTPUT]
+    uint64_t total;              // output bytes so far
+};
+
+static struct job jobs[JOB_MAX];
+static int next_job_id = 1;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_changed = PTHREAD_COND_INITIALIZER;
+static pthread_once_t monitor_once = PTHREAD_ONCE_INIT;
+static int monitor_fd = -1;
+static __thread int last_job;
+
+static void ring_append(struct job *job, const char *data, size_t len) {
+    if (len > JOB_OUTPUT) {
+        job->total += len - JOB_OUTPUT;
+        data += len - JOB_OUTPUT;
+        len = JOB_OUTPUT;
+    }
+    size_t pos = job->total % JOB_OUTPUT;
+    size_t first = len < JOB_OUTPUT - pos ? len : JOB_OUTPUT - pos;
+    memcpy(job->ring + pos, data, first);
+    memcpy(job->ring, data + first, len - first);
+    job->total += len;
+}
+
+// Append the output from byte since (or the oldest one still held) to out;
+// returns the offset of the first byte appended
+static uint64_t ring_copy(struct job *job, uint64_t since, struct outbuf *out) {
+    uint64_t oldest = job->total > JOB_OUTPUT ? job->total - JOB_OUTPUT : 0;
+    uint64_t start = since < oldest ? oldest : since > job->total ? job->total : since;
+    for (uint64_t n = start; n < job->total;) {
+        size_t pos = n % JOB_OUTPUT;
+        size_t len = job->total - n < JOB_OUTPUT - pos ? job->total - n : JOB_OUTPUT - pos;
+        outbuf_append(out, job->ring + pos, len);
+        n += len;
+    }
+    return start;
+}
+
+// Called with jobs_lock held once the job's last source is done
+static void job_finish(struct job *job) {
+    job->running = 0;
+    job->ended_ns = metrics_now();
+    for (int i = 0; i < job->proc.stage_count; i++) {
+        if (job->pidfds[i] >= 0) close(job->pidfds[i]);
+        job->pidfds[i] = -1;
+    }
+    metrics_observe(METRIC_COMMAND_WALL, job->ended_ns - job->started_ns);
+    metrics_observe(METRIC_COMMAND_CPU, (job->usage.user_us + job->usage.sys_us) * 1000);
+    pthread_cond_broadcast(&jobs_changed);
+}
+
+static void job_source_done(struct job *job, int fd, int close_fd) {
+    epoll_ctl(monitor_fd, EPOLL_CTL_DEL, fd, NULL);
+    if (close_fd) close(fd);
+    if (--job->pending == 0) job_finish(job);
+}
+
+// One readable source of a job; called with jobs_lock held
+static void job_event(struct job_watch *watch) {
+    struct job *job = watch->job;
+    char buf[16384];
+    switch (watch->kind) {
+        case JOB_WATCH_OUTPUT: {
+            ssize_t n = read(job->proc.out_fd, buf, sizeof(buf));
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+            if (n > 0) {
+                metrics_count(METRIC_PIPE_BYTES, n);
+                ring_append(job, buf, n);
+                return;
+            }
+            job_source_done(job, job->proc.out_fd, 1);
+            job->proc.out_fd = -1;
+            return;
+        }
+        case JOB_WATCH_CHANNEL: {
+            struct wire_reply reply;
+            int fd;
+            if (recv_with_fd(job->proc.channel, &reply, sizeof(reply), &fd) == sizeof(reply) &&
+                reply.count == job->proc.stage_count) {
+                memcpy(job->status, reply.codes, reply.count * sizeof(int));
+                job->usage = reply.usage;
+                job->stop = stop_reason(reply.timed_out, reply.codes, reply.count);
+            } else {
+                for (int i = 0; i < job->proc.stage_count; i++) job->status[i] = 127;
+            }
+            job_source_done(job, job->proc.channel, 1);
+            job->proc.channel = -1;
+            return;
+        }
+        case JOB_WATCH_PIDFD: {
+            int status;
+            struct rusage ru;
+            if (wait4(job->proc.pids[watch->stage], &status, WNOHANG, &ru) <= 0) return;
+            job->status[watch->stage] = exit_code(status);
+            add_usage(&job->usage, &ru);
+            job_source_done(job, job->pidfds[watch->stage], 0);
+            return;
+        }
+    }
+}
+
+static void *job_monitor(void *arg) {
+    (void)arg;
+    struct epoll_event events[16];
+    while (1) {
+        int n = epoll_wait(monitor_fd, events, 16, -1);
+        pthread_mutex_lock(&jobs_lock);
+        for (int i = 0; i < n; i++)
+            job_event(events[i].data.ptr);
+        pthread_mutex_unlock(&jobs_lock);
+    }
+    return NULL;
+}
+
+static void monitor_start(void) {
+    monitor_fd = epoll_create1(EPOLL_CLOEXEC);
+    pthread_t thread;
+    if (monitor_fd == -1 || pthread_create(&thread, NULL, job_monitor, NULL) != 0) {
+        perror("job monitor");
+        if (monitor_fd != -1) close(monitor_fd);
+        monitor_fd = -1;
+        return;
+    }
+    pthread_detach(thread);
+}
+
+static void job_watch_add(struct job *job, int slot, enum job_watch_kind kind, int stage, int fd) {
+    struct job_watch *watch = &job->watches[slot];
+    *watch = (struct job_watch){ job, kind, stage };
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = watch };
+    epoll_ctl(monitor_fd, EPOLL_CTL_ADD, fd, &ev);
+    job->pending++;
+}
+
+// A free slot, or the oldest finished job's; NULL if every job is running.
+// Called with jobs_lock held.
+static struct job *job_slot(void) {
+    struct job *oldest = NULL;
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].id == 0) return &jobs[i];
+        if (jobs[i].id > 0 && !jobs[i].running && (!oldest || jobs[i].id < oldest->id)) oldest = &jobs[i];
+    }
+    return oldest;
+}
+
+// Job id of owner, or NULL. Called with jobs_lock held.
+static struct job *job_find(const char *owner, int id) {
+    for (int i = 0; i < JOB_MAX; i++)
+        if (id > 0 && jobs[i].id == id && strcmp(jobs[i].owner, owner) == 0) return &jobs[i];
+    return NULL;
+}
+
+// Launch pl as a job of the calling thread's session and print "[id] pid"
+static void start_job(struct pipeline *pl, const char *command, struct outbuf *out) {
+    pthread_once(&monitor_once, monitor_start);
+    pthread_mutex_lock(&jobs_lock);
+    struct job *job = monitor_fd < 0 ? NULL : job_slot();
+    // The ring is in place before anything starts, so the monitor never
+    // sees a job without one
+    if (job && !job->ring) job->ring = malloc(JOB_OUTPUT);
+    if (job && job->ring) job->id = -1;
+    else job = NULL;
+    pthread_mutex_unlock(&jobs_lock);
+    if (!job) {
+        outbuf_printf(out, "Error: too many jobs.\n");
+        record_status(1);
+        return;
+    }
+
+    struct shell_process proc;
+    int launched = launch_pipeline(pl, &proc);
+    if (launched < 0) {
+        pthread_mutex_lock(&jobs_lock);
+        job->id = 0;
+        pthread_mutex_unlock(&jobs_lock);
+        launch_error(launched, out);
+        return;
+    }
+    fcntl(proc.out_fd, F_SETFL, fcntl(proc.out_fd, F_GETFL) | O_NONBLOCK);
+
+    pthread_mutex_lock(&jobs_lock);
+    snprintf(job->owner, sizeof(job->owner), "%s", session_id(shell_session()));
+    snprintf(job->command, sizeof(job->command), "%s", command);
+    job->proc = proc;
+    job->started_ns = proc.started_ns;
+    job->total = 0;
+    job->pending = 0;
+    job->running = 1;
+    job->stop = NULL;
+    memset(&job->usage, 0, sizeof(job->usage));
+    for (int i = 0; i < proc.stage_count; i++) {
+        // Stages that never started report 127 like they do in the foreground
+        job->status[i] = 127;
+        job->pidfds[i] = proc.pids[i] > 0 ? syscall(SYS_pidfd_open, proc.pids[i], 0) : -1;
+    }
+    job_watch_add(job, 0, JOB_WATCH_OUTPUT, 0, proc.out_fd);
+    if (proc.channel >= 0) {
+        job_watch_add(job, 1, JOB_WATCH_CHANNEL, 0, proc.channel);
+    } else {
+        for (int i = 0; i < proc.pid_count; i++)
+            if (job->pidfds[i] >= 0) job_watch_add(job, 2 + i, JOB_WATCH_PIDFD, i, job->pidfds[i]);
+    }
+    job->id = next_job_id++;
+    last_job = job->id;
+    outbuf_printf(out, "[%d] %d\n", job->id, (int)proc.pids[proc.stage_count - 1]);
+    pthread_mutex_unlock(&jobs_lock);
+    record_status(0);
+}
+
+// Job number from "%N" or "N"; -1 if arg is neither
+static int job_arg(const char *arg) {
+    if (*arg == '%') arg++;
+    char *end;
+    long id = strtol(arg, &end, 10);
+    return *arg && *end == '\0' && id > 0 && id < INT_MAX ? (int)id : -1;
+}
+
+static const char *job_state(const struct job *job, char *buf, size_t size) {
+    int code = job->status[job->proc.stage_count - 1];
+    if (job->running) return "Running";
+    if (code == 0) return "Done";
+    if (code > 128) snprintf(buf, size, "%s%s%s%s", strsignal(code - 128), job->stop ? " (" : "",
+                             job->stop ? job->stop : "", job->stop ? ")" : "");
+    else snprintf(buf, size, "Exit %d", code);
+    return buf;
+}
+
+// jobs
+void jobs_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)argc, (void)argv, (void)args;
+    const char *owner = session_id(shell_session());
+    pthread_mutex_lock(&jobs_lock);
+    // Slots are reused out of order, so list by id
+    for (int last = 0;;) {
+        struct job *next = NULL;
+        for (int i = 0; i < JOB_MAX; i++)
+            if (jobs[i].id > last && strcmp(jobs[i].owner, owner) == 0 && (!next || jobs[i].id < next->id))
+                next = &jobs[i];
+        if (!next) break;
+        char state[64];
+        outbuf_printf(out, "[%d]  %-22s %s\n", next->id, job_state(next, state, sizeof(state)), next->command);
+        last = next->id;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+// Block until job id (or, with id 0, every job of owner) has finished.
+// Returns the job's exit status, or -1 if there is no such job.
+static int job_wait(const char *owner, int id) {
+    int code = 0;
+    pthread_mutex_lock(&jobs_lock);
+    if (id == 0) {
+        for (int i = 0; i < JOB_MAX; i++)
+            while (jobs[i].id > 0 && jobs[i].running && strcmp(jobs[i].owner, owner) == 0)
+                pthread_cond_wait(&jobs_changed, &jobs_lock);
+    } else {
+        struct job *job = job_find(owner, id);
+        // Running jobs keep their slot, so job stays valid while waiting
+        while (job && job->running) pthread_cond_wait(&jobs_changed, &jobs_lock);
+        code = job ? job->status[job->proc.stage_count - 1] : -1;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+    return code;
+}
+
+// wait [%id ...]
+void wait_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    const char *owner = session_id(shell_session());
+    if (argc == 1) job_wait(owner, 0);
+    for (int i = 1; i < argc; i++) {
+        int code = job_wait(owner, job_arg(argv[i]));
+        if (code < 0) {
+            outbuf_printf(out, "wait: %s: no such job\n", argv[i]);
+            code = 127;
+        }
+        record_status(code);
+    }
+}
+
+// fg [%id]: wait for a job (the latest by default) and show its output
+void fg_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    const char *owner = session_id(shell_session());
+    int id = argc > 1 ? job_arg(argv[1]) : 0;
+    if (id == 0) {
+        pthread_mutex_lock(&jobs_lock);
+        for (int i = 0; i < JOB_MAX; i++)
+            if (jobs[i].id > id && strcmp(jobs[i].owner, owner) == 0) id = jobs[i].id;
+        pthread_mutex_unlock(&jobs_lock);
+    }
+    int code = id > 0 ? job_wait(owner, id) : -1;
+    if (code < 0) {
+        outbuf_printf(out, "fg: %s: no such job\n", argc > 1 ? argv[1] : "current");
+        record_status(1);
+        return;
+    }
+    pthread_mutex_lock(&jobs_lock);
+    struct job *job = job_find(owner, id);
+    if (job) {
+        outbuf_printf(out, "%s\n", job->command);
+        ring_copy(job, 0, out);
+    }
+    pthread_mutex_unlock(&jobs_lock);
+    record_status(code);
+}
+
+// SIGHUP every running job of owner, through pidfds like kill %job
+static void jobs_hangup(const char *owner) {
+    pthread_mutex_lock(&jobs_lock);
+    for (int i = 0; i < JOB_MAX; i++) {
+        struct job *job = &jobs[i];
+        if (job->id <= 0 || !job->running || strcmp(job->owner, owner) != 0) continue;
+        for (int j = 0; j < job->proc.stage_count; j++)
+            if (job->pidfds[j] >= 0) syscall(SYS_pidfd_send_signal, job->pidfds[j], SIGHUP, NULL, 0);
+    }
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+// Signal number from "9", "KILL" or "SIGKILL"; -1 if unknown
+static int signal_number(const char *name) {
+    char *end;
+    long n = strtol(name, &end, 10);
+    if (*name && *end == '\0') return n > 0 && n < NSIG ? (int)n : -1;
+    if (strncasecmp(name, "SIG", 3) == 0) name += 3;
+    for (int sig = 1; sig < NSIG; sig++) {
+        const char *abbrev = sigabbrev_np(sig);
+        if (abbrev && strcasecmp(abbrev, name) == 0) return sig;
+    }
+    return -1;
+}
+
+// kill [-SIGNAL] %job|pid ...
+void kill_cmd(int argc, char **argv, char *args, struct outbuf *out) {
+    (void)args;
+    int sig = SIGTERM, first = 1;
+    if (argv[1][0] == '-' && argc > 2) {
+        if ((sig = signal_number(argv[1] + 1)) < 0) {
+            outbuf_printf(out, "kill: %s: invalid signal specification\n", argv[1] + 1);
+            record_status(1);
+            return;
+        }
+        first = 2;
+    }
+    const char *owner = session_id(shell_session());
+    for (int i = first; i < argc; i++) {
+        int ok = 0;
+        if (argv[i][0] == '%') {
+            // Through pidfds, so a stage that has gone cannot hit a reused pid
+            pthread_mutex_lock(&jobs_lock);
+            struct job *job = job_find(owner, job_arg(argv[i]));
+            if (job && job->running) {
+                for (int j = 0; j < job->proc.stage_count; j++)
+                    if (job->pidfds[j] >= 0 && syscall(SYS_pidfd_send_signal, job->pidfds[j], sig, NULL, 0) == 0)
+                        ok = 1;
+            }
+            pthread_mutex_unlock(&jobs_lock);
+            if (!ok) errno = ESRCH;
+        } else {
+            char *end;
+            long pid = strtol(argv[i], &end, 10);
+            if (*end == '\0' && pid > 0) ok = kill(pid, sig) == 0;
+            else errno = EINVAL;
+        }
+        if (!ok) {
+            outbuf_printf(out, "kill: %s: %s\n", argv[i], errno == ESRCH ? "no such job or process" : strerror(errno));
+            record_status(1);
+        }
+    }
+}
+
+int shell_job_info(struct session *session, int id, uint64_t since, struct job_info *info, struct outbuf *out) {
+    const char *owner = session_id(session ? session : session_default());
+    pthread_mutex_lock(&jobs_lock);
+    struct job *job = job_find(owner, id);
+    if (job) {
+        info->id = job->id;
+        info->running = job->running;
+        info->pid = job->proc.pids[job->proc.stage_count - 1];
+        snprintf(info->command, sizeof(info->command), "%s", job->command);
+        info->status_count = job->running ? 0 : job->proc.stage_count;
+        memcpy(info->status, job->status, info->status_count * sizeof(int));
+        info->elapsed_ns = (job->running ? metrics_now() : job->ended_ns) - job->started_ns;
+        info->usage = job->usage;
+        info->stop_reason = job->stop;
+        info->output_start = ring_copy(job, since, out);
+        info->output_end = job->total;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+    return job ? 0 : -1;
+}
+
+int shell_last_job(void) {
+    return last_job;
+}
+
+// Start a line that ended in a lone & as a job. Every stage runs as a real
+// process, built-ins and filters included; sh gets the line without the &.
+static void run_background(struct pipeline *pl, enum parse_result parsed, char *input, struct outbuf *out) {
+    if (parsed == PARSE_NEEDS_SH) {
+        int background = pl->background;
+        char *line = arena_alloc(pl->arena, background + 1);
+        memcpy(line, input, background);
+        line[background] = '\0';
+        sh_pipeline(pl, line, pl->arena);
+        pl->background = background;     // still a job, for its deadline
+    }
+    start_job(pl, input, out);
+}
+
+// ---------- RESULT CACHE ----------
+// A pipeline made only of commands allowlisted in WEBSHELL_CACHE (see
+// result_cache.h) is served from the cache when the same words were run in
+// the same directory recently and none of the files involved has changed.
+// The files checked are the directory itself, < in_file and every argument
+// that is not an option; changes deeper down (du of a tree) are only picked
+// up when the entry expires. Redirecting output is a side effect, so > and
+// >> are never cached.
+
+#define CACHE_MAX_STAMPS 32
+
+static __thread int last_cache_result;
+
+static void cache_stamp(int dir, const char *path, struct cache_stamp *stamp) {
+    struct stat st;
+    memset(stamp, 0, sizeof(*stamp));
+    if (fstatat(dir, path, &st, 0) == -1) return;
+    stamp->dev = st.st_dev;
+    stamp->ino = st.st_ino;
+    stamp->mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    stamp->ctime_ns = st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+    stamp->size = st.st_size;
+}
+
+// Build pl's cache key (directory identity, every word and the session's
+// variables) in pl's arena and stamp the files it depends on. Returns NULL
+// if pl may not be cached.
+static char *cache_key(struct pipeline *pl, size_t *key_len, struct cache_stamp *stamps, int *stamp_count) {
+    for (int i = 0; i < pl->count; i++) {
+        struct stage *st = &pl->stages[i];
+        if (st->argc == 0 || st->out_file || !result_cache_allows(st->argv[0])) return NULL;
+    }
+
+    char **vars;
+    int var_count = session_env(shell_session(), pl->arena, &vars);
+    int dir = cwd_acquire();
+    cache_stamp(dir, ".", &stamps[0]);
+    int count = 1;
+    size_t len = 0, cap = 64;
+    for (int i = 0; i < var_count; i++) cap += strlen(vars[i]) + 1;
+    for (int i = 0; i < pl->count; i++) {
+        struct stage *st = &pl->stages[i];
+        for (int j = 0; j < st->argc; j++) cap += strlen(st->argv[j]) + 1;
+        if (st->in_file) cap += strlen(st->in_file) + 2;
+        cap++;
+    }
+    char *key = arena_alloc(pl->arena, cap);
+    len += snprintf(key, cap, "%lx:%lx", (unsigned long)stamps[0].dev, (unsigned long)stamps[0].ino) + 1;
+
+    for (int i = 0; i < pl->count && count >= 0; i++) {
+        struct stage *st = &pl->stages[i];
+        for (int j = 0; j < st->argc; j++) {
+            size_t n = strlen(st->argv[j]) + 1;
+            memcpy(key + len, st->argv[j], n);
+            len += n;
+            if (j > 0 && st->argv[j][0] != '-') {
+                if (count == CACHE_MAX_STAMPS) { count = -1; break; }
+                cache_stamp(dir, st->argv[j], &stamps[count++]);
+            }
+        }
+        if (st->in_file && count >= 0) {
+            if (count == CACHE_MAX_STAMPS) { count = -1; break; }
+            len += sprintf(key + len, "<%s", st->in_file) + 1;
+            cache_stamp(dir, st->in_file, &stamps[count++]);
+        }
+        key[len++] = st->err == ERR_CAPTURE ? '|' : '&';
+    }
+    for (int i = 0; i < var_count; i++) {
+        size_t n = strlen(vars[i]) + 1;
+        memcpy(key + len, vars[i], n);
+        len += n;
+    }
+    close(dir);
+    if (count < 0) return NULL;
+    *key_len = len;
+    *stamp_count = count;
+    return key;
+}
+
+// ---------- MAIN EXECUTION FUNCTION ----------
+
+static const char *syntax_error_message(enum parse_result result) {
+    return result == PARSE_BAD_QUOTE ? "Syntax error: unterminated quote.\n"
+                                     : "Syntax error: incomplete pipeline or redirection.\n";
+}
+
+// Run a one-stage, unredirected command if it is a built-in; returns 0 if not
+static int run_builtin(struct pipeline *pl, struct outbuf *out) {
+    struct stage *st = &pl->stages[0];
+    if (pl->count != 1 || st->argc == 0 || st->in_file || st->out_file || st->err != ERR_CAPTURE)
+        return 0;
+    const struct builtin *builtin = builtin_find(st->argv[0]);
+    if (!builtin) return 0;
+
+    // Other arities go to the system command of the same name (date +%s, ...)
+    if (st->argc - 1 < builtin->min_args || (builtin->max_args >= 0 && st->argc - 1 > builtin->max_args))
+        return 0;
+
+    // The arguments as one string, for names that may contain spaces
+    size_t len = 0;
+    for (int i = 1; i < st->argc; i++) len += strlen(st->argv[i]) + 1;
+    char *args = arena_alloc(pl->arena, len + 1);
+    args[0] = '\0';
+    for (int i = 1, pos = 0; i < st->argc; i++)
+        pos += sprintf(args + pos, "%s%s", i > 1 ? " " : "", st->argv[i]);
+
+    builtin->handler(st->argc, st->argv, args, out);
+    return 1;
+}
+
+// Run a natively parsed pipeline: in-process filters, a single external
+// command, or a pipeline of them
+static void run_pipeline(struct pipeline *pl, struct outbuf *out) {
+    if (run_filters(pl, out)) return;
+    if (pl->count == 1 && !pl->stages[0].in_file && !pl->stages[0].out_file)
+        execute_system_command(pl->stages[0].argv, out, pl->arena);
+    else
+        execute_pipeline(pl, out);
+}
+
+// Serve an allowlisted pipeline from the result cache, or run it and cache
+// its output. Returns 0 if it may not be cached.
+static int run_cached(struct pipeline *pl, struct outbuf *out) {
+    struct cache_stamp stamps[CACHE_MAX_STAMPS];
+    int stamp_count;
+    size_t key_len;
+    char *key = cache_key(pl, &key_len, stamps, &stamp_count);
+    if (!key) return 0;
+
+    if (result_cache_get(key, key_len, stamps, stamp_count, out, last_status, &last_status_count)) {
+        last_cache_result = SHELL_CACHE_HIT;
+        return 1;
+    }
+    last_cache_result = SHELL_CACHE_MISS;
+    size_t start = out->len, dropped = out->dropped;
+    run_pipeline(pl, out);
+
+    // Truncated output, commands that could not be started and commands
+    // stopped early are not kept
+    int ok = out->dropped == dropped && !last_stop;
+    for (int i = 0; i < last_status_count; i++)
+        if (last_status[i] == 126 || last_status[i] == 127) ok = 0;
+    if (ok)
+        result_cache_put(key, key_len, stamps, stamp_count, out->data + start, out->len - start,
+                         last_status, last_status_count);
+    return 1;
+}
+
+int shell_cache_result(void) {
+    return last_cache_result;
+}
+
+int execute_shell_command(char *input, struct outbuf *out) {
+    struct arena scratch = ARENA_INIT;
+    struct arena *arena = out->arena ? out->arena : &scratch;
+    struct pipeline *pl = arena_alloc(arena, sizeof(*pl));
+    struct session *session = shell_session();
+    session_history_add(session, input);
+    input = session_expand_alias(session, input, arena);
+    enum parse_result parsed = parse_pipeline(input, pl, arena);
+
+    record_status(0);
+    last_cache_result = SHELL_CACHE_BYPASS;
+    last_job = 0;
+    last_stop = NULL;
+    if (parsed == PARSE_EMPTY) {
+        outbuf_printf(out, "No command entered.\n");
+    } else if (parsed == PARSE_SYNTAX_ERROR || parsed == PARSE_BAD_QUOTE) {
+        outbuf_printf(out, "%s", syntax_error_message(parsed));
+        record_status(2);
+    } else if (pl->background >= 0) {
+        run_background(pl, parsed, input, out);
+    } else if (run_builtin(pl, out)) {
+        // BUILT-IN COMMANDS
+    } else if (parsed == PARSE_NEEDS_SH) {
+        sh_pipeline(pl, input, arena);
+        execute_pipeline(pl, out);
+    } else if (!run_cached(pl, out)) {
+        // External commands, pipelines and in-process filters
+        run_pipeline(pl, out);
+    }
+
+    arena_free(&scratch);
+    return last_status[last_status_count - 1];
+}
+
+// Start a command without waiting for its output (see shell.h)
+int start_shell_command(char *input, struct outbuf *out, struct shell_process *proc) {
+    proc->out_fd = proc->channel = -1;
+    proc->pid_count = proc->stage_count = 0;
+
+    struct arena scratch = ARENA_INIT;
+    struct arena *arena = out->arena ? out->arena : &scratch;
+    struct pipeline *pl = arena_alloc(arena, sizeof(*pl));
+    struct session *session = shell_session();
+    session_history_add(session, input);
+    input = session_expand_alias(session, input, arena);
+    enum parse_result parsed = parse_pipeline(input, pl, arena);
+    int ok = -1;
+    last_job = 0;
+    last_stop = NULL;
+
+    if (parsed == PARSE_EMPTY) {
+        outbuf_printf(out, "No command entered.\n");
+    } else if (parsed == PARSE_SYNTAX_ERROR || parsed == PARSE_BAD_QUOTE) {
+        outbuf_printf(out, "%s", syntax_error_message(parsed));
+    } else if (pl->background >= 0) {
+        run_background(pl, parsed, input, out);
+    } else if (!run_builtin(pl, out) && !(parsed == PARSE_OK && run_filters(pl, out))) {
+        if (parsed == PARSE_NEEDS_SH)
+            sh_pipeline(pl, input, arena);
+        ok = launch_pipeline(pl, proc);
+        if (ok < 0) launch_error(ok, out);
+    }
+
+    arena_free(&scratch);
+    return ok < 0 ? -1 : proc->out_fd;
+}
+
+// ---------- TERMINALS ----------
+
+int shell_start_terminal(int rows, int cols, struct shell_process *proc) {
+    proc->out_fd = proc->channel = -1;
+    proc->pid_count = proc->stage_count = 0;
+
+    struct arena scratch = ARENA_INIT;
+    struct pipeline *pl = arena_alloc(&scratch, sizeof(*pl));
+    char **argv = arena_alloc(&scratch, 2 * sizeof(char *));
+    const char *shell = getenv("SHELL");
+    argv[0] = (char *)(shell && *shell ? shell : "/bin/sh");
+    argv[1] = NULL;
+    simple_pipeline(pl, argv, &scratch);
+    pl->terminal = 1;
+    pl->winsize = (struct winsize){ .ws_row = rows, .ws_col = cols };
+    last_job = 0;
+    last_stop = NULL;
+
+    int ok = launch_pipeline(pl, proc);
+    arena_free(&scratch);
+    return ok < 0 ? -1 : proc->out_fd;
+}
+
+int shell_resize_terminal(int fd, int rows, int cols) {
+    struct winsize size = { .ws_row = rows, .ws_col = cols };
+    return ioctl(fd, TIOCSWINSZ, &size);
+}
+
+// ---------- COMPLETION ----------
+// Directory listings are cached by device and inode and reused while the
+// directory's mtime stays the same. A listing read within DIR_RACY_NS of
+// its directory's last change is read again next time, since a change in
+// the same timestamp tick would not move the mtime.
+
+#define DIR_CACHE_SIZE 32
+#define DIR_RACY_NS 20000000LL
+
+struct dir_listing {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    int racy;
+    char **names;                // sorted; directories end in '/'
+    int count;
+    char *text;                  // the names' bytes
+    unsigned long used;          // LRU clock
+};
+
+static pthread_mutex_t dir_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dir_listing dir_cache[DIR_CACHE_SIZE];
+static unsigned long dir_clock;
+
+// Read the directory open at fd into listing (dir_lock held)
+static void dir_listing_read(struct dir_listing *listing, int fd, const struct stat *st) {
+    free(listing->names);
+    free(listing->text);
+    *listing = (struct dir_listing){ .dev = st->st_dev, .ino = st->st_ino, .mtime = st->st_mtim };
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    listing->racy = (now.tv_sec - st->st_mtim.tv_sec) * 1000000000LL + (now.tv_nsec - st->st_mtim.tv_nsec) < DIR_RACY_NS;
+
+    DIR *d = fdopendir(dup(fd));
+    if (!d) return;
+    size_t len = 0, cap = 0;
+    size_t *offsets = NULL;
+    int count = 0, offsets_cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d))) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        int is_dir = entry->d_type == DT_DIR;
+        struct stat target;
+        if ((entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) && fstatat(dirfd(d), name, &target, 0) == 0)
+            is_dir = S_ISDIR(target.st_mode);
+        size_t n = strlen(name);
+        if (len + n + 2 > cap) {
+            cap = (len + n + 2) * 2;
+            listing->text = realloc(listing->text, cap);
+        }
+        if (count == offsets_cap) {
+            offsets_cap = offsets_cap ? offsets_cap * 2 : 256;
+            offsets = realloc(offsets, offsets_cap * sizeof(*offsets));
+        }
+        offsets[count++] = len;
+        memcpy(listing->text + len, name, n);
+        len += n;
+        if (is_dir) listing->text[len++] = '/';
+        listing->text[len++] = '\0';
+    }
+    closedir(d);
+
+    // Pointers only once the text has stopped moving
+    listing->names = malloc((count ? count : 1) * sizeof(char *));
+    for (int i = 0; i < count; i++) listing->names[i] = listing->text + offsets[i];
+    listing->count = count;
+    free(offsets);
+    qsort(listing->names, count, sizeof(char *), compare_names);
+}
+
+// The cached listing of the directory open at fd, read again if it changed,
+// in *out (NULL if fd cannot be examined). With cached_only, -1 instead of
+// reading the directory. (dir_lock held)
+static int dir_listing_get(int fd, int cached_only, struct dir_listing **out) {
+    struct stat st;
+    *out = NULL;
+    if (fstat(fd, &st) == -1) return 0;
+    struct dir_listing *listing = NULL, *oldest = &dir_cache[0];
+    for (int i = 0; i < DIR_CACHE_SIZE; i++) {
+        struct dir_listing *l = &dir_cache[i];
+        if (l->names && l->dev == st.st_dev && l->ino == st.st_ino) listing = l;
+        if (l->used < oldest->used) oldest = l;
+    }
+    if (!listing || listing->racy || listing->mtime.tv_sec != st.st_mtim.tv_sec ||
+        listing->mtime.tv_nsec != st.st_mtim.tv_nsec) {
+        if (cached_only) return -1;
+        if (!listing) listing = oldest;
+        dir_listing_read(listing, fd, &st);
+    }
+    listing->used = ++dir_clock;
+    *out = listing;
+    return 0;
+}
+
+// Take lock, or with cached_only give up if another thread holds it
+static int completion_lock(pthread_mutex_t *lock, int cached_only) {
+    if (cached_only) return pthread_mutex_trylock(lock) == 0 ? 0 : -1;
+    pthread_mutex_lock(lock);
+    return 0;
+}
+
+// First of count sorted names not below key
+static int names_lower_bound(char **names, int count, const char *key) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(names[mid], key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Add a match, prefixed with dir_len bytes of dir, unless max are already in
+static void completion_add(struct completion *c, int max, struct arena *arena, const char *dir, size_t dir_len,
+                           const char *name) {
+    if (c->count >= max) {
+        c->more = 1;
+        return;
+    }
+    size_t len = strlen(name);
+    char *match = arena_alloc(arena, dir_len + len + 1);
+    memcpy(match, dir, dir_len);
+    memcpy(match + dir_len, name, len + 1);
+    c->matches[c->count++] = match;
+}
+
+static int complete_command(const char *word, int max, struct arena *arena, struct completion *c, int cached_only) {
+    size_t len = strlen(word);
+    const char *found[64];
+    int builtin_matches = 0;
+    for (int i = 0; i < builtin_count && builtin_matches < 64; i++)
+        if (strncmp(builtins[i].name, word, len) == 0) found[builtin_matches++] = builtins[i].name;
+    qsort(found, builtin_matches, sizeof(char *), compare_names);
+
+    // Merge the two sorted lists, dropping built-ins that are also on $PATH
+    if (completion_lock(&path_lock, cached_only) == -1) return -1;
+    path_cache_validate();
+    if (cached_only && !path_names) {
+        pthread_mutex_unlock(&path_lock);
+        return -1;
+    }
+    path_names_load();
+    int i = 0, j = names_lower_bound(path_names, path_name_count, word);
+    while (!c->more) {
+        int from_path = j < path_name_count && strncmp(path_names[j], word, len) == 0;
+        if (!from_path && i == builtin_matches) break;
+        int order = !from_path ? -1 : i == builtin_matches ? 1 : strcmp(found[i], path_names[j]);
+        completion_add(c, max, arena, "", 0, order <= 0 ? found[i] : path_names[j]);
+        if (order <= 0) i++;
+        if (order >= 0) j++;
+    }
+    pthread_mutex_unlock(&path_lock);
+    return 0;
+}
+
+static int complete_file(struct session *session, const char *word, int max, struct arena *arena,
+                         struct completion *c, int cached_only) {
+    const char *slash = strrchr(word, '/');
+    const char *part = slash ? slash + 1 : word;
+    size_t dir_len = part - word;
+    char *dir = arena_alloc(arena, dir_len + 2);
+    memcpy(dir, word, dir_len);
+    strcpy(dir + dir_len, dir_len ? "" : ".");
+
+    int cwd = session_cwd(session);
+    int fd = openat(cwd, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cwd >= 0) close(cwd);
+    if (fd == -1) return 0;
+
+    struct dir_listing *listing;
+    if (completion_lock(&dir_lock, cached_only) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (dir_listing_get(fd, cached_only, &listing) == -1) {
+        pthread_mutex_unlock(&dir_lock);
+        close(fd);
+        return -1;
+    }
+    size_t len = strlen(part);
+    for (int i = listing ? names_lower_bound(listing->names, listing->count, part) : 0;
+         listing && i < listing->count && !c->more && strncmp(listing->names[i], part, len) == 0; i++) {
+        // Hidden files only when asked for
+        if (listing->names[i][0] == '.' && part[0] != '.') continue;
+        completion_add(c, max, arena, word, dir_len, listing->names[i]);
+    }
+    pthread_mutex_unlock(&dir_lock);
+    close(fd);
+    return 0;
+}
+
+static int complete(struct session *session, const char *line, int max, struct arena *arena, struct completion *c,
+                    int cached_only) {
+    static const char breaks[] = " \t|;&<>()";
+    size_t start = strlen(line);
+    while (start > 0 && !strchr(breaks, line[start - 1])) start--;
+    size_t before = start;
+    while (before > 0 && (line[before - 1] == ' ' || line[before - 1] == '\t')) before--;
+
+    const char *word = line + start;
+    *c = (struct completion){ .start = start, .matches = arena_alloc(arena, (max > 0 ? max : 1) * sizeof(char *)) };
+    c->files = (before > 0 && !strchr("|;&(", line[before - 1])) || strchr(word, '/');
+    if (c->files) return complete_file(session ? session : session_default(), word, max, arena, c, cached_only);
+    return complete_command(word, max, arena, c, cached_only);
+}
+
+void shell_complete(struct session *session, const char *line, int max, struct arena *arena, struct completion *c) {
+    complete(session, line, max, arena, c, 0);
+}
+
+int shell_complete_cached(struct session *session, const char *line, int max, struct arena *arena,
+                          struct completion *c) {
+    return complete(session, line, max, arena, c, 1);
+}
@@ -0,0 +1,163 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "arena.h"
+
+#define MAX_STAGES 16   // commands in one pipeline
+
+struct session;
+
+// Run a command line and append its output to out. Returns the exit status of
+// the last pipeline stage (0 for built-ins). Scratch memory comes from
+// out->arena when it has one, so a caller that resets that arena between
+// requests runs commands without touching malloc.
+int execute_shell_command(char *input, struct outbuf *out);
+
+// A running command. Output arrives on out_fd. When it is supervised (by the
+// executor daemon, or a thread for in-process stages), channel is the socket
+// that reports its exit statuses and closing it is enough to let the
+// supervisor reap the stages; otherwise channel is -1 and the first
+// pid_count pids are children to reap. pids holds every stage's pid either
+// way (-1 for stages that did not start).
+struct shell_process {
+    int out_fd;
+    int channel;
+    int stage_count;
+    int pid_count;
+    pid_t pids[MAX_STAGES];
+    long long started_ns;        // launch time (metrics_now())
+};
+
+// Resource usage of a command's stages, from wait4()
+struct shell_usage {
+    int64_t user_us, sys_us;
+    int64_t max_rss_kb;          // of the largest stage
+};
+
+// Run the calling thread's commands in session (session.h): its directory,
+// variables, aliases and history. NULL goes back to the server's own state.
+void shell_use_session(struct session *session);
+
+// Fork the executor daemon that launches commands on behalf of the server.
+// Call early, before any threads exist. Returns -1 if commands will be
+// spawned in-process instead, which is refused while any rlimit
+// (WEBSHELL_CPU_LIMIT, _MEMORY_LIMIT, _NPROC_LIMIT, _FILE_LIMIT) is set.
+int executor_start(void);
+
+// Start a command line without waiting, for streaming. External commands and
+// pipelines return the read end of their output pipe and fill proc; the
+// caller reads to EOF, then closes proc->channel or reaps proc->pids.
+// Built-ins, including pipelines ending in the in-process wc/grep/head/tail,
+// run to completion into out and return -1.
+int start_shell_command(char *input, struct outbuf *out, struct shell_process *proc);
+
+// Start an interactive shell ($SHELL, or /bin/sh) in the calling thread's
+// session on a new rows x cols pseudo-terminal, which becomes its
+// controlling terminal. It runs under the job deadline and the usual
+// rlimits. Returns the master side, which carries both its output and its
+// input, and fills proc as start_shell_command() does; -1 if it could not be
+// started.
+int shell_start_terminal(int rows, int cols, struct shell_process *proc);
+
+// Give a terminal a new size; its foreground programs get SIGWINCH
+int shell_resize_terminal(int fd, int rows, int cols);
+
+// Every command runs in a process group of its own under a supervisor that
+// enforces a wall-clock deadline: SIGTERM to the whole group, then SIGKILL
+// two seconds later. WEBSHELL_TIMEOUT sets it in seconds (default 60, 0 for
+// none), WEBSHELL_JOB_TIMEOUT does the same for background jobs (default
+// none). Each process also gets rlimits: WEBSHELL_CPU_LIMIT seconds of CPU
+// (default 600), WEBSHELL_MEMORY_LIMIT MiB of data memory (4096),
+// WEBSHELL_NPROC_LIMIT processes of the user (4096) and WEBSHELL_FILE_LIMIT
+// MiB per file written (1024); 0 lifts a limit.
+
+// Shorten the deadline of the calling thread's next commands to ms (0: back
+// to the configured one)
+void shell_set_timeout(int64_t ms);
+
+// Why the calling thread's last command was stopped early: "timeout",
+// "cpu_limit" or "file_size_limit"; NULL if it was not
+const char *shell_stop_reason(void);
+
+// Background jobs. A command line ending in a lone & starts a job and returns at once with
+// "[id] pid". The job's output is kept in a ring of its last JOB_OUTPUT
+// bytes and it is reaped by a monitor thread, so it never holds a worker.
+// jobs, wait, fg and kill manage the jobs of the current session.
+
+#define JOB_OUTPUT (64 * 1024)
+
+struct job_info {
+    int id;
+    int running;
+    pid_t pid;                   // last stage
+    char command[256];
+    int status[MAX_STAGES];      // once done
+    int status_count;
+    int64_t elapsed_ns;
+    struct shell_usage usage;    // once done
+    const char *stop_reason;     // once done, as shell_stop_reason()
+    uint64_t output_start;       // output bytes [output_start, output_end) were appended
+    uint64_t output_end;
+};
+
+// Describe job id of session (NULL: the server's own state) and append its
+// output from byte since, or from the oldest byte still held. Returns -1 if
+// the session has no such job.
+int shell_job_info(struct session *session, int id, uint64_t since, struct job_info *info, struct outbuf *out);
+
+// Id of the job the calling thread's last command started, or 0
+int shell_last_job(void);
+
+// Exit status of every stage of the calling thread's last command, like
+// bash's PIPESTATUS. Returns the number of stages.
+int shell_pipestatus(int *codes, int max);
+
+// Whether the calling thread's last execute_shell_command() was served from
+// the result cache (result_cache.h)
+enum { SHELL_CACHE_BYPASS, SHELL_CACHE_HIT, SHELL_CACHE_MISS };
+int shell_cache_result(void);
+
+// PATH cache counters (see the `hash` built-in)
+struct path_cache_stats {
+    unsigned long hits, misses;
+    long long saved_ns;          // PATH search time avoided by hits
+    int entries;
+};
+
+// Resolve a command name through the PATH cache. Returns 0 and writes the
+// absolute path to out, or -1 to leave the search to posix_spawnp().
+int path_cache_lookup(const char *name, char *out, size_t size);
+
+void path_cache_stats(struct path_cache_stats *stats);
+
+// Tab completion of the word at the end of line, for the web UI. The word
+// starts after the last blank or shell operator. As a command name (the
+// first word of a command, without a slash) it is completed from the
+// built-ins and the executables on $PATH; otherwise as a file name relative
+// to session's directory (NULL: the server's). Each match is the whole word
+// it would become; directories end in '/'. The $PATH names are listed once
+// per PATH cache flush and directory listings are cached while their mtime
+// holds, so a repeat completion is a stat() and a binary search.
+struct completion {
+    size_t start;                // where the word begins in line
+    int files;                   // file names rather than command names
+    char **matches;              // sorted, in arena
+    int count;                   // at most max
+    int more;                    // matches past max were left out
+};
+
+void shell_complete(struct session *session, const char *line, int max, struct arena *arena, struct completion *c);
+
+// shell_complete() from the caches alone, without blocking: -1 if it would
+// have to list a directory or $PATH, or wait for a completion in progress
+int shell_complete_cached(struct session *session, const char *line, int max, struct arena *arena,
+                          struct completion *c);
+
+// Run a command line through /bin/sh -c (used for syntax the native parser
+// does not handle)
+void handle_redirection_and_piping(char *input, struct outbuf *out);
+
+#endif
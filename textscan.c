@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "textscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// ---------- SCALAR ----------
+
+static inline int is_space(unsigned char c) {
+    return c == ' ' || (unsigned)(c - '\t') <= '\r' - '\t';
+}
+
+static size_t count_scalar(const char *data, size_t len, char c) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+        n += data[i] == c;
+    return n;
+}
+
+static const char *find_scalar(const char *data, size_t len, const char *needle, size_t needle_len) {
+    return memmem(data, len, needle, needle_len);
+}
+
+static size_t words_scalar(const char *data, size_t len, int *in_word) {
+    size_t words = 0;
+    int in = *in_word;
+    for (size_t i = 0; i < len; i++) {
+        if (is_space(data[i])) {
+            in = 0;
+        } else {
+            words += !in;
+            in = 1;
+        }
+    }
+    *in_word = in;
+    return words;
+}
+
+static size_t json_plain_scalar(const char *data, size_t len) {
+    size_t i = 0;
+    for (; i < len; i++) {
+        unsigned char c = data[i];
+        if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\') break;
+    }
+    return i;
+}
+
+static size_t url_plain_scalar(const char *data, size_t len) {
+    size_t i = 0;
+    while (i < len && data[i] != '%' && data[i] != '+') i++;
+    return i;
+}
+
+#ifdef SCAN_X86
+// ---------- SSE2 ----------
+// Byte compares produce -1 per match; subtracting them into byte counters and
+// folding those with psadbw every 255 blocks counts 16 bytes per step.
+
+__attribute__((target("sse2")))
+static size_t count_sse2(const char *data, size_t len, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t total = 0, i = 0;
+    while (len - i >= 16) {
+        size_t blocks = (len - i) / 16;
+        if (blocks > 255) blocks = 255;
+        __m128i acc = _mm_setzero_si128();
+        for (size_t b = 0; b < blocks; b++, i += 16)
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), needle));
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        total += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+    }
+    return total + count_scalar(data + i, len - i, c);
+}
+
+// Candidates are positions where both the first and the last byte of the
+// needle match; only those are compared in full.
+__attribute__((target("sse2")))
+static const char *find_sse2(const char *data, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len < 2 || needle_len > len) return find_scalar(data, len, needle, needle_len);
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 16 <= len; i += 16) {
+        __m128i head = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i tail = _mm_loadu_si128((const __m128i *)(data + i + needle_len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + __builtin_ctz(mask);
+            if (memcmp(data + at + 1, needle + 1, needle_len - 2) == 0) return data + at;
+        }
+    }
+    return find_scalar(data + i, len - i, needle, needle_len);
+}
+
+// A word starts at every non-space byte whose predecessor is a space
+__attribute__((target("sse2")))
+static size_t words_sse2(const char *data, size_t len, int *in_word) {
+    const __m128i tab = _mm_set1_epi8('\t'), span = _mm_set1_epi8('\r' - '\t'), space = _mm_set1_epi8(' ');
+    unsigned prev_space = !*in_word;
+    size_t words = 0, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i ctrl = _mm_sub_epi8(v, tab);
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(_mm_min_epu8(ctrl, span), ctrl));
+        unsigned spaces = _mm_movemask_epi8(ws);
+        words += __builtin_popcount(~spaces & ((spaces << 1) | prev_space) & 0xffff);
+        prev_space = spaces >> 15;
+    }
+    *in_word = !prev_space;
+    return words + words_scalar(data + i, len - i, in_word);
+}
+
+// Signed compare: 0x20 > c holds for control characters and for every byte
+// >= 0x80, so one compare finds both
+__attribute__((target("sse2")))
+static size_t json_plain_sse2(const char *data, size_t len) {
+    const __m128i limit = _mm_set1_epi8(0x20), quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i special = _mm_or_si128(_mm_cmpgt_epi8(limit, v),
+                                       _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+        unsigned mask = _mm_movemask_epi8(special);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + json_plain_scalar(data + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t url_plain_sse2(const char *data, size_t len) {
+    const __m128i percent = _mm_set1_epi8('%'), plus = _mm_set1_epi8('+');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, plus)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + url_plain_scalar(data + i, len - i);
+}
+
+// ---------- AVX2 ----------
+// The SSE2 kernels, 32 bytes at a time.
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const char *data, size_t len, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t total = 0, i = 0;
+    while (len - i >= 32) {
+        size_t blocks = (len - i) / 32;
+        if (blocks > 255) blocks = 255;
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t b = 0; b < blocks; b++, i += 32)
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), needle));
+        __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        total += (size_t)_mm_cvtsi128_si32(half) + (size_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(half, half));
+    }
+    return total + count_scalar(data + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *data, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len < 2 || needle_len > len) return find_scalar(data, len, needle, needle_len);
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 32 <= len; i += 32) {
+        __m256i head = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i tail = _mm256_loadu_si256((const __m256i *)(data + i + needle_len - 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first),
+                                                              _mm256_cmpeq_epi8(tail, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + __builtin_ctz(mask);
+            if (memcmp(data + at + 1, needle + 1, needle_len - 2) == 0) return data + at;
+        }
+    }
+    return find_scalar(data + i, len - i, needle, needle_len);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t words_avx2(const char *data, size_t len, int *in_word) {
+    const __m256i tab = _mm256_set1_epi8('\t'), span = _mm256_set1_epi8('\r' - '\t');
+    const __m256i space = _mm256_set1_epi8(' ');
+    uint32_t prev_space = !*in_word;
+    size_t words = 0, i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i ctrl = _mm256_sub_epi8(v, tab);
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                     _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, span), ctrl));
+        uint32_t spaces = _mm256_movemask_epi8(ws);
+        words += __builtin_popcount(~spaces & ((spaces << 1) | prev_space));
+        prev_space = spaces >> 31;
+    }
+    *in_word = !prev_space;
+    return words + words_scalar(data + i, len - i, in_word);
+}
+
+__attribute__((target("avx2")))
+static size_t json_plain_avx2(const char *data, size_t len) {
+    const __m256i limit = _mm256_set1_epi8(0x20), quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i special = _mm256_or_si256(_mm256_cmpgt_epi8(limit, v),
+                                          _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)));
+        uint32_t mask = _mm256_movemask_epi8(special);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + json_plain_sse2(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t url_plain_avx2(const char *data, size_t len) {
+    const __m256i percent = _mm256_set1_epi8('%'), plus = _mm256_set1_epi8('+');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, percent), _mm256_cmpeq_epi8(v, plus)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + url_plain_sse2(data + i, len - i);
+}
+#endif
+
+// ---------- DISPATCH ----------
+
+struct scan_ops {
+    const char *name;
+    size_t (*count)(const char *, size_t, char);
+    const char *(*find)(const char *, size_t, const char *, size_t);
+    size_t (*words)(const char *, size_t, int *);
+    size_t (*json_plain)(const char *, size_t);
+    size_t (*url_plain)(const char *, size_t);
+};
+
+static const struct scan_ops scan_versions[] = {
+#ifdef SCAN_X86
+    { "avx2", count_avx2, find_avx2, words_avx2, json_plain_avx2, url_plain_avx2 },
+    { "sse2", count_sse2, find_sse2, words_sse2, json_plain_sse2, url_plain_sse2 },
+#endif
+    { "scalar", count_scalar, find_scalar, words_scalar, json_plain_scalar, url_plain_scalar },
+};
+
+static const struct scan_ops *ops;
+static pthread_once_t ops_once = PTHREAD_ONCE_INIT;
+
+static int scan_supported(const struct scan_ops *version) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(version->name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    if (strcmp(version->name, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+#endif
+    (void)version;
+    return 1;
+}
+
+// The first supported version, or the one named by WEBSHELL_SIMD
+static void scan_select(void) {
+    const char *wanted = getenv("WEBSHELL_SIMD");
+    size_t count = sizeof(scan_versions) / sizeof(scan_versions[0]);
+    for (size_t i = 0; i < count && !ops; i++)
+        if (scan_supported(&scan_versions[i]) && (!wanted || strcmp(wanted, scan_versions[i].name) == 0))
+            ops = &scan_versions[i];
+    if (!ops) ops = &scan_versions[count - 1];
+}
+
+static inline const struct scan_ops *scan_ops(void) {
+    pthread_once(&ops_once, scan_select);
+    return ops;
+}
+
+size_t scan_count(const char *data, size_t len, char c) {
+    return scan_ops()->count(data, len, c);
+}
+
+const char *scan_find(const char *data, size_t len, const char *needle, size_t needle_len) {
+    return scan_ops()->find(data, len, needle, needle_len);
+}
+
+size_t scan_words(const char *data, size_t len, int *in_word) {
+    return scan_ops()->words(data, len, in_word);
+}
+
+size_t scan_json_plain(const char *data, size_t len) {
+    return scan_ops()->json_plain(data, len);
+}
+
+size_t scan_url_plain(const char *data, size_t len) {
+    return scan_ops()->url_plain(data, len);
+}
+
+const char *scan_impl(void) {
+    return scan_ops()->name;
+}
@@ -0,0 +1,31 @@
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <stddef.h>
+
+// Byte-scanning kernels behind the in-process wc, grep, head and tail and
+// the JSON and URL codecs in escape.c. Each has an AVX2, an SSE2 and a
+// scalar version; the best one the CPU supports is picked on first use. WEBSHELL_SIMD=avx2|sse2|scalar forces a version
+// (for benchmarks). Thread-safe.
+
+// Number of occurrences of c in data
+size_t scan_count(const char *data, size_t len, char c);
+
+// First occurrence of needle in data, or NULL
+const char *scan_find(const char *data, size_t len, const char *needle, size_t needle_len);
+
+// Number of words (runs of non-whitespace) starting in data. *in_word says
+// whether the previous chunk ended inside a word and is updated for the next.
+size_t scan_words(const char *data, size_t len, int *in_word);
+
+// Length of the prefix of data that goes into a JSON string unchanged:
+// printable ASCII other than '"' and '\\'
+size_t scan_json_plain(const char *data, size_t len);
+
+// Length of the prefix of data without '%' or '+'
+size_t scan_url_plain(const char *data, size_t len);
+
+// Name of the version in use: "avx2", "sse2" or "scalar"
+const char *scan_impl(void);
+
+#endif
@@ -0,0 +1,54 @@
+// Generates builtin_hash.h, the perfect-hash lookup table for builtins.def.
+// Build and run from the repository root:
+//   gcc tools/gen_builtin_hash.c -o gen_builtin_hash && ./gen_builtin_hash > builtin_hash.h
+#include <stdio.h>
+#include <string.h>
+#include "../builtins.h"
+
+#define BUILTIN(name, handler, min_args, max_args, usage, description) #name,
+static const char *names[] = {
+#include "../builtins.def"
+};
+#undef BUILTIN
+
+#define NAME_COUNT (int)(sizeof(names) / sizeof(names[0]))
+
+int main(void) {
+    // Slots are stored as signed char
+    if (NAME_COUNT > 127) {
+        fprintf(stderr, "too many built-ins for the slot table\n");
+        return 1;
+    }
+
+    // Table at least twice the number of names keeps the seed search short
+    int size = 1;
+    while (size < 2 * NAME_COUNT) size <<= 1;
+
+    for (uint32_t seed = 1; seed != 0; seed++) {
+        int slots[256];
+        for (int i = 0; i < size; i++) slots[i] = -1;
+
+        int ok = 1;
+        for (int i = 0; i < NAME_COUNT && ok; i++) {
+            uint32_t slot = builtin_hash(names[i], seed) & (size - 1);
+            if (slots[slot] != -1) ok = 0;
+            else slots[slot] = i;
+        }
+        if (!ok) continue;
+
+        printf("// Generated by tools/gen_builtin_hash.c from builtins.def. Do not edit.\n");
+        printf("#ifndef BUILTIN_HASH_H\n#define BUILTIN_HASH_H\n\n");
+        printf("#define BUILTIN_HASH_COUNT %d\n", NAME_COUNT);
+        printf("#define BUILTIN_HASH_SEED %uu\n", seed);
+        printf("#define BUILTIN_HASH_SIZE %d\n\n", size);
+        printf("// Index into builtins[] for each slot, -1 if empty\n");
+        printf("static const signed char builtin_slots[BUILTIN_HASH_SIZE] = {");
+        for (int i = 0; i < size; i++)
+            printf("%s%d", i == 0 ? "\n    " : i % 16 ? ", " : ",\n    ", slots[i]);
+        printf("\n};\n\n#endif\n");
+        return 0;
+    }
+
+    fprintf(stderr, "no perfect hash seed found\n");
+    return 1;
+}
@@ -0,0 +1,173 @@
+#include <stdint.h>
+#include <string.h>
+#include "websocket.h"
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+// ---------- HANDSHAKE ----------
+// SHA-1 is only used on the short key of each handshake, so the plain
+// textbook version is plenty.
+
+struct sha1 {
+    uint32_t h[5];
+    unsigned char block[64];
+    size_t block_len;
+    uint64_t total;
+};
+
+static uint32_t rol(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static void sha1_block(struct sha1 *s, const unsigned char *p) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 80; i++)
+        w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3], e = s->h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) f = (b & c) | (~b & d), k = 0x5A827999;
+        else if (i < 40) f = b ^ c ^ d, k = 0x6ED9EBA1;
+        else if (i < 60) f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+        else f = b ^ c ^ d, k = 0xCA62C1D6;
+        uint32_t t = rol(a, 5) + f + e + k + w[i];
+        e = d, d = c, c = rol(b, 30), b = a, a = t;
+    }
+    s->h[0] += a, s->h[1] += b, s->h[2] += c, s->h[3] += d, s->h[4] += e;
+}
+
+static void sha1_init(struct sha1 *s) {
+    static const uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    memcpy(s->h, h, sizeof(h));
+    s->block_len = 0;
+    s->total = 0;
+}
+
+static void sha1_update(struct sha1 *s, const void *data, size_t len) {
+    const unsigned char *p = data;
+    s->total += len;
+    while (len > 0) {
+        size_t n = 64 - s->block_len < len ? 64 - s->block_len : len;
+        memcpy(s->block + s->block_len, p, n);
+        s->block_len += n;
+        p += n;
+        len -= n;
+        if (s->block_len == 64) {
+            sha1_block(s, s->block);
+            s->block_len = 0;
+        }
+    }
+}
+
+static void sha1_final(struct sha1 *s, unsigned char digest[20]) {
+    uint64_t bits = s->total * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t pad_len = (s->block_len < 56 ? 56 : 120) - s->block_len;
+    for (int i = 0; i < 8; i++) pad[pad_len + i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha1_update(s, pad, pad_len + 8);
+    for (int i = 0; i < 20; i++) digest[i] = (unsigned char)(s->h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+static void base64_encode(const unsigned char *in, size_t len, char *out) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < len ? in[i + 1] << 8 : 0) | (i + 2 < len ? in[i + 2] : 0);
+        *out++ = digits[v >> 18];
+        *out++ = digits[(v >> 12) & 63];
+        *out++ = i + 1 < len ? digits[(v >> 6) & 63] : '=';
+        *out++ = i + 2 < len ? digits[v & 63] : '=';
+    }
+    *out = '\0';
+}
+
+void ws_accept_key(const char *key, size_t len, char out[WS_ACCEPT_LEN + 1]) {
+    struct sha1 s;
+    unsigned char digest[20];
+    sha1_init(&s);
+    sha1_update(&s, key, len);
+    sha1_update(&s, WS_GUID, sizeof(WS_GUID) - 1);
+    sha1_final(&s, digest);
+    base64_encode(digest, sizeof(digest), out);
+}
+
+// ---------- FRAMES ----------
+
+enum ws_result ws_parse_frame(const unsigned char *buf, size_t len, size_t max_len, struct ws_frame *frame,
+                              int *error) {
+    *error = WS_CLOSE_PROTOCOL;
+    if (len < 2) return WS_INCOMPLETE;
+    frame->fin = buf[0] >> 7;
+    frame->opcode = buf[0] & 0x0F;
+    if (buf[0] & 0x70) return WS_ERROR;
+    if (!(buf[1] & 0x80)) return WS_ERROR;    // clients must mask
+
+    int control = frame->opcode >= WS_CLOSE;
+    if (frame->opcode > WS_PONG || (frame->opcode > WS_BINARY && !control)) return WS_ERROR;
+
+    size_t payload = buf[1] & 0x7F, pos = 2;
+    if (control && (!frame->fin || payload > 125)) return WS_ERROR;
+    if (payload == 126) {
+        if (len < 4) return WS_INCOMPLETE;
+        payload = (size_t)buf[2] << 8 | buf[3];
+        pos = 4;
+    } else if (payload == 127) {
+        if (len < 10) return WS_INCOMPLETE;
+        if (buf[2] & 0x80) return WS_ERROR;
+        uint64_t n = 0;
+        for (int i = 2; i < 10; i++) n = n << 8 | buf[i];
+        if (n > max_len) {
+            *error = WS_CLOSE_TOO_BIG;
+            return WS_ERROR;
+        }
+        payload = (size_t)n;
+        pos = 10;
+    }
+    if (payload > max_len) {
+        *error = WS_CLOSE_TOO_BIG;
+        return WS_ERROR;
+    }
+
+    if (len < pos + 4) return WS_INCOMPLETE;
+    memcpy(frame->mask, buf + pos, 4);
+    frame->header_len = pos + 4;
+    frame->len = payload;
+    return len - frame->header_len < payload ? WS_INCOMPLETE : WS_COMPLETE;
+}
+
+void ws_unmask(unsigned char *payload, size_t len, const unsigned char mask[4]) {
+    // Eight bytes at a time; the mask repeats every four, so doubled it
+    // lines up with every 8-byte step
+    uint64_t wide;
+    unsigned char m8[8];
+    memcpy(m8, mask, 4);
+    memcpy(m8 + 4, mask, 4);
+    memcpy(&wide, m8, 8);
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, payload + i, 8);
+        v ^= wide;
+        memcpy(payload + i, &v, 8);
+    }
+    for (; i < len; i++) payload[i] ^= mask[i & 3];
+}
+
+size_t ws_frame_header(unsigned char *out, int opcode, size_t len) {
+    out[0] = 0x80 | opcode;
+    if (len < 126) {
+        out[1] = (unsigned char)len;
+        return 2;
+    }
+    if (len <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = (unsigned char)(len >> 8);
+        out[3] = (unsigned char)len;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) out[2 + i] = (unsigned char)((uint64_t)len >> (56 - 8 * i));
+    return 10;
+}
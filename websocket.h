@@ -0,0 +1,55 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stddef.h>
+
+// WebSocket framing (RFC 6455) for the terminal endpoint. Like http.h this
+// only turns bytes into frames and back; the server does all the I/O. Client
+// frames are parsed where they lie in the input buffer and unmasked in
+// place; server frames are never masked, so only a header has to be built.
+// No extensions are negotiated.
+
+#define WS_MAX_HEADER 14         // 2 bytes, 8 of extended length, 4 of mask
+#define WS_ACCEPT_LEN 28         // base64 of a SHA-1 digest
+
+enum ws_opcode {
+    WS_CONTINUATION = 0x0,
+    WS_TEXT = 0x1,
+    WS_BINARY = 0x2,
+    WS_CLOSE = 0x8,
+    WS_PING = 0x9,
+    WS_PONG = 0xA,
+};
+
+// Close status codes the server sends
+enum { WS_CLOSE_NORMAL = 1000, WS_CLOSE_PROTOCOL = 1002, WS_CLOSE_TOO_BIG = 1009 };
+
+enum ws_result { WS_INCOMPLETE, WS_COMPLETE, WS_ERROR };
+
+struct ws_frame {
+    int fin;                     // last frame of its message
+    int opcode;
+    size_t header_len;           // the payload starts here
+    size_t len;                  // payload length
+    unsigned char mask[4];
+};
+
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key: base64(SHA-1(key + GUID)),
+// NUL-terminated
+void ws_accept_key(const char *key, size_t len, char out[WS_ACCEPT_LEN + 1]);
+
+// Parse the frame at the start of buf. WS_COMPLETE once the header and the
+// whole payload are there. Unmasked, reserved-bit and unknown-opcode frames,
+// fragmented or long control frames and payloads over max_len are errors;
+// *error is then the close code to answer with.
+enum ws_result ws_parse_frame(const unsigned char *buf, size_t len, size_t max_len, struct ws_frame *frame,
+                              int *error);
+
+// Unmask a client frame's payload in place
+void ws_unmask(unsigned char *payload, size_t len, const unsigned char mask[4]);
+
+// Write the header of a server frame with a len-byte payload to out, which
+// has room for WS_MAX_HEADER bytes. Returns its length.
+size_t ws_frame_header(unsigned char *out, int opcode, size_t len);
+
+#endif